@@ -0,0 +1,463 @@
+#pragma once
+
+#include "Scene.hpp"
+#include "global.hpp"
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * \brief 双向路径追踪（BDPT）：每个采样分别从相机与面光源出发各生成一条子路径，
+ * 把相机子路径的前t个顶点与光源子路径的前s个顶点两两连接，得到长度相同的多种采样策略，
+ * 以平衡启发式按各策略生成同一路径的面积测度概率密度加权（多重重要性采样）。
+ * t = 1的策略把光源子路径上的顶点直接连到相机，贡献落在任意像素上，写入线程安全的胶片。
+ * 光源被遮挡、只能经漫反射间接照亮场景时，从光源一侧出发的策略方差远小于路径追踪。
+ * 与路径追踪一致，面光源单面发光并吸收所有入射光（光源上的顶点不再继续反射）
+ */
+
+struct BDPTSettings
+{
+    // 路径的最大边数
+    int maxDepth = 8;
+    // 子路径超过该顶点数后按Scene::RussianRoulette的概率继续
+    int rouletteDepth = 3;
+};
+
+namespace bdpt
+{
+    /**
+     * \brief 针孔相机，与Renderer生成相机光线的方式一致：相机看向+z，成像平面位于z = 1处，
+     * 半宽tanX（水平方向与像素列的增长方向相反）、半高tanY
+     */
+    struct Camera
+    {
+        Vector3f eye;
+        float tanX, tanY;
+        int width, height;
+
+        // 成像平面的面积
+        float area() const { return 4 * tanX * tanY; }
+        bool inFrustum(const Vector3f &w) const
+        {
+            return w.z > 0 && std::fabs(w.x) <= tanX * w.z && std::fabs(w.y) <= tanY * w.z;
+        }
+        // 单位方向w的重要性We = 1 / (A cos⁴θ)，整幅图像上积分为1
+        float We(const Vector3f &w) const
+        {
+            return inFrustum(w) ? 1 / (area() * w.z * w.z * w.z * w.z) : 0;
+        }
+        // 沿单位方向w发出相机光线的立体角概率密度1 / (A cos³θ)
+        float pdfDir(const Vector3f &w) const
+        {
+            return inFrustum(w) ? 1 / (area() * w.z * w.z * w.z) : 0;
+        }
+        // 点p投影到图像上的像素坐标
+        bool raster(const Vector3f &p, float &x, float &y) const
+        {
+            Vector3f d = p - eye;
+            if (d.z <= 0)
+                return false;
+            x = (-d.x / d.z / tanX + 1) / 2 * width;
+            y = (1 - d.y / d.z / tanY) / 2 * height;
+            return x >= 0 && y >= 0 && x < width && y < height;
+        }
+    };
+
+    enum class VertexType
+    {
+        Camera,
+        Light,  // 面光源上的点
+        Surface // 非光源表面上的点
+    };
+
+    struct Vertex
+    {
+        VertexType type = VertexType::Surface;
+        Vector3f p, n;           // 位置与法线（相机顶点的法线无意义）
+        Vector3f beta;           // 从子路径起点到该顶点的吞吐量
+        const Material *m = nullptr;
+        Vector3f albedo;         // 纹理材质在该点处的反照率
+        Vector3f Le;             // 光源顶点的自发光
+        bool delta = false;      // 该点按delta分布（镜面）散射
+        float pdfFwd = 0;        // 沿子路径生成该点的面积测度概率密度
+        float pdfRev = 0;        // 从另一侧反向生成该点的面积测度概率密度
+
+        bool connectible() const { return type != VertexType::Surface || !delta; }
+    };
+
+    // 临时修改一个值，离开作用域时恢复
+    template <typename T>
+    struct ScopedAssignment
+    {
+        T *target = nullptr;
+        T backup;
+        ScopedAssignment() = default;
+        ScopedAssignment(T *target, const T &value) : target(target)
+        {
+            if (target)
+            {
+                backup = *target;
+                *target = value;
+            }
+        }
+        ScopedAssignment &operator=(ScopedAssignment &&other)
+        {
+            std::swap(target, other.target);
+            std::swap(backup, other.backup);
+            return *this;
+        }
+        ~ScopedAssignment()
+        {
+            if (target)
+                *target = backup;
+        }
+    };
+
+    struct Context
+    {
+        const Scene &scene;
+        Camera camera;
+        BDPTSettings settings;
+        float lightArea = 0; // 所有面光源的总面积，Scene::sampleLight按面积均匀采样光源
+
+        Context(const Scene &scene, const Camera &camera, const BDPTSettings &settings)
+            : scene(scene), camera(camera), settings(settings)
+        {
+            for (Object *object : scene.get_objects())
+                if (object->hasEmit())
+                    lightArea += object->getArea();
+        }
+
+        // 按顶点的材质类型调用f(bsdf)，纹理材质代入该点的反照率
+        template <typename F>
+        auto withBSDF(const Vertex &v, F &&f) const
+        {
+            return v.m->dispatch([&](const auto &kernel)
+                                 {
+                                     if (!(v.m->flags() & MATERIAL_TEXTURED))
+                                         return f(kernel);
+                                     auto textured = kernel;
+                                     bsdf::setAlbedo(textured, v.albedo, 0);
+                                     return f(textured); });
+        }
+
+        // 表面顶点的BSDF值，toPrev、toNext为指向两侧顶点的单位方向
+        Vector3f f(const Vertex &v, const Vector3f &toPrev, const Vector3f &toNext) const
+        {
+            if (v.type != VertexType::Surface || v.delta || dotProduct(toPrev, v.n) <= 0)
+                return Vector3f();
+            return withBSDF(v, [&](const auto &bsdf)
+                            { return bsdf.eval(-toPrev, toNext, v.n); });
+        }
+
+        // 光源顶点沿方向w的自发光（单面）
+        Vector3f Le(const Vertex &v, const Vector3f &w) const
+        {
+            return v.type == VertexType::Light && dotProduct(v.n, w) > 0 ? v.Le : Vector3f();
+        }
+
+        // 把从v出发的立体角概率密度换算为next处的面积测度
+        float convertDensity(const Vertex &v, float pdf, const Vertex &next) const
+        {
+            Vector3f w = next.p - v.p;
+            float dist2 = dotProduct(w, w);
+            if (dist2 <= 0)
+                return 0;
+            if (next.type != VertexType::Camera)
+                pdf *= std::fabs(dotProduct(next.n, w)) / std::sqrt(dist2);
+            return pdf / dist2;
+        }
+
+        // 光源顶点v按余弦分布发射时生成next的面积测度概率密度
+        float pdfLight(const Vertex &v, const Vertex &next) const
+        {
+            Vector3f w = (next.p - v.p).normalized();
+            float cosTheta = dotProduct(v.n, w);
+            return cosTheta > 0 ? convertDensity(v, cosTheta / M_PI, next) : 0;
+        }
+
+        // 光源子路径的起点落在光源顶点v处的面积测度概率密度
+        float pdfLightOrigin(const Vertex &) const { return lightArea > 0 ? 1 / lightArea : 0; }
+
+        // 已知前一个顶点prev时，从v采样生成next的面积测度概率密度
+        float pdf(const Vertex &v, const Vertex *prev, const Vertex &next) const
+        {
+            if (v.type == VertexType::Light)
+                return pdfLight(v, next);
+            Vector3f toNext = next.p - v.p;
+            if (dotProduct(toNext, toNext) <= 0)
+                return 0;
+            toNext = toNext.normalized();
+            float pdf = 0;
+            if (v.type == VertexType::Camera)
+                pdf = camera.pdfDir(toNext);
+            else if (prev && !v.delta)
+            {
+                Vector3f toPrev = (prev->p - v.p).normalized();
+                pdf = withBSDF(v, [&](const auto &bsdf)
+                               { return bsdf.pdf(-toPrev, toNext, v.n); });
+            }
+            return convertDensity(v, pdf, next);
+        }
+
+        // a、b之间无遮挡时的几何项|cosθa| |cosθb| / r²（相机顶点不计余弦），被遮挡时为0
+        float G(const Vertex &a, const Vertex &b) const
+        {
+            Vector3f d = b.p - a.p;
+            float dist2 = dotProduct(d, d);
+            if (dist2 <= 0)
+                return 0;
+            float dist = std::sqrt(dist2);
+            Vector3f w = d / dist;
+            STAT_INC(shadowRays);
+            if (scene.intersect(Ray(a.p, w)).distance - dist <= -EPSILON)
+                return 0;
+            float g = 1 / dist2;
+            if (a.type != VertexType::Camera)
+                g *= std::fabs(dotProduct(a.n, w));
+            if (b.type != VertexType::Camera)
+                g *= std::fabs(dotProduct(b.n, w));
+            return g;
+        }
+
+        /**
+         * @brief 沿ray随机游走，把交点依次写入path（最多maxVertices个），返回写入的顶点数。
+         *        相机子路径命中光源时记录该光源顶点后停止，光源子路径命中光源时直接停止
+         * @param pdfDir 第一条光线方向的立体角概率密度
+         * @param[out] escaped 光线逃出场景时的环境光贡献（只有相机子路径能得到，不与其他策略加权）
+         */
+        int randomWalk(Ray ray, Vector3f beta, float pdfDir, int maxVertices, bool fromCamera, Vertex *path, Vector3f &escaped) const
+        {
+            int bounces = 0;
+            float pdfFwd = pdfDir;
+            while (bounces < maxVertices)
+            {
+                STAT_INC(bounceRays);
+                Intersection inter = scene.intersect(ray);
+                if (!inter.happened)
+                {
+                    if (fromCamera && scene.environment)
+                        escaped += beta * scene.environment->eval(ray.direction);
+                    break;
+                }
+                Vertex &v = path[bounces], &prev = path[bounces - 1];
+                v = Vertex();
+                v.p = inter.coords;
+                v.beta = beta;
+                if (inter.m->flags() & MATERIAL_EMISSIVE)
+                {
+                    if (!fromCamera)
+                        break;
+                    v.type = VertexType::Light;
+                    v.n = inter.normal;
+                    v.Le = inter.m->getEmission();
+                    v.pdfFwd = convertDensity(prev, pdfFwd, v);
+                    ++bounces;
+                    break;
+                }
+                v.n = scene.shadingNormal(ray, inter);
+                v.m = inter.m;
+                if (inter.m->flags() & MATERIAL_TEXTURED)
+                    v.albedo = scene.textureAlbedo(ray, inter, v.n);
+                v.pdfFwd = convertDensity(prev, pdfFwd, v);
+                if (++bounces >= maxVertices)
+                    break;
+
+                // 按BSDF采样下一个方向，并记录反向采样的概率密度
+                Vector3f wo;
+                float pdfRev = 0;
+                bool delta = false;
+                Vector3f f = scene.dispatchShading(ray, inter, v.n, [&](const auto &bsdf)
+                                                   {
+                                                       using BSDFType = std::decay_t<decltype(bsdf)>;
+                                                       delta = BSDFType::flags & MATERIAL_DELTA;
+                                                       wo = bsdf.sample(ray.direction, v.n).normalized();
+                                                       pdfFwd = bsdf.pdf(ray.direction, wo, v.n);
+                                                       pdfRev = bsdf.pdf(-wo, -ray.direction, v.n);
+                                                       return bsdf.eval(ray.direction, wo, v.n); });
+                if (pdfFwd <= EPSILON || dotProduct(-ray.direction, v.n) <= 0)
+                    break;
+                beta = beta * f * std::fabs(dotProduct(wo, v.n)) / pdfFwd;
+                if (!(luminance(beta) > 0))
+                    break;
+                if (bounces >= settings.rouletteDepth)
+                {
+                    if (get_random_float() > scene.RussianRoulette)
+                        break;
+                    beta = beta / scene.RussianRoulette;
+                }
+                if (delta)
+                {
+                    v.delta = true;
+                    pdfFwd = pdfRev = 0;
+                }
+                prev.pdfRev = convertDensity(v, pdfRev, prev);
+                ray = Ray(v.p, wo);
+            }
+            return bounces;
+        }
+
+        // 相机子路径：起点为相机，沿相机光线ray游走；看到的环境光累加到Lenv
+        int cameraSubpath(const Ray &ray, Vertex *path, Vector3f &Lenv) const
+        {
+            path[0] = Vertex();
+            path[0].type = VertexType::Camera;
+            path[0].p = ray.origin;
+            path[0].beta = Vector3f(1.0f);
+            STAT_INC(cameraRays);
+            return 1 + randomWalk(ray, Vector3f(1.0f), camera.pdfDir(ray.direction), settings.maxDepth + 1, true, path + 1, Lenv);
+        }
+
+        // 光源子路径：按面积采样光源上一点，按余弦分布发射
+        int lightSubpath(Vertex *path) const
+        {
+            Intersection light;
+            float pdfPos;
+            scene.sampleLight(light, pdfPos);
+            if (!(pdfPos > 0))
+                return 0;
+            path[0] = Vertex();
+            path[0].type = VertexType::Light;
+            path[0].p = light.coords;
+            path[0].n = light.normal;
+            path[0].Le = light.emit;
+            path[0].beta = light.emit / pdfPos;
+            path[0].pdfFwd = pdfPos;
+
+            float u1 = get_random_float(), u2 = get_random_float();
+            float r = std::sqrt(u1), phi = 2 * M_PI * u2;
+            Vector3f dir = bsdf::toWorld(Vector3f(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1 - u1))), light.normal);
+            float pdfDir = dotProduct(dir, light.normal) / M_PI;
+            if (pdfDir <= 0)
+                return 1;
+            // Le cosθ / (pdfPos pdfDir) = Le π / pdfPos
+            Vector3f beta = light.emit * M_PI / pdfPos;
+            Vector3f escaped;
+            return 1 + randomWalk(Ray(light.coords, dir), beta, pdfDir, settings.maxDepth, false, path + 1, escaped);
+        }
+
+        /**
+         * @brief 连接策略(s, t)的多重重要性采样权重（平衡启发式）：沿两条子路径依次比较
+         *        其他连接位置生成同一路径的概率密度，sampled为s = 1或t = 1时新采样的端点
+         */
+        float misWeight(Vertex *light, Vertex *cam, const Vertex &sampled, int s, int t) const
+        {
+            if (s + t == 2)
+                return 1;
+            auto remap0 = [](float f)
+            { return f != 0 ? f : 1; };
+            Vertex *qs = s > 0 ? &light[s - 1] : nullptr, *pt = t > 0 ? &cam[t - 1] : nullptr;
+            Vertex *qsMinus = s > 1 ? &light[s - 2] : nullptr, *ptMinus = t > 1 ? &cam[t - 2] : nullptr;
+
+            ScopedAssignment<Vertex> a1;
+            if (s == 1)
+                a1 = ScopedAssignment<Vertex>(qs, sampled);
+            else if (t == 1)
+                a1 = ScopedAssignment<Vertex>(pt, sampled);
+            // 连接处的顶点不是delta分布
+            ScopedAssignment<bool> a2, a3;
+            if (pt)
+                a2 = ScopedAssignment<bool>(&pt->delta, false);
+            if (qs)
+                a3 = ScopedAssignment<bool>(&qs->delta, false);
+            // 连接后两端附近顶点的反向概率密度
+            ScopedAssignment<float> a4, a5, a6, a7;
+            if (pt)
+                a4 = ScopedAssignment<float>(&pt->pdfRev, s > 0 ? pdf(*qs, qsMinus, *pt) : pdfLightOrigin(*pt));
+            if (ptMinus)
+                a5 = ScopedAssignment<float>(&ptMinus->pdfRev, s > 0 ? pdf(*pt, qs, *ptMinus) : pdfLight(*pt, *ptMinus));
+            if (qs)
+                a6 = ScopedAssignment<float>(&qs->pdfRev, pdf(*pt, ptMinus, *qs));
+            if (qsMinus)
+                a7 = ScopedAssignment<float>(&qsMinus->pdfRev, pdf(*qs, pt, *qsMinus));
+
+            float sumRi = 0, ri = 1;
+            for (int i = t - 1; i > 0; --i)
+            {
+                ri *= remap0(cam[i].pdfRev) / remap0(cam[i].pdfFwd);
+                if (!cam[i].delta && !cam[i - 1].delta)
+                    sumRi += ri;
+            }
+            ri = 1;
+            for (int i = s - 1; i >= 0; --i)
+            {
+                ri *= remap0(light[i].pdfRev) / remap0(light[i].pdfFwd);
+                if (!light[i].delta && (i == 0 || !light[i - 1].delta))
+                    sumRi += ri;
+            }
+            return 1 / (1 + sumRi);
+        }
+
+        /**
+         * @brief 连接光源子路径的前s个顶点与相机子路径的前t个顶点，返回加权后的贡献；
+         *        t = 1时贡献属于像素坐标(rasterX, rasterY)
+         */
+        Vector3f connect(Vertex *light, Vertex *cam, int s, int t, float &rasterX, float &rasterY) const
+        {
+            Vertex &pt = cam[t - 1];
+            if (t > 1 && s != 0 && pt.type == VertexType::Light)
+                return Vector3f();
+            Vector3f L;
+            Vertex sampled;
+            if (s == 0)
+            {
+                // 相机子路径直接命中光源
+                L = pt.beta * Le(pt, (cam[t - 2].p - pt.p).normalized());
+            }
+            else if (t == 1)
+            {
+                // 光源子路径上的点连到相机
+                Vertex &qs = light[s - 1];
+                if (!qs.connectible() || !camera.raster(qs.p, rasterX, rasterY))
+                    return Vector3f();
+                Vector3f d = camera.eye - qs.p;
+                float dist2 = dotProduct(d, d);
+                Vector3f w = -d.normalized();
+                sampled.type = VertexType::Camera;
+                sampled.p = camera.eye;
+                // We / pdf，pdf = r² / cosθ为针孔相机对qs所张立体角的密度
+                sampled.beta = Vector3f(camera.We(w) * w.z / dist2);
+                L = qs.beta * f(qs, (light[s - 2].p - qs.p).normalized(), -w) * sampled.beta;
+                if (luminance(L) > 0)
+                    L = L * G(qs, sampled) * dist2;
+            }
+            else if (s == 1)
+            {
+                // 在光源上重新采样一点（与相机子路径的顶点相连）
+                if (!pt.connectible())
+                    return Vector3f();
+                Intersection pos;
+                float pdfPos;
+                scene.sampleLight(pos, pdfPos);
+                if (!(pdfPos > 0))
+                    return Vector3f();
+                sampled.type = VertexType::Light;
+                sampled.p = pos.coords;
+                sampled.n = pos.normal;
+                sampled.Le = pos.emit;
+                sampled.beta = pos.emit / pdfPos;
+                sampled.pdfFwd = pdfLightOrigin(sampled);
+                Vector3f w = (sampled.p - pt.p).normalized();
+                L = pt.beta * f(pt, (cam[t - 2].p - pt.p).normalized(), w) * Le(sampled, -w) / pdfPos;
+                if (luminance(L) > 0)
+                    L = L * G(pt, sampled);
+            }
+            else
+            {
+                Vertex &qs = light[s - 1];
+                if (!qs.connectible() || !pt.connectible())
+                    return Vector3f();
+                Vector3f w = (pt.p - qs.p).normalized();
+                L = qs.beta * f(qs, (light[s - 2].p - qs.p).normalized(), w) *
+                    f(pt, (cam[t - 2].p - pt.p).normalized(), -w) * pt.beta;
+                if (luminance(L) > 0)
+                    L = L * G(qs, pt);
+            }
+            if (!(luminance(L) > 0))
+                return Vector3f();
+            return L * misWeight(light, cam, sampled, s, t);
+        }
+    };
+}
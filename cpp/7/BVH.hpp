@@ -5,20 +5,74 @@
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
+#include "MemoryArena.hpp"
+#include "Simd.hpp"
+#include "Stats.hpp"
 
 #include <algorithm>
 #include <cassert>
 #include <atomic>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <ctime>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <unordered_map>
+#include <omp.h>
 
 struct BVHBuildNode;
 // BVHAccel Forward Declarations
 struct BVHPrimitiveInfo;
+struct LazySubtree;
+
+/**
+ * \brief 深度优先展开的线性BVH节点，用于BVH的二进制缓存（左子节点紧随父节点之后）
+ */
+struct LinearBVHNode
+{
+    float pMin[3], pMax[3];
+    float area;
+    int32_t offset;       // 叶节点：首个图元下标；内部节点：右子节点下标
+    uint16_t nPrimitives; // 0表示内部节点
+    uint8_t axis;
+    uint8_t pad;
+};
+
+/**
+ * \brief 量化BVH节点：每个内部节点保存两个子节点的包围盒，以两者并集为坐标系按轴量化为8位整数
+ * （步长为2的幂，下界向下、上界向上取整，保证解量化后的包围盒包含原包围盒）。
+ * 40字节保存两个子节点，平均每个节点约20字节，而BVHBuildNode为80字节
+ */
+struct QuantizedBVHNode
+{
+    float origin[3];        // 量化坐标系原点（两个子节点包围盒并集的pMin）
+    int8_t exponent[3];     // 每轴量化步长为2^exponent
+    uint8_t nPrimitives[2]; // 子节点为叶节点时的图元数，0表示内部节点
+    uint8_t qMin[2][3], qMax[2][3];
+    uint32_t child[2];      // 内部子节点：在量化节点数组中的下标；叶节点：首个图元下标
+};
+static_assert(sizeof(QuantizedBVHNode) == 40, "QuantizedBVHNode layout");
+
+// 量化步长2^exponent，直接拼出float的指数位，遍历时无需调用ldexp
+inline float quantizationStep(int8_t exponent)
+{
+    uint32_t bits = uint32_t(exponent + 127) << 23;
+    float step;
+    memcpy(&step, &bits, sizeof(step));
+    return step;
+}
+
+// 解量化，构建时的保守取整检查与遍历时（Vec4f逐通道）须使用同一表达式
+inline float dequantize(float origin, uint8_t q, float step) { return origin + q * step; }
 
 // BVHAccel Declarations
-inline int leafNodes, totalLeafNodes, totalPrimitives, interiorNodes;
+// 构建统计：leafNodes为最近一次构建的叶节点数，其余为所有BVH的累计值。
+// 延迟构建的子树在渲染线程中展开，因此用原子变量
+inline std::atomic<int> leafNodes{0}, totalLeafNodes{0}, totalPrimitives{0}, interiorNodes{0};
 
 class BVHAccel
 {
@@ -27,38 +81,144 @@ public:
     enum class SplitMethod
     {
         NAIVE,
-        SAH
+        SAH,  // 分桶SAH对象划分
+        LBVH, // 按图元质心的Morton码排序后线性构建，适用于超大网格
+        SBVH  // 在SAH对象划分之外考虑空间划分，跨越分割面的图元在两侧各保留一份引用
+    };
+
+    // 是否输出构建耗时
+    static inline bool verbose = true;
+    // LBVH构建后是否做聚合式treelet优化（以少量构建时间换取更低的SAH开销）
+    static inline bool refineLBVH = true;
+    // SBVH允许复制的图元引用数占图元数的比例
+    static inline float sbvhDuplicationBudget = 0.3f;
+    // 对象划分两侧包围盒重叠面积与根节点表面积之比超过该值时才尝试空间划分（Stich et al. 2009的alpha）
+    static inline float sbvhAlpha = 1e-5f;
+    // refit后节点表面积或整棵树的SAH开销超过最近一次构建时的该倍数时重建（根节点即整体重建）
+    static inline float rebuildThreshold = 1.3f;
+    // 延迟构建：只构建上层，图元数不超过lazySubtreeSize的子树在首次被光线或光源采样到达时才构建
+    static inline bool lazyBuild = false;
+    static inline int lazySubtreeSize = 512;
+    // 构建或更新后生成量化节点数组，求交时遍历量化节点以减少内存带宽（延迟构建时不生成）
+    static inline bool compressNodes = false;
+
+    // update()对BVH所做的处理
+    enum class UpdateResult
+    {
+        Refit,
+        PartialRebuild,
+        FullRebuild
     };
 
     // BVHAccel Public Methods
     BVHAccel(std::vector<Object *> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE);
+    BVHAccel(std::vector<Object *> p, const LinearBVHNode *nodes, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE);
     Bounds3 WorldBound() const;
     ~BVHAccel();
 
+    // 图元移动或变形后自底向上更新包围盒与面积，不改变树结构
+    void refit();
+    // refit后按质量启发式决定是否局部或整体重建，用于逐帧动画
+    UpdateResult update();
+    // 丢弃现有节点并按原参数整体重建
+    void rebuild();
+
     Intersection Intersect(const Ray &ray) const;
     Intersection getIntersection(BVHBuildNode *node, const Ray &ray) const;
     bool IntersectP(const Ray &ray) const;
     BVHBuildNode *root;
 
     // BVHAccel Private Methods
-    BVHBuildNode *recursiveBuild(std::vector<Object *> objects);
+    BVHBuildNode *recursiveBuild(std::vector<Object *> objects, std::vector<Object *> &orderedPrims);
+    BVHBuildNode *recursiveBuildSAH(std::vector<BVHPrimitiveInfo> refs, std::vector<Object *> &orderedPrims,
+                                    int &duplicateBudget, double rootArea, int depth);
+    BVHBuildNode *buildLBVH(std::vector<Object *> &orderedPrims);
+    void build();
+    BVHBuildNode *buildLazyTop(std::vector<BVHPrimitiveInfo> &refs, int first, int end);
+    BVHBuildNode *buildRange(int first, int end);
+    BVHBuildNode *expand(BVHBuildNode *node) const;
+    void refitNode(BVHBuildNode *node);
+    void markBuilt(BVHBuildNode *node);
+    bool rebuildSubtree(BVHBuildNode *node);
+    int rebuildDegraded(BVHBuildNode *node);
+    void refineTreelets(BVHBuildNode *node, int depth = 0);
+    int flattenBVHTree(BVHBuildNode *node, std::vector<LinearBVHNode> &nodes) const;
+    BVHBuildNode *unflattenBVHTree(const LinearBVHNode *nodes, int &offset);
+
+    // 由指针树生成量化节点数组，此后Intersect遍历量化节点；根节点为叶节点或仍有未展开的延迟子树时不生成
+    // （不会为量化而展开延迟子树）
+    void compress();
+    uint32_t compressNode(BVHBuildNode *node);
+    Intersection getIntersectionQuantized(uint32_t index, const Ray &ray) const;
+
+    // 展开为线性节点数组，叶节点以primitives中的下标引用图元
+    std::vector<LinearBVHNode> flatten() const;
+
+    // BVH每一层的SAH开销统计
+    struct LevelStats
+    {
+        int interiorNodes = 0, leafNodes = 0, primitives = 0;
+        double areaRatio = 0; // 该层节点表面积之和 / 根节点表面积
+        double cost = 0;      // 该层对SAH开销的贡献
+    };
+    std::vector<LevelStats> SAHLevelStats(float traversalCost = 1, float intersectCost = 1) const;
+    // 按层输出SAH开销，总开销为光线穿过根节点时的期望遍历与求交次数
+    void printSAHSummary(std::ostream &os, float traversalCost = 1, float intersectCost = 1) const;
+    double SAHCost(float traversalCost = 1, float intersectCost = 1) const;
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
+    // 构建后按叶节点顺序重排，叶节点以[firstPrimOffset, firstPrimOffset + nPrimitives)引用
     std::vector<Object *> primitives;
+    // primitives中每个引用在光源采样时的面积；SBVH复制的图元按引用数均分面积，保证各图元被选中的概率正比于面积
+    std::vector<float> primitiveAreas;
+    // BVH节点统一从内存池分配，随BVHAccel一次性释放
+    MemoryArena nodeArena;
+    // 量化节点数组，非空时用于求交（指针树仍用于光源采样与refit）
+    std::vector<QuantizedBVHNode> quantizedNodes;
+    // 最近一次整体构建后的SAH开销，以及此后局部重建遗留在内存池中的旧节点字节数（超过内存池一半时改为整体重建）
+    double buildCost = 0;
+    size_t abandonedBytes = 0;
+    // 串行化延迟子树的构建（内存池与构建统计不是线程安全的）
+    mutable std::mutex lazyMutex;
+    // 最近一次整体构建生成的延迟子树数，以及其中已展开（含被局部重建一并构建）的个数
+    int lazySubtrees = 0;
+    mutable std::atomic<int> expandedSubtrees{0};
 
+    void updateReferenceAreas();
+    float updateNodeAreas(BVHBuildNode *node);
     void getSample(BVHBuildNode *node, float p, Intersection &pos, float &pdf);
     void Sample(Intersection &pos, float &pdf);
 };
 
+// 构建时对图元的一次引用，SBVH中bounds为图元裁剪到所在节点后的包围盒
+struct BVHPrimitiveInfo
+{
+    BVHPrimitiveInfo() {}
+    BVHPrimitiveInfo(int primitiveNumber, const Bounds3 &bounds)
+        : primitiveNumber(primitiveNumber), bounds(bounds), centroid(0.5f * bounds.pMin + 0.5f * bounds.pMax) {}
+    int primitiveNumber;
+    Bounds3 bounds;
+    Vector3f centroid;
+};
+
+// 延迟构建的子树：覆盖primitives中[first, first + count)，built在首次展开时发布
+struct LazySubtree
+{
+    int first = 0, count = 0;
+    std::atomic<BVHBuildNode *> built{nullptr};
+};
+
 struct BVHBuildNode
 {
     Bounds3 bounds;
     BVHBuildNode *left;
     BVHBuildNode *right;
-    Object *object;
+    Object *object; // 仅含一个图元的叶节点指向该图元
     float area;
+    float builtSurfaceArea = 0; // 最近一次构建时包围盒的表面积，refit后与之比较判断质量
+    LazySubtree *lazy = nullptr; // 非空时为延迟构建的子树，展开后的实际子树由lazy->built给出
 
 public:
     int splitAxis = 0, firstPrimOffset = 0, nPrimitives = 0;
@@ -74,15 +234,12 @@ public:
 
 BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode,
                    SplitMethod splitMethod)
-    : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
+    : root(nullptr), maxPrimsInNode(std::max(1, std::min(255, maxPrimsInNode))), splitMethod(splitMethod),
       primitives(std::move(p))
 {
     time_t start, stop;
     time(&start);
-    if (primitives.empty())
-        return;
-
-    root = recursiveBuild(primitives);
+    build();
 
     time(&stop);
     double diff = difftime(stop, start);
@@ -90,33 +247,117 @@ BVHAccel::BVHAccel(std::vector<Object *> p, int maxPrimsInNode,
     int mins = ((int)diff / 60) - (hrs * 60);
     int secs = (int)diff - (hrs * 3600) - (mins * 60);
 
-    printf(
-        "\rBVH Generation complete: \nTime Taken: %i hrs, %i mins, %i secs\n\n",
-        hrs, mins, secs);
+    if (verbose)
+        printf(
+            "\rBVH Generation complete: \nTime Taken: %i hrs, %i mins, %i secs\n\n",
+            hrs, mins, secs);
 }
 
-BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
+void BVHAccel::build()
 {
-    BVHBuildNode *node = new BVHBuildNode();
+    leafNodes = 0;
+    lazySubtrees = 0;
+    expandedSubtrees = 0;
+    if (primitives.empty())
+        return;
+
+    std::vector<Object *> orderedPrims;
+    orderedPrims.reserve(primitives.size());
+    if (lazyBuild && primitives.size() > lazySubtreeSize)
+    {
+        std::vector<BVHPrimitiveInfo> refs;
+        refs.reserve(primitives.size());
+        for (int i = 0; i < primitives.size(); ++i)
+            refs.emplace_back(i, primitives[i]->getBounds());
+        root = buildLazyTop(refs, 0, refs.size());
+        for (const auto &ref : refs)
+            orderedPrims.push_back(primitives[ref.primitiveNumber]);
+    }
+    else if (splitMethod == SplitMethod::LBVH)
+        root = buildLBVH(orderedPrims);
+    else if (splitMethod == SplitMethod::NAIVE)
+        root = recursiveBuild(primitives, orderedPrims);
+    else
+    {
+        std::vector<BVHPrimitiveInfo> refs;
+        refs.reserve(primitives.size());
+        Bounds3 bounds;
+        for (int i = 0; i < primitives.size(); ++i)
+        {
+            refs.emplace_back(i, primitives[i]->getBounds());
+            bounds = Union(bounds, refs.back().bounds);
+        }
+        int duplicateBudget = splitMethod == SplitMethod::SBVH ? int(sbvhDuplicationBudget * primitives.size()) : 0;
+        root = recursiveBuildSAH(std::move(refs), orderedPrims, duplicateBudget, bounds.SurfaceArea(), 0);
+    }
+    primitives.swap(orderedPrims);
+    updateReferenceAreas();
+    markBuilt(root);
+    buildCost = SAHCost();
+    abandonedBytes = 0;
+    quantizedNodes.clear();
+    if (compressNodes)
+        compress();
+}
+
+BVHAccel::~BVHAccel() = default;
+
+/**
+ * @brief 由线性节点数组（如二进制缓存）直接还原BVH，无需重新排序划分
+ * @param p     图元列表，顺序须与展开时一致
+ * @param nodes flatten()得到的线性节点数组，来自文件时须先经MeshCache::validNodes校验
+ */
+BVHAccel::BVHAccel(std::vector<Object *> p, const LinearBVHNode *nodes, int maxPrimsInNode,
+                   SplitMethod splitMethod)
+    : root(nullptr), maxPrimsInNode(std::max(1, std::min(255, maxPrimsInNode))), splitMethod(splitMethod),
+      primitives(std::move(p))
+{
+    leafNodes = 0;
+    if (primitives.empty())
+        return;
+    int offset = 0;
+    root = unflattenBVHTree(nodes, offset);
+    updateReferenceAreas();
+    markBuilt(root);
+    buildCost = SAHCost();
+    abandonedBytes = 0;
+    if (compressNodes)
+        compress();
+}
+
+BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects, std::vector<Object *> &orderedPrims)
+{
+    BVHBuildNode *node = nodeArena.Create<BVHBuildNode>();
 
     // Compute bounds of all primitives in BVH node
     Bounds3 bounds;
     for (int i = 0; i < objects.size(); ++i)
         bounds = Union(bounds, objects[i]->getBounds());
-    if (objects.size() == 1)
+    if (objects.size() <= maxPrimsInNode)
     {
         // Create leaf _BVHBuildNode_
-        node->bounds = objects[0]->getBounds();
-        node->object = objects[0];
+        node->bounds = bounds;
+        node->firstPrimOffset = orderedPrims.size();
+        node->nPrimitives = objects.size();
+        node->object = objects.size() == 1 ? objects[0] : nullptr;
         node->left = nullptr;
         node->right = nullptr;
-        node->area = objects[0]->getArea();
+        node->area = 0;
+        for (auto object : objects)
+        {
+            orderedPrims.push_back(object);
+            node->area += object->getArea();
+        }
+        leafNodes++;
+        totalLeafNodes++;
+        totalPrimitives += objects.size();
         return node;
     }
     else if (objects.size() == 2)
     {
-        node->left = recursiveBuild(std::vector{objects[0]});
-        node->right = recursiveBuild(std::vector{objects[1]});
+        interiorNodes++;
+        node->left = recursiveBuild(std::vector{objects[0]}, orderedPrims);
+        node->right = recursiveBuild(std::vector{objects[1]}, orderedPrims);
 
         node->bounds = Union(node->left->bounds, node->right->bounds);
         node->area = node->left->area + node->right->area;
@@ -129,6 +370,8 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
             centroidBounds =
                 Union(centroidBounds, objects[i]->getBounds().Centroid());
         int dim = centroidBounds.maxExtent();
+        node->splitAxis = dim;
+        interiorNodes++;
         switch (dim)
         {
         case 0:
@@ -157,8 +400,8 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
 
         assert(objects.size() == (leftshapes.size() + rightshapes.size()));
 
-        node->left = recursiveBuild(leftshapes);
-        node->right = recursiveBuild(rightshapes);
+        node->left = recursiveBuild(leftshapes, orderedPrims);
+        node->right = recursiveBuild(rightshapes, orderedPrims);
 
         node->bounds = Union(node->left->bounds, node->right->bounds);
         node->area = node->left->area + node->right->area;
@@ -167,11 +410,1115 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Object *> objects)
     return node;
 }
 
+/**
+ * @brief 分桶SAH构建，splitMethod为SBVH时同时考虑空间划分（Stich et al. 2009）：
+ *        对象划分两侧重叠明显时，沿各轴把节点包围盒等分为若干桶，按图元裁剪到各桶后的包围盒
+ *        求空间划分的SAH开销；跨越分割面的引用在两侧各保留一份，复制数受duplicateBudget限制
+ * @param refs            当前节点的图元引用
+ * @param duplicateBudget 剩余可复制的引用数
+ * @param rootArea        根节点表面积，用于判断重叠是否明显
+ */
+BVHBuildNode *BVHAccel::recursiveBuildSAH(std::vector<BVHPrimitiveInfo> refs, std::vector<Object *> &orderedPrims,
+                                          int &duplicateBudget, double rootArea, int depth)
+{
+    // 遍历开销与求交开销均取1，与SAHLevelStats一致
+    constexpr int nBuckets = 16;
+
+    BVHBuildNode *node = nodeArena.Create<BVHBuildNode>();
+    Bounds3 bounds, centroidBounds;
+    for (const auto &ref : refs)
+    {
+        bounds = Union(bounds, ref.bounds);
+        centroidBounds = Union(centroidBounds, ref.centroid);
+    }
+    const int n = refs.size();
+    const double area = bounds.SurfaceArea();
+
+    // 对象划分：三个轴上按质心分桶，扫描求SAH开销最小的分割
+    double bestCost = std::numeric_limits<double>::infinity();
+    int bestAxis = -1, bestBucket = 0;
+    Bounds3 bestLeft, bestRight;
+    auto bucketOf = [&](const BVHPrimitiveInfo &ref, int axis)
+    {
+        const Bounds3 &cb = centroidBounds;
+        int b = nBuckets * (ref.centroid[axis] - cb.pMin[axis]) / (cb.pMax[axis] - cb.pMin[axis]);
+        return std::max(0, std::min(nBuckets - 1, b));
+    };
+    for (int axis = 0; axis < 3 && n > 1; ++axis)
+    {
+        const Bounds3 &cb = centroidBounds;
+        if (cb.pMax[axis] <= cb.pMin[axis])
+            continue;
+        int count[nBuckets] = {};
+        Bounds3 bucketBounds[nBuckets], rightBounds[nBuckets];
+        for (const auto &ref : refs)
+        {
+            int b = bucketOf(ref, axis);
+            count[b]++;
+            bucketBounds[b] = Union(bucketBounds[b], ref.bounds);
+        }
+        for (int i = nBuckets - 1; i > 0; --i)
+            rightBounds[i - 1] = i == nBuckets - 1 ? bucketBounds[i] : Union(rightBounds[i], bucketBounds[i]);
+        Bounds3 left;
+        int nl = 0;
+        for (int i = 0; i < nBuckets - 1; ++i)
+        {
+            left = Union(left, bucketBounds[i]);
+            nl += count[i];
+            int nr = n - nl;
+            if (nl == 0 || nr == 0)
+                continue;
+            double cost = 1 + (nl * left.SurfaceArea() + nr * rightBounds[i].SurfaceArea()) / area;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBucket = i;
+                bestLeft = left;
+                bestRight = rightBounds[i];
+            }
+        }
+    }
+
+    // 空间划分：仅当对象划分两侧重叠明显时尝试
+    int spatialAxis = -1;
+    float spatialPlane = 0;
+    Bounds3 spatialLeft, spatialRight;
+    int spatialNl = 0, spatialNr = 0;
+    if (splitMethod == SplitMethod::SBVH && duplicateBudget > 0 && n > 1 && depth < 64)
+    {
+        Bounds3 overlap = bestAxis >= 0 ? Overlap(bestLeft, bestRight) : bounds;
+        if (!overlap.IsEmpty() && overlap.SurfaceArea() > sbvhAlpha * rootArea)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const Bounds3 &nb = bounds;
+                float lo = nb.pMin[axis], width = (nb.pMax[axis] - lo) / nBuckets;
+                if (width <= 0)
+                    continue;
+                auto binOf = [&](float x)
+                { return std::max(0, std::min(nBuckets - 1, int((x - lo) / width))); };
+                int enter[nBuckets] = {}, exit[nBuckets] = {};
+                Bounds3 binBounds[nBuckets], rightBounds[nBuckets];
+                for (const auto &ref : refs)
+                {
+                    int b0 = binOf(ref.bounds.pMin[axis]), b1 = binOf(ref.bounds.pMax[axis]);
+                    enter[b0]++;
+                    exit[b1]++;
+                    if (b0 == b1)
+                    {
+                        binBounds[b0] = Union(binBounds[b0], ref.bounds);
+                        continue;
+                    }
+                    Object *primitive = primitives[ref.primitiveNumber];
+                    for (int b = b0; b <= b1; ++b)
+                    {
+                        Bounds3 slab = ref.bounds;
+                        if (b > b0)
+                            slab.pMin[axis] = lo + b * width;
+                        if (b < b1)
+                            slab.pMax[axis] = lo + (b + 1) * width;
+                        binBounds[b] = Union(binBounds[b], primitive->getClippedBounds(slab));
+                    }
+                }
+                for (int i = nBuckets - 1; i > 0; --i)
+                    rightBounds[i - 1] = i == nBuckets - 1 ? binBounds[i] : Union(rightBounds[i], binBounds[i]);
+                Bounds3 left;
+                int nl = 0, nr = n;
+                for (int i = 0; i < nBuckets - 1; ++i)
+                {
+                    left = Union(left, binBounds[i]);
+                    nl += enter[i];
+                    nr -= exit[i];
+                    // 须确实减少两侧的引用数，且新增的引用不超过预算
+                    if (nl == 0 || nr == 0 || nl == n || nr == n || nl + nr - n > duplicateBudget)
+                        continue;
+                    if (left.IsEmpty() || rightBounds[i].IsEmpty())
+                        continue;
+                    double cost = 1 + (nl * left.SurfaceArea() + nr * rightBounds[i].SurfaceArea()) / area;
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        spatialAxis = axis;
+                        spatialPlane = lo + (i + 1) * width;
+                        spatialLeft = left;
+                        spatialRight = rightBounds[i];
+                        spatialNl = nl;
+                        spatialNr = nr;
+                    }
+                }
+            }
+        }
+    }
+
+    if (n <= maxPrimsInNode && n <= bestCost)
+    {
+        // Create leaf _BVHBuildNode_
+        node->bounds = bounds;
+        node->firstPrimOffset = orderedPrims.size();
+        node->nPrimitives = n;
+        node->object = n == 1 ? primitives[refs[0].primitiveNumber] : nullptr;
+        node->area = 0;
+        for (const auto &ref : refs)
+        {
+            orderedPrims.push_back(primitives[ref.primitiveNumber]);
+            node->area += orderedPrims.back()->getArea();
+        }
+        leafNodes++;
+        totalLeafNodes++;
+        totalPrimitives += n;
+        return node;
+    }
+
+    std::vector<BVHPrimitiveInfo> leftRefs, rightRefs;
+    if (spatialAxis >= 0)
+    {
+        Bounds3 leftBox = bounds, rightBox = bounds;
+        leftBox.pMax[spatialAxis] = spatialPlane;
+        rightBox.pMin[spatialAxis] = spatialPlane;
+        for (const auto &ref : refs)
+        {
+            if (ref.bounds.pMax[spatialAxis] <= spatialPlane)
+            {
+                leftRefs.push_back(ref);
+                continue;
+            }
+            if (ref.bounds.pMin[spatialAxis] >= spatialPlane)
+            {
+                rightRefs.push_back(ref);
+                continue;
+            }
+            // 引用反分割：整体放入一侧比复制更划算时不复制
+            double splitCost = spatialNl * spatialLeft.SurfaceArea() + spatialNr * spatialRight.SurfaceArea();
+            Bounds3 leftUnion = Union(spatialLeft, ref.bounds), rightUnion = Union(spatialRight, ref.bounds);
+            double toLeft = spatialNl * leftUnion.SurfaceArea() + (spatialNr - 1) * spatialRight.SurfaceArea();
+            double toRight = (spatialNl - 1) * spatialLeft.SurfaceArea() + spatialNr * rightUnion.SurfaceArea();
+            Object *primitive = primitives[ref.primitiveNumber];
+            Bounds3 leftPart = primitive->getClippedBounds(Overlap(ref.bounds, leftBox));
+            Bounds3 rightPart = primitive->getClippedBounds(Overlap(ref.bounds, rightBox));
+            if (rightPart.IsEmpty() || (toLeft < splitCost && toLeft <= toRight))
+            {
+                leftRefs.push_back(ref);
+                spatialLeft = leftUnion;
+                spatialNr--;
+            }
+            else if (leftPart.IsEmpty() || toRight < splitCost)
+            {
+                rightRefs.push_back(ref);
+                spatialRight = rightUnion;
+                spatialNl--;
+            }
+            else
+            {
+                leftRefs.emplace_back(ref.primitiveNumber, leftPart);
+                rightRefs.emplace_back(ref.primitiveNumber, rightPart);
+                duplicateBudget--;
+            }
+        }
+        node->splitAxis = spatialAxis;
+    }
+    else if (bestAxis >= 0)
+    {
+        for (const auto &ref : refs)
+            (bucketOf(ref, bestAxis) <= bestBucket ? leftRefs : rightRefs).push_back(ref);
+        node->splitAxis = bestAxis;
+    }
+
+    // 质心重合等无法划分的情况：按质心中位数对半分
+    if (leftRefs.empty() || rightRefs.empty())
+    {
+        int dim = centroidBounds.maxExtent();
+        auto mid = refs.begin() + n / 2;
+        std::nth_element(refs.begin(), mid, refs.end(), [dim](const BVHPrimitiveInfo &a, const BVHPrimitiveInfo &b)
+                         { return a.centroid[dim] < b.centroid[dim]; });
+        leftRefs.assign(refs.begin(), mid);
+        rightRefs.assign(mid, refs.end());
+        node->splitAxis = dim;
+    }
+    refs.clear();
+    refs.shrink_to_fit();
+
+    interiorNodes++;
+    node->left = recursiveBuildSAH(std::move(leftRefs), orderedPrims, duplicateBudget, rootArea, depth + 1);
+    node->right = recursiveBuildSAH(std::move(rightRefs), orderedPrims, duplicateBudget, rootArea, depth + 1);
+    node->bounds = Union(node->left->bounds, node->right->bounds);
+    node->area = node->left->area + node->right->area;
+    return node;
+}
+
+/**
+ * @brief 计算primitives中每个引用的采样面积；存在重复引用时按引用数均分面积并更新各节点的面积
+ */
+void BVHAccel::updateReferenceAreas()
+{
+    primitiveAreas.resize(primitives.size());
+    if (splitMethod != SplitMethod::SBVH)
+    {
+        for (int i = 0; i < primitives.size(); ++i)
+            primitiveAreas[i] = primitives[i]->getArea();
+        return;
+    }
+    std::unordered_map<Object *, int> references;
+    for (auto object : primitives)
+        references[object]++;
+    for (int i = 0; i < primitives.size(); ++i)
+        primitiveAreas[i] = primitives[i]->getArea() / references[primitives[i]];
+    if (root && references.size() < primitives.size())
+        updateNodeAreas(root);
+}
+
+float BVHAccel::updateNodeAreas(BVHBuildNode *node)
+{
+    if (node->lazy)
+    {
+        BVHBuildNode *built = node->lazy->built.load(std::memory_order_acquire);
+        if (built)
+            node->area = updateNodeAreas(built);
+        else
+        {
+            node->area = 0;
+            for (int i = node->lazy->first; i < node->lazy->first + node->lazy->count; ++i)
+                node->area += primitiveAreas[i];
+        }
+        return node->area;
+    }
+    if (node->nPrimitives > 0)
+    {
+        node->area = 0;
+        for (int i = 0; i < node->nPrimitives; ++i)
+            node->area += primitiveAreas[node->firstPrimOffset + i];
+    }
+    else
+        node->area = updateNodeAreas(node->left) + updateNodeAreas(node->right);
+    return node->area;
+}
+
+// LBVH构建用的Morton码与基数排序
+namespace lbvh
+{
+    struct MortonPrimitive
+    {
+        uint64_t code;
+        uint32_t index;
+    };
+
+    // 将低21位按3位间隔展开：b2b1b0 -> b2 0 0 b1 0 0 b0
+    inline uint64_t expandBits(uint64_t x)
+    {
+        x &= 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffffull;
+        x = (x | x << 16) & 0x1f0000ff0000ffull;
+        x = (x | x << 8) & 0x100f00f00f00f00full;
+        x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+        x = (x | x << 2) & 0x1249249249249249ull;
+        return x;
+    }
+
+    // p为归一化到[0, 1]的质心，bitsPerAxis为10（30位码）或21（63位码）
+    inline uint64_t encodeMorton3(const Vector3f &p, int bitsPerAxis)
+    {
+        double scale = double(1u << bitsPerAxis);
+        auto quantize = [scale](double v)
+        { return uint64_t(std::min(std::max(v * scale, 0.0), scale - 1)); };
+        return (expandBits(quantize(p.x)) << 2) | (expandBits(quantize(p.y)) << 1) | expandBits(quantize(p.z));
+    }
+
+    /**
+     * @brief 每趟8位的并行LSD基数排序：各线程统计所在分段的直方图，
+     *        按（桶, 线程）顺序求前缀和得到写入位置后分散写出，排序稳定
+     */
+    inline void radixSort(std::vector<MortonPrimitive> &v, int bits)
+    {
+        const int bitsPerPass = 8, nBuckets = 1 << bitsPerPass;
+        const int nPasses = (bits + bitsPerPass - 1) / bitsPerPass;
+        const size_t n = v.size();
+        std::vector<MortonPrimitive> tmp(n);
+        std::vector<size_t> offsets(omp_get_max_threads() * nBuckets);
+        for (int pass = 0; pass < nPasses; ++pass)
+        {
+            const int shift = pass * bitsPerPass;
+            const std::vector<MortonPrimitive> &in = (pass & 1) ? tmp : v;
+            std::vector<MortonPrimitive> &out = (pass & 1) ? v : tmp;
+#pragma omp parallel
+            {
+                int t = omp_get_thread_num(), nThreads = omp_get_num_threads();
+                size_t begin = n * t / nThreads, end = n * (t + 1) / nThreads;
+                size_t *count = &offsets[t * nBuckets];
+                std::fill(count, count + nBuckets, 0);
+                for (size_t i = begin; i < end; ++i)
+                    count[(in[i].code >> shift) & (nBuckets - 1)]++;
+#pragma omp barrier
+#pragma omp single
+                {
+                    size_t sum = 0;
+                    for (int b = 0; b < nBuckets; ++b)
+                        for (int k = 0; k < nThreads; ++k)
+                        {
+                            size_t c = offsets[k * nBuckets + b];
+                            offsets[k * nBuckets + b] = sum;
+                            sum += c;
+                        }
+                }
+                for (size_t i = begin; i < end; ++i)
+                    out[count[(in[i].code >> shift) & (nBuckets - 1)]++] = in[i];
+            }
+        }
+        if (nPasses & 1)
+            v.swap(tmp);
+    }
+}
+
+/**
+ * @brief 线性BVH构建（Karras 2012）：质心Morton码 + 并行基数排序 + 并行生成层次结构，
+ *        各内部节点互不依赖地求出覆盖区间与分割位置，包围盒自底向上用原子计数合并。
+ *        总体O(n)且随核数扩展，树质量略逊于中位数划分，可由refineTreelets弥补一部分
+ */
+BVHBuildNode *BVHAccel::buildLBVH(std::vector<Object *> &orderedPrims)
+{
+    const int n = primitives.size();
+    std::vector<Bounds3> primBounds(n);
+    Bounds3 centroidBounds;
+#pragma omp parallel
+    {
+        Bounds3 local;
+#pragma omp for
+        for (int i = 0; i < n; ++i)
+        {
+            primBounds[i] = primitives[i]->getBounds();
+            local = Union(local, primBounds[i].Centroid());
+        }
+#pragma omp critical
+        centroidBounds = Union(centroidBounds, local);
+    }
+
+    // 图元超过2^20个时每轴1024格的30位码重复过多，改用63位码
+    const int bitsPerAxis = n > (1 << 20) ? 21 : 10;
+    std::vector<lbvh::MortonPrimitive> morton(n);
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i)
+        morton[i] = {lbvh::encodeMorton3(centroidBounds.Offset(primBounds[i].Centroid()), bitsPerAxis), uint32_t(i)};
+    lbvh::radixSort(morton, 3 * bitsPerAxis);
+
+    // 节点编号：内部节点[0, n - 1)，叶节点n - 1 + j对应排序后的第j个图元，根为内部节点0
+    const int nInternal = n - 1;
+    std::vector<Bounds3> bounds(2 * n - 1);
+    std::vector<float> areas(2 * n - 1);
+    orderedPrims.resize(n);
+#pragma omp parallel for
+    for (int j = 0; j < n; ++j)
+    {
+        orderedPrims[j] = primitives[morton[j].index];
+        bounds[nInternal + j] = primBounds[morton[j].index];
+        areas[nInternal + j] = orderedPrims[j]->getArea();
+    }
+
+    // 相邻Morton码的公共前缀长度，码相同时以下标补位保证各码互异
+    auto delta = [&](int i, int j) -> int
+    {
+        if (j < 0 || j >= n)
+            return -1;
+        uint64_t a = morton[i].code, b = morton[j].code;
+        if (a == b)
+            return 64 + __builtin_clz(uint32_t(i ^ j));
+        return __builtin_clzll(a ^ b);
+    };
+
+    std::vector<int> leftChild(nInternal), rightChild(nInternal), first(nInternal), last(nInternal);
+    std::vector<int> parent(2 * n - 1, -1);
+#pragma omp parallel for
+    for (int i = 0; i < nInternal; ++i)
+    {
+        // 区间方向与另一端点：指数扩张后二分查找
+        int d = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+        int deltaMin = delta(i, i - d);
+        int lMax = 2;
+        while (delta(i, i + lMax * d) > deltaMin)
+            lMax *= 2;
+        int l = 0;
+        for (int t = lMax / 2; t >= 1; t /= 2)
+            if (delta(i, i + (l + t) * d) > deltaMin)
+                l += t;
+        int j = i + l * d;
+
+        // 分割位置：区间内与端点i公共前缀长于deltaNode的最远位置
+        int deltaNode = delta(i, j);
+        int s = 0;
+        for (int div = 2;; div *= 2)
+        {
+            int t = (l + div - 1) / div;
+            if (delta(i, i + (s + t) * d) > deltaNode)
+                s += t;
+            if (t <= 1)
+                break;
+        }
+        int split = i + s * d + std::min(d, 0);
+
+        first[i] = std::min(i, j);
+        last[i] = std::max(i, j);
+        leftChild[i] = first[i] == split ? nInternal + split : split;
+        rightChild[i] = last[i] == split + 1 ? nInternal + split + 1 : split + 1;
+        parent[leftChild[i]] = i;
+        parent[rightChild[i]] = i;
+    }
+
+    // 自底向上合并包围盒：每个内部节点由第二个到达的线程计算
+    std::vector<std::atomic<int>> visits(nInternal);
+#pragma omp parallel for
+    for (int j = 0; j < n; ++j)
+    {
+        int node = parent[nInternal + j];
+        while (node >= 0 && visits[node].fetch_add(1, std::memory_order_acq_rel) == 1)
+        {
+            bounds[node] = Union(bounds[leftChild[node]], bounds[rightChild[node]]);
+            areas[node] = areas[leftChild[node]] + areas[rightChild[node]];
+            node = parent[node];
+        }
+    }
+
+    // 转为BVHBuildNode，图元数不超过maxPrimsInNode的子树直接合并为叶节点
+    BVHBuildNode *nodes = nodeArena.CreateArray<BVHBuildNode>(2 * n - 1);
+    std::vector<int> stack = {0};
+    while (!stack.empty())
+    {
+        int id = stack.back();
+        stack.pop_back();
+        BVHBuildNode *node = &nodes[id];
+        node->bounds = bounds[id];
+        node->area = areas[id];
+        bool isLeaf = id >= nInternal;
+        int lo = isLeaf ? id - nInternal : first[id];
+        int hi = isLeaf ? lo : last[id];
+        if (isLeaf || hi - lo + 1 <= maxPrimsInNode)
+        {
+            node->firstPrimOffset = lo;
+            node->nPrimitives = hi - lo + 1;
+            node->object = lo == hi ? orderedPrims[lo] : nullptr;
+            leafNodes++;
+            totalLeafNodes++;
+            totalPrimitives += node->nPrimitives;
+        }
+        else
+        {
+            interiorNodes++;
+            node->splitAxis = node->bounds.maxExtent();
+            node->left = &nodes[leftChild[id]];
+            node->right = &nodes[rightChild[id]];
+            stack.push_back(rightChild[id]);
+            stack.push_back(leftChild[id]);
+        }
+    }
+
+    if (refineLBVH)
+    {
+#pragma omp parallel
+#pragma omp single
+        refineTreelets(&nodes[0]);
+    }
+    return &nodes[0];
+}
+
+/**
+ * @brief 聚合式treelet优化（参考Karras & Aila 2013）：自底向上以每个内部节点为根，
+ *        反复展开表面积最大的子节点得到至多7个叶的treelet，再对这些叶贪心地两两合并
+ *        （每次合并并集表面积最小的一对）重建拓扑；新拓扑内部节点表面积之和更小时才替换，
+ *        treelet叶下方的子树与primitives的顺序均不变
+ */
+void BVHAccel::refineTreelets(BVHBuildNode *node, int depth)
+{
+    if (node->nPrimitives > 0)
+        return;
+    // 上层子树并行处理
+    if (depth < 8)
+    {
+#pragma omp task
+        refineTreelets(node->left, depth + 1);
+        refineTreelets(node->right, depth + 1);
+#pragma omp taskwait
+    }
+    else
+    {
+        refineTreelets(node->left, depth + 1);
+        refineTreelets(node->right, depth + 1);
+    }
+
+    const int maxLeaves = 7;
+    BVHBuildNode *leaves[maxLeaves] = {node->left, node->right}, *internals[maxLeaves];
+    int nLeaves = 2, nInternals = 0;
+    double oldCost = 0;
+    while (nLeaves < maxLeaves)
+    {
+        int best = -1;
+        double bestArea = -1;
+        for (int k = 0; k < nLeaves; ++k)
+            if (leaves[k]->nPrimitives == 0 && leaves[k]->bounds.SurfaceArea() > bestArea)
+            {
+                best = k;
+                bestArea = leaves[k]->bounds.SurfaceArea();
+            }
+        if (best < 0)
+            break;
+        internals[nInternals++] = leaves[best];
+        oldCost += bestArea;
+        leaves[nLeaves++] = leaves[best]->right;
+        leaves[best] = leaves[best]->left;
+    }
+    if (nInternals == 0)
+        return;
+
+    // 贪心合并，clusters[k]为第k个活动簇在entries中的下标
+    Bounds3 clusterBounds[maxLeaves];
+    int clusters[maxLeaves], merges[maxLeaves][2];
+    for (int k = 0; k < nLeaves; ++k)
+    {
+        clusterBounds[k] = leaves[k]->bounds;
+        clusters[k] = k;
+    }
+    double newCost = 0;
+    for (int count = nLeaves, m = 0; count > 2; --count, ++m)
+    {
+        int bestA = 0, bestB = 1;
+        double bestArea = std::numeric_limits<double>::max();
+        for (int a = 0; a < count; ++a)
+            for (int b = a + 1; b < count; ++b)
+            {
+                double area = Union(clusterBounds[a], clusterBounds[b]).SurfaceArea();
+                if (area < bestArea)
+                {
+                    bestArea = area;
+                    bestA = a;
+                    bestB = b;
+                }
+            }
+        newCost += bestArea;
+        merges[m][0] = clusters[bestA];
+        merges[m][1] = clusters[bestB];
+        clusterBounds[bestA] = Union(clusterBounds[bestA], clusterBounds[bestB]);
+        clusters[bestA] = nLeaves + m;
+        clusterBounds[bestB] = clusterBounds[count - 1];
+        clusters[bestB] = clusters[count - 1];
+    }
+    if (newCost >= oldCost)
+        return;
+
+    // 复用原treelet的内部节点写入新拓扑
+    BVHBuildNode *entries[2 * maxLeaves];
+    std::copy(leaves, leaves + nLeaves, entries);
+    for (int m = 0; m < nInternals; ++m)
+    {
+        BVHBuildNode *inner = internals[m];
+        inner->left = entries[merges[m][0]];
+        inner->right = entries[merges[m][1]];
+        inner->bounds = Union(inner->left->bounds, inner->right->bounds);
+        inner->area = inner->left->area + inner->right->area;
+        inner->splitAxis = inner->bounds.maxExtent();
+        entries[nLeaves + m] = inner;
+    }
+    node->left = entries[clusters[0]];
+    node->right = entries[clusters[1]];
+}
+
+void BVHAccel::compress()
+{
+    quantizedNodes.clear();
+    if (!root || expandedSubtrees.load(std::memory_order_acquire) < lazySubtrees)
+        return;
+    BVHBuildNode *node = root->lazy ? root->lazy->built.load(std::memory_order_acquire) : root;
+    if (node->nPrimitives > 0)
+        return;
+    compressNode(node);
+}
+
+uint32_t BVHAccel::compressNode(BVHBuildNode *node)
+{
+    uint32_t index = quantizedNodes.size();
+    quantizedNodes.emplace_back();
+    QuantizedBVHNode quantized{};
+    // compress已确认延迟子树全部展开
+    BVHBuildNode *children[2] = {node->left->lazy ? node->left->lazy->built.load(std::memory_order_acquire) : node->left,
+                                 node->right->lazy ? node->right->lazy->built.load(std::memory_order_acquire) : node->right};
+    const Bounds3 frame = Union(children[0]->bounds, children[1]->bounds);
+    for (int i = 0; i < 3; ++i)
+    {
+        // 取最小的步长2^e使255个步长覆盖整个坐标系，按float实际计算结果校验
+        float lo = frame.pMin[i], hi = frame.pMax[i];
+        int e = hi > lo ? std::max(-126, (int)std::ceil(std::log2((hi - lo) / 255.0))) : -126;
+        while (e < 127 && dequantize(lo, 255, quantizationStep(e)) < hi)
+            ++e;
+        float step = quantizationStep(e);
+        quantized.origin[i] = lo;
+        quantized.exponent[i] = e;
+        for (int c = 0; c < 2; ++c)
+        {
+            const Bounds3 &bounds = children[c]->bounds;
+            float cMin = bounds.pMin[i], cMax = bounds.pMax[i];
+            int qMin = std::clamp((int)std::floor((cMin - lo) / step), 0, 255);
+            int qMax = std::clamp((int)std::ceil((cMax - lo) / step), 0, 255);
+            while (qMin > 0 && dequantize(lo, qMin, step) > cMin)
+                --qMin;
+            while (qMax < 255 && dequantize(lo, qMax, step) < cMax)
+                ++qMax;
+            quantized.qMin[c][i] = qMin;
+            quantized.qMax[c][i] = qMax;
+        }
+    }
+    for (int c = 0; c < 2; ++c)
+    {
+        if (children[c]->nPrimitives > 0)
+        {
+            // maxPrimsInNode不超过255，叶节点图元数可存入8位
+            assert(children[c]->nPrimitives <= 255);
+            quantized.nPrimitives[c] = children[c]->nPrimitives;
+            quantized.child[c] = children[c]->firstPrimOffset;
+        }
+        else
+            quantized.child[c] = compressNode(children[c]);
+    }
+    // 递归过程中数组可能扩容，最后再写回
+    quantizedNodes[index] = quantized;
+    return index;
+}
+
+std::vector<LinearBVHNode> BVHAccel::flatten() const
+{
+    std::vector<LinearBVHNode> nodes;
+    if (!root)
+        return nodes;
+    flattenBVHTree(root, nodes);
+    return nodes;
+}
+
+int BVHAccel::flattenBVHTree(BVHBuildNode *node, std::vector<LinearBVHNode> &nodes) const
+{
+    // 线性数组须包含完整的树，延迟子树在此全部展开
+    if (node->lazy)
+        node = expand(node);
+    int offset = nodes.size();
+    nodes.emplace_back();
+    LinearBVHNode linear{};
+    const Bounds3 &bounds = node->bounds;
+    for (int i = 0; i < 3; ++i)
+    {
+        linear.pMin[i] = bounds.pMin[i];
+        linear.pMax[i] = bounds.pMax[i];
+    }
+    linear.area = node->area;
+    linear.axis = node->splitAxis;
+    if (node->nPrimitives > 0)
+    {
+        linear.offset = node->firstPrimOffset;
+        linear.nPrimitives = node->nPrimitives;
+    }
+    else
+    {
+        flattenBVHTree(node->left, nodes);
+        linear.offset = flattenBVHTree(node->right, nodes);
+        linear.nPrimitives = 0;
+    }
+    nodes[offset] = linear;
+    return offset;
+}
+
+BVHBuildNode *BVHAccel::unflattenBVHTree(const LinearBVHNode *nodes, int &offset)
+{
+    const LinearBVHNode &linear = nodes[offset++];
+    BVHBuildNode *node = nodeArena.Create<BVHBuildNode>();
+    node->bounds.pMin = Vector3f(linear.pMin[0], linear.pMin[1], linear.pMin[2]);
+    node->bounds.pMax = Vector3f(linear.pMax[0], linear.pMax[1], linear.pMax[2]);
+    node->area = linear.area;
+    node->splitAxis = linear.axis;
+    if (linear.nPrimitives > 0)
+    {
+        node->firstPrimOffset = linear.offset;
+        node->nPrimitives = linear.nPrimitives;
+        node->object = linear.nPrimitives == 1 ? primitives[linear.offset] : nullptr;
+        leafNodes++;
+        totalLeafNodes++;
+        totalPrimitives += linear.nPrimitives;
+    }
+    else
+    {
+        interiorNodes++;
+        node->left = unflattenBVHTree(nodes, offset);
+        node->right = unflattenBVHTree(nodes, offset);
+    }
+    return node;
+}
+
+/**
+ * @brief 统计每层的SAH开销：内部节点贡献 traversalCost * SA(node) / SA(root)，
+ *        叶节点贡献 intersectCost * nPrimitives * SA(leaf) / SA(root)
+ */
+std::vector<BVHAccel::LevelStats> BVHAccel::SAHLevelStats(float traversalCost, float intersectCost) const
+{
+    std::vector<LevelStats> levels;
+    if (!root)
+        return levels;
+    double rootArea = root->bounds.SurfaceArea();
+    std::vector<std::pair<BVHBuildNode *, int>> stack = {{root, 0}};
+    while (!stack.empty())
+    {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        if (levels.size() <= depth)
+            levels.resize(depth + 1);
+        LevelStats &level = levels[depth];
+        double ratio = rootArea > 0 ? node->bounds.SurfaceArea() / rootArea : 1;
+        level.areaRatio += ratio;
+        // 尚未展开的延迟子树按含全部图元的叶节点计
+        if (node->lazy && node->lazy->built.load(std::memory_order_acquire))
+            node = node->lazy->built.load(std::memory_order_acquire);
+        if (node->lazy)
+        {
+            level.leafNodes++;
+            level.primitives += node->lazy->count;
+            level.cost += intersectCost * node->lazy->count * ratio;
+        }
+        else if (node->nPrimitives > 0)
+        {
+            level.leafNodes++;
+            level.primitives += node->nPrimitives;
+            level.cost += intersectCost * node->nPrimitives * ratio;
+        }
+        else
+        {
+            level.interiorNodes++;
+            level.cost += traversalCost * ratio;
+            stack.push_back({node->left, depth + 1});
+            stack.push_back({node->right, depth + 1});
+        }
+    }
+    return levels;
+}
+
+void BVHAccel::printSAHSummary(std::ostream &os, float traversalCost, float intersectCost) const
+{
+    auto levels = SAHLevelStats(traversalCost, intersectCost);
+    double total = 0;
+    char line[128];
+    snprintf(line, sizeof(line), "%6s %9s %9s %11s %12s %10s\n", "level", "interior", "leaves", "primitives", "area ratio", "SAH cost");
+    os << line;
+    for (int i = 0; i < levels.size(); ++i)
+    {
+        auto &l = levels[i];
+        snprintf(line, sizeof(line), "%6d %9d %9d %11d %12.3f %10.3f\n", i, l.interiorNodes, l.leafNodes, l.primitives, l.areaRatio, l.cost);
+        os << line;
+        total += l.cost;
+    }
+    snprintf(line, sizeof(line), "total SAH cost: %.3f (maxPrimsInNode=%d, %zu primitives)\n", total, maxPrimsInNode, primitives.size());
+    os << line;
+}
+
+double BVHAccel::SAHCost(float traversalCost, float intersectCost) const
+{
+    double cost = 0;
+    for (auto &level : SAHLevelStats(traversalCost, intersectCost))
+        cost += level.cost;
+    return cost;
+}
+
+void BVHAccel::markBuilt(BVHBuildNode *node)
+{
+    if (node == nullptr)
+        return;
+    node->builtSurfaceArea = node->bounds.SurfaceArea();
+    if (node->lazy)
+        markBuilt(node->lazy->built.load(std::memory_order_acquire));
+    else if (node->nPrimitives == 0)
+    {
+        markBuilt(node->left);
+        markBuilt(node->right);
+    }
+}
+
+void BVHAccel::refit()
+{
+    if (!root)
+        return;
+    // 缩放会改变图元面积，先更新采样面积再自底向上合并
+    updateReferenceAreas();
+    refitNode(root);
+    if (!quantizedNodes.empty())
+        compress();
+}
+
+void BVHAccel::refitNode(BVHBuildNode *node)
+{
+    if (node->lazy)
+    {
+        // 未展开的子树直接按图元范围重新计算，展开时会按当前几何构建
+        BVHBuildNode *built = node->lazy->built.load(std::memory_order_acquire);
+        if (built)
+        {
+            refitNode(built);
+            node->bounds = built->bounds;
+            node->area = built->area;
+            return;
+        }
+        node->bounds = Bounds3();
+        node->area = 0;
+        for (int i = node->lazy->first; i < node->lazy->first + node->lazy->count; ++i)
+        {
+            node->bounds = Union(node->bounds, primitives[i]->getBounds());
+            node->area += primitiveAreas[i];
+        }
+        return;
+    }
+    if (node->nPrimitives > 0)
+    {
+        node->bounds = Bounds3();
+        node->area = 0;
+        for (int i = 0; i < node->nPrimitives; ++i)
+        {
+            node->bounds = Union(node->bounds, primitives[node->firstPrimOffset + i]->getBounds());
+            node->area += primitiveAreas[node->firstPrimOffset + i];
+        }
+        return;
+    }
+    refitNode(node->left);
+    refitNode(node->right);
+    node->bounds = Union(node->left->bounds, node->right->bounds);
+    node->area = node->left->area + node->right->area;
+}
+
+/**
+ * @brief 逐帧更新：先refit，再按质量启发式处理——
+ *        整棵树的SAH开销或根节点表面积相对最近一次构建增大超过rebuildThreshold倍时整体重建；
+ *        否则自顶向下找出表面积膨胀超过该倍数的最上层子树，在其图元范围内局部重建
+ */
+BVHAccel::UpdateResult BVHAccel::update()
+{
+    if (!root)
+        return UpdateResult::Refit;
+    refit();
+    bool degraded = SAHCost() > buildCost * rebuildThreshold ||
+                    root->bounds.SurfaceArea() > root->builtSurfaceArea * rebuildThreshold ||
+                    abandonedBytes > nodeArena.TotalAllocated() / 2;
+    if (degraded)
+    {
+        rebuild();
+        return UpdateResult::FullRebuild;
+    }
+    int rebuilt = rebuildDegraded(root);
+    if (rebuilt < 0)
+    {
+        rebuild();
+        return UpdateResult::FullRebuild;
+    }
+    if (rebuilt > 0 && !quantizedNodes.empty())
+        compress();
+    return rebuilt > 0 ? UpdateResult::PartialRebuild : UpdateResult::Refit;
+}
+
+/**
+ * @return 局部重建的子树数，-1表示有子树无法局部重建（图元范围不连续）
+ */
+int BVHAccel::rebuildDegraded(BVHBuildNode *node)
+{
+    if (node->lazy)
+    {
+        node = node->lazy->built.load(std::memory_order_acquire);
+        if (node == nullptr)
+            return 0;
+    }
+    if (node->nPrimitives > 0)
+        return 0;
+    if (node != root && node->bounds.SurfaceArea() > node->builtSurfaceArea * rebuildThreshold)
+        return rebuildSubtree(node) ? 1 : -1;
+    int left = rebuildDegraded(node->left);
+    if (left < 0)
+        return -1;
+    int right = rebuildDegraded(node->right);
+    return right < 0 ? -1 : left + right;
+}
+
+/**
+ * @brief 在子树原有的图元范围内重新构建子树，并原地替换node的内容，父节点的指针保持有效。
+ *        要求子树的叶节点覆盖primitives中连续的一段（treelet优化后可能不满足）
+ */
+bool BVHAccel::rebuildSubtree(BVHBuildNode *node)
+{
+    int first = std::numeric_limits<int>::max(), end = 0, count = 0, unexpanded = 0;
+    size_t nodes = 0;
+    std::vector<BVHBuildNode *> stack = {node};
+    while (!stack.empty())
+    {
+        BVHBuildNode *n = stack.back();
+        stack.pop_back();
+        nodes++;
+        if (n->lazy)
+        {
+            BVHBuildNode *built = n->lazy->built.load(std::memory_order_acquire);
+            if (built)
+                stack.push_back(built);
+            else
+            {
+                first = std::min(first, n->lazy->first);
+                end = std::max(end, n->lazy->first + n->lazy->count);
+                count += n->lazy->count;
+                unexpanded++;
+            }
+        }
+        else if (n->nPrimitives > 0)
+        {
+            first = std::min(first, n->firstPrimOffset);
+            end = std::max(end, n->firstPrimOffset + n->nPrimitives);
+            count += n->nPrimitives;
+        }
+        else
+        {
+            stack.push_back(n->left);
+            stack.push_back(n->right);
+        }
+    }
+    if (end - first != count)
+        return false;
+
+    abandonedBytes += nodes * sizeof(BVHBuildNode);
+    *node = *buildRange(first, end);
+    // 未展开的延迟子树随之构建完毕
+    expandedSubtrees.fetch_add(unexpanded, std::memory_order_release);
+    if (splitMethod == SplitMethod::SBVH)
+        updateReferenceAreas();
+    return true;
+}
+
+/**
+ * @brief 对primitives中[first, end)重新构建子树，范围内的图元按新的叶节点顺序原地重排
+ * @return 新子树的根，叶节点下标已平移到原图元范围
+ */
+BVHBuildNode *BVHAccel::buildRange(int first, int end)
+{
+    int count = end - first;
+    std::vector<Object *> orderedPrims;
+    orderedPrims.reserve(count);
+    BVHBuildNode *subtree;
+    if (splitMethod == SplitMethod::NAIVE)
+        subtree = recursiveBuild(std::vector<Object *>(primitives.begin() + first, primitives.begin() + end), orderedPrims);
+    else
+    {
+        // LBVH与SBVH的局部重建也使用SAH对象划分，不再复制引用
+        std::vector<BVHPrimitiveInfo> refs;
+        refs.reserve(count);
+        for (int i = first; i < end; ++i)
+            refs.emplace_back(i, primitives[i]->getBounds());
+        int duplicateBudget = 0;
+        subtree = recursiveBuildSAH(std::move(refs), orderedPrims, duplicateBudget, 0, 0);
+    }
+    std::copy(orderedPrims.begin(), orderedPrims.end(), primitives.begin() + first);
+    for (int i = first; i < end; ++i)
+        primitiveAreas[i] = primitives[i]->getArea();
+
+    // 新子树的叶节点下标从0开始，平移到原图元范围
+    std::vector<BVHBuildNode *> stack = {subtree};
+    while (!stack.empty())
+    {
+        BVHBuildNode *n = stack.back();
+        stack.pop_back();
+        if (n->nPrimitives > 0)
+            n->firstPrimOffset += first;
+        else
+        {
+            stack.push_back(n->left);
+            stack.push_back(n->right);
+        }
+    }
+    markBuilt(subtree);
+    return subtree;
+}
+
+/**
+ * @brief 延迟构建的上层：按质心中位数划分，图元数不超过lazySubtreeSize时生成延迟子树，
+ *        只记录其图元范围、包围盒与面积。refs按划分结果原地重排，决定primitives的顺序
+ */
+BVHBuildNode *BVHAccel::buildLazyTop(std::vector<BVHPrimitiveInfo> &refs, int first, int end)
+{
+    BVHBuildNode *node = nodeArena.Create<BVHBuildNode>();
+    Bounds3 bounds, centroidBounds;
+    float area = 0;
+    for (int i = first; i < end; ++i)
+    {
+        bounds = Union(bounds, refs[i].bounds);
+        centroidBounds = Union(centroidBounds, refs[i].centroid);
+        area += primitives[refs[i].primitiveNumber]->getArea();
+    }
+    node->bounds = bounds;
+    node->area = area;
+    if (end - first <= lazySubtreeSize)
+    {
+        node->lazy = nodeArena.Create<LazySubtree>();
+        node->lazy->first = first;
+        node->lazy->count = end - first;
+        ++lazySubtrees;
+        return node;
+    }
+
+    int dim = centroidBounds.maxExtent();
+    int mid = (first + end) / 2;
+    std::nth_element(refs.begin() + first, refs.begin() + mid, refs.begin() + end,
+                     [dim](const BVHPrimitiveInfo &a, const BVHPrimitiveInfo &b)
+                     { return a.centroid[dim] < b.centroid[dim]; });
+    node->splitAxis = dim;
+    interiorNodes++;
+    node->left = buildLazyTop(refs, first, mid);
+    node->right = buildLazyTop(refs, mid, end);
+    return node;
+}
+
+/**
+ * @brief 返回延迟子树展开后的根节点，首次调用时构建。渲染线程可能并发到达同一子树，
+ *        以原子指针做双重检查，构建过程由lazyMutex串行化
+ */
+BVHBuildNode *BVHAccel::expand(BVHBuildNode *node) const
+{
+    LazySubtree *lazy = node->lazy;
+    BVHBuildNode *built = lazy->built.load(std::memory_order_acquire);
+    if (built)
+        return built;
+    std::lock_guard<std::mutex> lock(lazyMutex);
+    built = lazy->built.load(std::memory_order_relaxed);
+    if (!built)
+    {
+        // 只改动该子树独占的图元范围与内存池，其他线程不会读到未完成的部分
+        built = const_cast<BVHAccel *>(this)->buildRange(lazy->first, lazy->first + lazy->count);
+        lazy->built.store(built, std::memory_order_release);
+        expandedSubtrees.fetch_add(1, std::memory_order_release);
+    }
+    return built;
+}
+
+void BVHAccel::rebuild()
+{
+    if (splitMethod == SplitMethod::SBVH)
+    {
+        // 去掉SBVH复制的引用，恢复原始图元列表
+        std::unordered_map<Object *, bool> seen;
+        std::vector<Object *> unique;
+        for (auto object : primitives)
+            if (!seen[object])
+            {
+                seen[object] = true;
+                unique.push_back(object);
+            }
+        primitives.swap(unique);
+    }
+    root = nullptr;
+    nodeArena.Reset();
+    build();
+}
+
 Intersection BVHAccel::Intersect(const Ray &ray) const
 {
     Intersection isect;
     if (!root)
         return isect;
+    if (!quantizedNodes.empty())
+    {
+        STAT_INC(nodesVisited);
+        STAT_INC(boxTests);
+        if (!root->bounds.IntersectP(ray, ray.direction_inv, {int(ray.direction.x > 0), int(ray.direction.y > 0), int(ray.direction.z > 0)}))
+            return isect;
+        return getIntersectionQuantized(0, ray);
+    }
     isect = BVHAccel::getIntersection(root, ray);
     return isect;
 }
@@ -179,11 +1526,26 @@ Intersection BVHAccel::Intersect(const Ray &ray) const
 Intersection BVHAccel::getIntersection(BVHBuildNode *node, const Ray &ray) const
 {
     // TODO Traverse the BVH to find intersection
-    if (node == nullptr || !node->bounds.IntersectP(ray, ray.direction_inv, {int(ray.direction.x > 0), int(ray.direction.y > 0), int(ray.direction.z > 0)})) 
+    if (node == nullptr)
+        return Intersection();
+    STAT_INC(nodesVisited);
+    STAT_INC(boxTests);
+    if (!node->bounds.IntersectP(ray, ray.direction_inv, {int(ray.direction.x > 0), int(ray.direction.y > 0), int(ray.direction.z > 0)})) 
         return Intersection();
+    if (node->lazy)
+        node = expand(node);
 
-    if (node->object != nullptr) 
-        return node->object->getIntersection(ray);
+    if (node->nPrimitives > 0)
+    {
+        Intersection isect;
+        for (int i = 0; i < node->nPrimitives; ++i)
+        {
+            Intersection hit = primitives[node->firstPrimOffset + i]->getIntersection(ray);
+            if (hit.distance < isect.distance)
+                isect = hit;
+        }
+        return isect;
+    }
 
     auto hit1 = getIntersection(node->left, ray);
     auto hit2 = getIntersection(node->right, ray);
@@ -191,12 +1553,63 @@ Intersection BVHAccel::getIntersection(BVHBuildNode *node, const Ray &ray) const
     return hit1.distance < hit2.distance ? hit1 : hit2;
 }
 
+Intersection BVHAccel::getIntersectionQuantized(uint32_t index, const Ray &ray) const
+{
+    // 与getIntersection相同的遍历顺序，只是包围盒由父节点中的8位坐标解量化得到；
+    // 两个子节点的包围盒放在Vec3x4的通道0、1中一次完成slab测试
+    const QuantizedBVHNode &node = quantizedNodes[index];
+    Vec4f pMin[3], pMax[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        Vec4f origin(node.origin[i]), step(quantizationStep(node.exponent[i]));
+        pMin[i] = origin + Vec4f(node.qMin[0][i], node.qMin[1][i], 0, 0) * step;
+        pMax[i] = origin + Vec4f(node.qMax[0][i], node.qMax[1][i], 0, 0) * step;
+    }
+    const bool dirIsNeg[3] = {!(ray.direction.x > 0), !(ray.direction.y > 0), !(ray.direction.z > 0)};
+    int hitMask = simd::movemask(simd::intersectBoxes(Vec3x4(pMin[0], pMin[1], pMin[2]), Vec3x4(pMax[0], pMax[1], pMax[2]),
+                                                      ray.origin, ray.direction_inv, dirIsNeg));
+    Intersection hits[2];
+    for (int c = 0; c < 2; ++c)
+    {
+        STAT_INC(nodesVisited);
+        STAT_INC(boxTests);
+        if (!(hitMask >> c & 1))
+            continue;
+        if (node.nPrimitives[c] == 0)
+        {
+            hits[c] = getIntersectionQuantized(node.child[c], ray);
+            continue;
+        }
+        for (int i = 0; i < node.nPrimitives[c]; ++i)
+        {
+            Intersection hit = primitives[node.child[c] + i]->getIntersection(ray);
+            if (hit.distance < hits[c].distance)
+                hits[c] = hit;
+        }
+    }
+    return hits[0].distance < hits[1].distance ? hits[0] : hits[1];
+}
+
 void BVHAccel::getSample(BVHBuildNode *node, float p, Intersection &pos, float &pdf)
 {
+    if (node->lazy)
+        node = expand(node);
     if (node->left == nullptr || node->right == nullptr)
     {
-        node->object->Sample(pos, pdf);
-        pdf *= node->area;
+        // 叶节点内按面积选取图元
+        Object *object = primitives[node->firstPrimOffset + node->nPrimitives - 1];
+        for (int i = 0; i < node->nPrimitives; ++i)
+        {
+            float candidateArea = primitiveAreas[node->firstPrimOffset + i];
+            if (p < candidateArea)
+            {
+                object = primitives[node->firstPrimOffset + i];
+                break;
+            }
+            p -= candidateArea;
+        }
+        object->Sample(pos, pdf);
+        pdf *= object->getArea();
         return;
     }
     if (p < node->left->area)
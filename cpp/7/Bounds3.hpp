@@ -12,10 +12,10 @@ public:
     Vector3f pMin, pMax; // two points to specify the bounding box
     Bounds3()
     {
-        double minNum = std::numeric_limits<double>::lowest();
-        double maxNum = std::numeric_limits<double>::max();
-        pMax = Vector3f(minNum, minNum, minNum);
-        pMin = Vector3f(maxNum, maxNum, maxNum);
+        // 空包围盒：pMin为+inf、pMax为-inf，作为Union的单位元
+        const float inf = std::numeric_limits<float>::infinity();
+        pMax = Vector3f(-inf, -inf, -inf);
+        pMin = Vector3f(inf, inf, inf);
     }
     Bounds3(const Vector3f p) : pMin(p), pMax(p) {}
     Bounds3(const Vector3f p1, const Vector3f p2)
@@ -43,6 +43,8 @@ public:
     }
 
     Vector3f Centroid() { return 0.5 * pMin + 0.5 * pMax; }
+    // 默认构造或不相交求交得到的包围盒为空
+    bool IsEmpty() const { return pMin.x > pMax.x || pMin.y > pMax.y || pMin.z > pMax.z; }
     Bounds3 Intersect(const Bounds3 &b)
     {
         return Bounds3(Vector3f(fmax(pMin.x, b.pMin.x), fmax(pMin.y, b.pMin.y),
@@ -122,4 +124,17 @@ inline Bounds3 Union(const Bounds3 &b, const Vector3f &p)
     ret.pMin = Vector3f::Min(b.pMin, p);
     ret.pMax = Vector3f::Max(b.pMax, p);
     return ret;
-}
\ No newline at end of file
+}
+
+// 两个包围盒的交集，不相交时返回空包围盒（Bounds3::Intersect会重新排序角点，不能用于判断不相交）
+inline Bounds3 Overlap(const Bounds3 &b1, const Bounds3 &b2)
+{
+    Bounds3 ret;
+    Vector3f pMin = Vector3f::Max(b1.pMin, b2.pMin);
+    Vector3f pMax = Vector3f::Min(b1.pMax, b2.pMax);
+    if (pMin.x > pMax.x || pMin.y > pMax.y || pMin.z > pMax.z)
+        return ret;
+    ret.pMin = pMin;
+    ret.pMax = pMax;
+    return ret;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "global.hpp"
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * \brief 一维分段常数分布：按func的相对大小在[0, 1)上采样，
+ * 每段的概率密度与func成正比（func全为0时退化为均匀分布）
+ */
+class Distribution1D
+{
+public:
+    Distribution1D() = default;
+    explicit Distribution1D(std::vector<float> f) : func(std::move(f)), cdf(func.size() + 1)
+    {
+        int n = func.size();
+        cdf[0] = 0;
+        for (int i = 0; i < n; ++i)
+            cdf[i + 1] = cdf[i] + std::max(func[i], 0.0f) / n;
+        funcInt = cdf[n];
+        for (int i = 1; i <= n; ++i)
+            cdf[i] = funcInt > 0 ? cdf[i] / funcInt : float(i) / n;
+    }
+
+    int count() const { return func.size(); }
+    // func在[0, 1)上的积分
+    float integral() const { return funcInt; }
+
+    /**
+     * @brief 连续采样
+     * @param[out] pdf    采样点处的概率密度
+     * @param[out] offset 采样点所在的段
+     * @return [0, 1)中的采样点
+     */
+    float sampleContinuous(float u, float &pdf, int &offset) const
+    {
+        offset = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin() - 1;
+        offset = std::min(std::max(offset, 0), count() - 1);
+        float du = u - cdf[offset], width = cdf[offset + 1] - cdf[offset];
+        if (width > 0)
+            du /= width;
+        pdf = this->pdf(offset);
+        return std::min((offset + du) / count(), 1 - std::numeric_limits<float>::epsilon());
+    }
+
+    // 离散采样，返回段下标，pmf为该段的概率
+    int sampleDiscrete(float u, float &pmf) const
+    {
+        int offset = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin() - 1;
+        offset = std::min(std::max(offset, 0), count() - 1);
+        pmf = cdf[offset + 1] - cdf[offset];
+        return offset;
+    }
+
+    // 第offset段上的概率密度
+    float pdf(int offset) const { return funcInt > 0 ? std::max(func[offset], 0.0f) / funcInt : 1.0f; }
+
+private:
+    std::vector<float> func, cdf;
+    float funcInt = 0;
+};
+
+/**
+ * \brief 二维分段常数分布：先按各行的积分（边缘分布）选行，再在行内按条件分布采样，
+ * 返回[0, 1)^2中的点及其概率密度
+ */
+class Distribution2D
+{
+public:
+    Distribution2D() = default;
+    // func按行存放，width * height个值
+    Distribution2D(const std::vector<float> &func, int width, int height)
+    {
+        rows.reserve(height);
+        std::vector<float> marginalFunc(height);
+        for (int y = 0; y < height; ++y)
+        {
+            rows.emplace_back(std::vector<float>(func.begin() + (size_t)y * width, func.begin() + (size_t)(y + 1) * width));
+            marginalFunc[y] = rows.back().integral();
+        }
+        marginal = Distribution1D(std::move(marginalFunc));
+    }
+
+    void sample(float u0, float u1, float &x, float &y, float &pdf) const
+    {
+        float pdfs[2];
+        int row, column;
+        y = marginal.sampleContinuous(u1, pdfs[1], row);
+        x = rows[row].sampleContinuous(u0, pdfs[0], column);
+        pdf = pdfs[0] * pdfs[1];
+    }
+
+    float pdf(float x, float y) const
+    {
+        int row = std::min(std::max(int(y * marginal.count()), 0), marginal.count() - 1);
+        int column = std::min(std::max(int(x * rows[row].count()), 0), rows[row].count() - 1);
+        return marginal.integral() > 0 ? std::max(rows[row].pdf(column), 0.0f) * rows[row].integral() / marginal.integral() : 1.0f;
+    }
+
+private:
+    std::vector<Distribution1D> rows;
+    Distribution1D marginal;
+};
+
+// 多重重要性采样的幂启发式（β = 2），fPdf为被加权的策略的概率密度
+inline float powerHeuristic(float fPdf, float gPdf)
+{
+    float f = fPdf * fPdf, g = gPdf * gPdf;
+    return f + g > 0 ? f / (f + g) : 0;
+}
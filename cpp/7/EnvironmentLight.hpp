@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Distribution.hpp"
+#include "Texture.hpp"
+#include "Vector.hpp"
+#include "global.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * \brief 无穷远处的环境光：经纬度（lat-long）HDR贴图，+y为天顶，第0行为θ = 0，
+ * u = φ / 2π、v = θ / π，方向为(sinθ cosφ, cosθ, sinθ sinφ)。
+ * 按亮度 × sinθ建立二维分段常数分布，光源采样的方向按贴图的亮处集中，
+ * 贴图按最近纹素取值，与采样分布完全一致
+ */
+class EnvironmentLight
+{
+public:
+    // 由PFM（或PPM）经纬度贴图创建，scale为整体亮度
+    explicit EnvironmentLight(const std::string &path, float scale = 1)
+    {
+        if (!loadImage(path, width, height, radiance))
+        {
+            std::cerr << "Cannot load environment map " << path << "\n";
+            width = height = 1;
+            radiance.assign(3, 0.0f);
+        }
+        for (auto &c : radiance)
+            c *= scale;
+        buildDistribution();
+    }
+
+    // 各方向相同的环境光
+    explicit EnvironmentLight(const Vector3f &color) : width(1), height(1), radiance{color.x, color.y, color.z}
+    {
+        buildDistribution();
+    }
+
+    // 沿方向dir（指向环境）到达的辐射亮度
+    Vector3f eval(const Vector3f &dir) const
+    {
+        float u, v;
+        directionToUV(dir, u, v);
+        const float *c = &radiance[texelIndex(u, v) * 3];
+        return Vector3f(c[0], c[1], c[2]);
+    }
+
+    /**
+     * @brief 按贴图亮度采样方向
+     * @param[out] pdf 立体角上的概率密度，为0时采样无效
+     * @return 指向环境的单位方向与该方向的辐射亮度
+     */
+    Vector3f sample(Vector3f &dir, float &pdf) const
+    {
+        float u, v, pdfUV;
+        distribution.sample(get_random_float(), get_random_float(), u, v, pdfUV);
+        float theta = v * M_PI, phi = u * 2 * M_PI;
+        float sinTheta = std::sin(theta);
+        dir = Vector3f(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+        // (u, v)到立体角的雅可比行列式为2π² sinθ
+        pdf = sinTheta > 0 ? pdfUV / (2 * M_PI * M_PI * sinTheta) : 0;
+        const float *c = &radiance[texelIndex(u, v) * 3];
+        return Vector3f(c[0], c[1], c[2]);
+    }
+
+    // 光源采样得到方向dir的概率密度（立体角）
+    float pdf(const Vector3f &dir) const
+    {
+        float u, v;
+        directionToUV(dir, u, v);
+        float sinTheta = std::sin(v * M_PI);
+        return sinTheta > 0 ? distribution.pdf(u, v) / (2 * M_PI * M_PI * sinTheta) : 0;
+    }
+
+private:
+    int width = 0, height = 0;
+    std::vector<float> radiance; // 自上而下逐行的RGB
+    Distribution2D distribution;
+
+    void buildDistribution()
+    {
+        // 每个纹素的权重为亮度 × sinθ（θ取纹素中心），使立体角上的采样密度与亮度成正比
+        std::vector<float> func((size_t)width * height);
+        for (int y = 0; y < height; ++y)
+        {
+            float sinTheta = std::sin((y + 0.5f) / height * M_PI);
+            for (int x = 0; x < width; ++x)
+            {
+                const float *c = &radiance[((size_t)y * width + x) * 3];
+                func[(size_t)y * width + x] = luminance(Vector3f(c[0], c[1], c[2])) * sinTheta;
+            }
+        }
+        distribution = Distribution2D(func, width, height);
+    }
+
+    static void directionToUV(const Vector3f &dir, float &u, float &v)
+    {
+        float theta = std::acos(clamp(-1, 1, dir.y));
+        float phi = std::atan2(dir.z, dir.x);
+        if (phi < 0)
+            phi += 2 * M_PI;
+        u = phi / (2 * M_PI);
+        v = theta / M_PI;
+    }
+
+    size_t texelIndex(float u, float v) const
+    {
+        int x = std::min(int(u * width), width - 1), y = std::min(int(v * height), height - 1);
+        return (size_t)y * width + x;
+    }
+};
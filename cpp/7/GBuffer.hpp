@@ -0,0 +1,165 @@
+#pragma once
+
+#include "Scene.hpp"
+#include "global.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief 相机光线首个交点的G-buffer：Render与RenderProgressive的MSAA亚像素位置是确定的，
+ * 同一(像素, 子采样k)的相机光线每次渲染都相同。第一次渲染时记录每个子采样的首个交点
+ * （位置、几何法线、纹理坐标、材质编号，40字节），之后的渲染（只修改了光照或材质参数时）
+ * 从记录出发继续路径追踪，不再求交相机光线。
+ * 子采样按k分层存放，层数受maxBytes限制，超出的子采样照常追踪；换了场景、场景的几何体重建或更新
+ * （Scene::geometryGeneration变化）、材质表增减，以及相机或子采样网格变化时自动清空。
+ * 材质参数的修改需先调用scene.materials.commit()才会进入着色使用的核函数
+ */
+class GBuffer
+{
+public:
+    // 所有层的内存上限（字节）
+    size_t maxBytes = 256 << 20;
+
+    /**
+     * @brief 渲染开始前调用：图像与子采样网格的参数和已有记录不一致时清空并按maxBytes重新分配
+     * @param gridWidth, gridHeight MSAA子采样网格的尺寸
+     * @param spp 每像素采样数，层数不超过它
+     */
+    void prepare(const Scene &scene, int gridWidth, int gridHeight, int spp)
+    {
+        Layout layout{&scene, scene.geometryGeneration, scene.materials.size(),
+                      scene.width, scene.height, gridWidth, gridHeight, (float)scene.fov};
+        if (!(layout == current))
+        {
+            invalidate();
+            current = layout;
+        }
+        // 布局不变时保留已有的层，只追加新层
+        size_t pixels = (size_t)scene.width * scene.height;
+        int wanted = (int)std::min<size_t>(spp, maxBytes / (pixels * sizeof(Record)));
+        if (wanted > layers)
+        {
+            layers = wanted;
+            records.resize(pixels * layers);
+        }
+    }
+
+    // 丢弃全部记录
+    void invalidate()
+    {
+        records.clear();
+        layers = 0;
+    }
+
+    /**
+     * @brief 像素m的第k个子采样的首个交点：已有记录时由记录还原，否则追踪相机光线并记录（同一像素只能由一个线程调用）
+     * @param ray 该子采样的相机光线
+     */
+    PrimaryHit primary(const Scene &scene, const Ray &ray, int m, int k)
+    {
+        if (k >= layers)
+            return scene.tracePrimary(ray);
+        Record &record = records[(size_t)k * current.width * current.height + m];
+        if (record.material == empty)
+        {
+            PrimaryHit hit = scene.tracePrimary(ray);
+            store(record, hit);
+            return hit;
+        }
+        // 材质编号越界说明记录与场景不符（prepare未随场景变化调用），不使用记录
+        if (record.material == unlisted || (record.material != escaped && record.material >= scene.materials.size()))
+            return scene.tracePrimary(ray);
+        reused.fetch_add(1, std::memory_order_relaxed);
+        return load(scene, record, ray);
+    }
+
+    // 由记录还原的首个交点数（跨多次渲染累计）
+    uint64_t reusedCount() const { return reused.load(std::memory_order_relaxed); }
+    size_t bytes() const { return records.size() * sizeof(Record); }
+
+private:
+    // material为材质编号，或下面的特殊值
+    struct Record
+    {
+        Vector3f p, normal;
+        float u, v, uvScale;
+        uint32_t material = empty;
+    };
+    static constexpr uint32_t empty = ~0u;         // 尚未追踪
+    static constexpr uint32_t escaped = ~0u - 1;   // 相机光线未命中任何物体
+    static constexpr uint32_t unlisted = ~0u - 2;  // 材质不在场景材质表中，无法记录，每次重新追踪
+
+    struct Layout
+    {
+        const Scene *scene = nullptr;
+        uint64_t generation = 0;
+        size_t materials = 0;
+        int width = 0, height = 0, gridWidth = 0, gridHeight = 0;
+        float fov = 0;
+        bool operator==(const Layout &o) const
+        {
+            return scene == o.scene && generation == o.generation && materials == o.materials &&
+                   width == o.width && height == o.height && gridWidth == o.gridWidth &&
+                   gridHeight == o.gridHeight && fov == o.fov;
+        }
+    };
+
+    Layout current;
+    int layers = 0;
+    std::vector<Record> records;
+    std::atomic<uint64_t> reused{0};
+
+    void store(Record &record, const PrimaryHit &hit)
+    {
+        if (!hit.inter.happened)
+        {
+            record.material = escaped;
+            return;
+        }
+        uint32_t id = hit.inter.m->id();
+        if (id == Material::invalidId)
+        {
+            record.material = unlisted;
+            return;
+        }
+        record.p = hit.inter.coords;
+        record.normal = hit.inter.normal;
+        record.u = hit.inter.tcoords.x;
+        record.v = hit.inter.tcoords.y;
+        record.uvScale = hit.inter.uvScale;
+        record.material = id;
+    }
+
+    // 与Scene::tracePrimary的结果完全相同（法线不做量化，否则阴影光线与采样方向的细微差别会改变渲染结果），
+    // 光源的自发光与环境光按当前参数重新求值
+    PrimaryHit load(const Scene &scene, const Record &record, const Ray &ray) const
+    {
+        PrimaryHit hit(ray);
+        if (record.material == escaped)
+        {
+            STAT_PATH_LENGTH(0);
+            hit.Le = scene.environment ? scene.environment->eval(ray.direction) : Vector3f();
+            return hit;
+        }
+        Intersection &inter = hit.inter;
+        inter.happened = true;
+        inter.coords = record.p;
+        inter.normal = record.normal;
+        inter.tcoords = Vector3f(record.u, record.v, 0);
+        inter.uvScale = record.uvScale;
+        inter.distance = (record.p - ray.origin).norm();
+        inter.m = scene.materials.get(record.material);
+        if (inter.m->flags() & MATERIAL_EMISSIVE)
+        {
+            STAT_PATH_LENGTH(1);
+            hit.Le = inter.m->getEmission();
+            return hit;
+        }
+        hit.N = scene.shadingNormal(ray, inter);
+        hit.surface = true;
+        return hit;
+    }
+};
@@ -20,6 +20,8 @@ struct Intersection
     bool happened;
     Vector3f coords;
     Vector3f tcoords;
+    // 纹理坐标相对世界坐标的缩放（sqrt(纹理空间面积 / 世界空间面积)），用于换算纹理足迹
+    float uvScale = 0;
     Vector3f normal;
     Vector3f emit;
     double distance;
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "Intersection.hpp"
+#include "LightBounds.hpp"
+#include "Object.hpp"
+#include "global.hpp"
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * \brief 光源层次结构（light BVH）：叶节点为单个自发光图元，每个节点保存其下光源的包围盒、
+ * 发光方向锥与总功率。采样时从根节点出发，按两个子节点对着色点的重要性随机选择一侧，
+ * O(log n)步到达一个光源，选中的概率为沿途各步概率之积，远处或背对着色点的光源很少被选中
+ */
+class LightBVH
+{
+public:
+    explicit LightBVH(std::vector<Object *> emitters);
+
+    /**
+     * @brief 为着色点p（法线n）采样光源上的一点
+     * @param[out] pdf 面积测度下的概率密度，为0时没有对p有贡献的光源
+     */
+    void sample(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf) const;
+    // 按重要性选中光源emitter的概率（emitter为构造时传入的下标）
+    float pmf(const Vector3f &p, const Vector3f &n, int emitter) const;
+
+    size_t size() const { return emitters.size(); }
+    size_t numNodes() const { return nodes.size(); }
+
+private:
+    // 深度优先存放，左子节点紧随其后
+    struct Node
+    {
+        LightBounds bounds;
+        int secondChild = -1; // 右子节点下标，叶节点为-1
+        int emitter = -1;     // 叶节点的光源下标
+        int parent = -1;
+    };
+    std::vector<Node> nodes;
+    std::vector<Object *> emitters;
+    std::vector<int> leafOf; // 各光源所在的叶节点
+
+    struct Item
+    {
+        int emitter;
+        LightBounds bounds;
+        Vector3f centroid;
+    };
+    int build(std::vector<Item> &items, int begin, int end, int parent);
+    static float splitCost(const LightBounds &b, const Bounds3 &bounds, int dim);
+};
+
+inline LightBVH::LightBVH(std::vector<Object *> all)
+{
+    std::vector<Item> items;
+    for (Object *object : all)
+    {
+        LightBounds b = object->getLightBounds();
+        // 功率为0的光源不参与采样
+        if (b.phi <= 0)
+            continue;
+        items.push_back({(int)emitters.size(), b, 0.5f * (b.bounds.pMin + b.bounds.pMax)});
+        emitters.push_back(object);
+    }
+    leafOf.assign(emitters.size(), -1);
+    nodes.reserve(2 * items.size());
+    if (!items.empty())
+        build(items, 0, items.size(), -1);
+}
+
+/**
+ * @brief 划分的开销：功率 × 方向锥覆盖的立体角度量 × 包围盒表面积，Kr惩罚细长的包围盒
+ */
+inline float LightBVH::splitCost(const LightBounds &b, const Bounds3 &bounds, int dim)
+{
+    float theta_o = std::acos(clamp(-1, 1, b.cosTheta_o)), theta_e = std::acos(clamp(-1, 1, b.cosTheta_e));
+    float theta_w = std::min(theta_o + theta_e, (float)M_PI);
+    float sinTheta_o = LightBounds::safeSqrt(1 - b.cosTheta_o * b.cosTheta_o);
+    float M_omega = 2 * M_PI * (1 - b.cosTheta_o) +
+                    M_PI / 2 * (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) - 2 * theta_o * sinTheta_o + b.cosTheta_o);
+    Vector3f d = bounds.Diagonal();
+    float Kr = std::max(d.x, std::max(d.y, d.z)) / std::max(d[dim], 1e-6f);
+    return b.phi * M_omega * Kr * b.bounds.SurfaceArea();
+}
+
+inline int LightBVH::build(std::vector<Item> &items, int begin, int end, int parent)
+{
+    int index = nodes.size();
+    nodes.emplace_back();
+    nodes[index].parent = parent;
+    if (end - begin == 1)
+    {
+        nodes[index].bounds = items[begin].bounds;
+        nodes[index].emitter = items[begin].emitter;
+        leafOf[items[begin].emitter] = index;
+        return index;
+    }
+
+    Bounds3 bounds, centroids;
+    for (int i = begin; i < end; ++i)
+    {
+        bounds = Union(bounds, items[i].bounds.bounds);
+        centroids = Union(centroids, items[i].centroid);
+    }
+
+    // 三个轴上各分12个桶，取开销最小的划分
+    const int numBuckets = 12;
+    float bestCost = std::numeric_limits<float>::infinity();
+    int bestDim = -1, bestBucket = -1;
+    for (int dim = 0; dim < 3; ++dim)
+    {
+        float lo = centroids.pMin[dim], hi = centroids.pMax[dim];
+        if (hi <= lo)
+            continue;
+        LightBounds buckets[numBuckets];
+        auto bucketOf = [&](const Item &item)
+        { return std::min(numBuckets - 1, int(numBuckets * (item.centroid[dim] - lo) / (hi - lo))); };
+        for (int i = begin; i < end; ++i)
+        {
+            LightBounds &b = buckets[bucketOf(items[i])];
+            b = Union(b, items[i].bounds);
+        }
+        for (int split = 0; split < numBuckets - 1; ++split)
+        {
+            LightBounds left, right;
+            for (int b = 0; b <= split; ++b)
+                left = Union(left, buckets[b]);
+            for (int b = split + 1; b < numBuckets; ++b)
+                right = Union(right, buckets[b]);
+            float cost = splitCost(left, bounds, dim) + splitCost(right, bounds, dim);
+            if (left.phi > 0 && right.phi > 0 && cost < bestCost)
+            {
+                bestCost = cost;
+                bestDim = dim;
+                bestBucket = split;
+            }
+        }
+    }
+
+    int mid;
+    if (bestDim >= 0)
+    {
+        float lo = centroids.pMin[bestDim], hi = centroids.pMax[bestDim];
+        mid = std::partition(items.begin() + begin, items.begin() + end, [&](const Item &item)
+                             { return std::min(numBuckets - 1, int(numBuckets * (item.centroid[bestDim] - lo) / (hi - lo))) <= bestBucket; }) -
+              items.begin();
+    }
+    else
+        mid = (begin + end) / 2; // 质心重合时按下标对半分
+    if (mid == begin || mid == end)
+        mid = (begin + end) / 2;
+
+    build(items, begin, mid, index);
+    int second = build(items, mid, end, index);
+    nodes[index].secondChild = second;
+    nodes[index].bounds = Union(nodes[index + 1].bounds, nodes[second].bounds);
+    return index;
+}
+
+inline void LightBVH::sample(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf) const
+{
+    pdf = 0;
+    if (nodes.empty() || nodes[0].bounds.importance(p, n) <= 0)
+        return;
+    float u = get_random_float(), pmf = 1;
+    int index = 0;
+    while (nodes[index].secondChild >= 0)
+    {
+        const Node &node = nodes[index];
+        float c0 = nodes[index + 1].bounds.importance(p, n), c1 = nodes[node.secondChild].bounds.importance(p, n);
+        if (c0 <= 0 && c1 <= 0)
+            return;
+        float p0 = c0 / (c0 + c1);
+        // 复用u：按所选分支的概率重新映射到[0, 1)
+        if (u < p0)
+        {
+            index = index + 1;
+            pmf *= p0;
+            u = std::min(u / p0, 0.99999994f);
+        }
+        else
+        {
+            index = node.secondChild;
+            pmf *= 1 - p0;
+            u = std::min((u - p0) / (1 - p0), 0.99999994f);
+        }
+    }
+    float areaPdf;
+    emitters[nodes[index].emitter]->Sample(pos, areaPdf);
+    pdf = pmf * areaPdf;
+}
+
+inline float LightBVH::pmf(const Vector3f &p, const Vector3f &n, int emitter) const
+{
+    int index = leafOf[emitter];
+    if (index < 0 || nodes[0].bounds.importance(p, n) <= 0)
+        return 0;
+    float pmf = 1;
+    for (int parent = nodes[index].parent; parent >= 0; index = parent, parent = nodes[index].parent)
+    {
+        float c0 = nodes[parent + 1].bounds.importance(p, n), c1 = nodes[nodes[parent].secondChild].bounds.importance(p, n);
+        float c = (index == parent + 1) ? c0 : c1;
+        if (c <= 0)
+            return 0;
+        pmf *= c / (c0 + c1);
+    }
+    return pmf;
+}
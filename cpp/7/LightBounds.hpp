@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Bounds3.hpp"
+#include "Vector.hpp"
+#include "global.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * \brief 光源层次结构中的光源包围信息：空间包围盒、发光方向锥（轴w、半角θo）、
+ * 锥外的发射衰减范围θe（漫反射面光源为π/2）与总功率phi
+ */
+struct LightBounds
+{
+    Bounds3 bounds;
+    Vector3f w = Vector3f(0, 0, 1);
+    float phi = 0;
+    float cosTheta_o = 1;
+    float cosTheta_e = 0;
+    bool twoSided = false;
+
+    LightBounds() = default;
+    LightBounds(const Bounds3 &b, const Vector3f &w, float phi, float cosTheta_o, float cosTheta_e, bool twoSided)
+        : bounds(b), w(w), phi(phi), cosTheta_o(cosTheta_o), cosTheta_e(cosTheta_e), twoSided(twoSided) {}
+
+    /**
+     * @brief 包围内的光源对着色点p（法线n，为0时不考虑入射角）贡献的保守估计，
+     *        用于光源层次结构的随机遍历：功率 × 发射角上界的余弦 × 入射角上界的余弦 / 距离平方
+     */
+    float importance(const Vector3f &p, const Vector3f &n) const
+    {
+        Vector3f pc = 0.5f * (bounds.pMin + bounds.pMax);
+        Vector3f d = p - pc;
+        float d2 = dotProduct(d, d);
+        float r2 = 0.25f * dotProduct(bounds.Diagonal(), bounds.Diagonal());
+        // 着色点离包围盒很近时按包围盒尺度截断，避免重要性发散
+        d2 = std::max(d2, std::sqrt(r2));
+        Vector3f wi = d.normalized();
+
+        float cosTheta_w = dotProduct(w, wi);
+        if (twoSided)
+            cosTheta_w = std::fabs(cosTheta_w);
+        float sinTheta_w = safeSqrt(1 - cosTheta_w * cosTheta_w);
+
+        // 从p看包围球所张的角的上界
+        float cosTheta_b = dotProduct(d, d) < r2 ? -1 : safeSqrt(1 - r2 / dotProduct(d, d));
+        float sinTheta_b = safeSqrt(1 - cosTheta_b * cosTheta_b);
+
+        // 发射方向与p方向夹角的下界：θ' = max(0, θw - θo - θb)
+        float sinTheta_o = safeSqrt(1 - cosTheta_o * cosTheta_o);
+        float cosTheta_x = cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+        float sinTheta_x = sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+        float cosThetap = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+        if (cosThetap <= cosTheta_e)
+            return 0;
+        float result = phi * cosThetap / d2;
+
+        if (n.x != 0 || n.y != 0 || n.z != 0)
+        {
+            float cosTheta_i = std::fabs(dotProduct(wi, n));
+            float sinTheta_i = safeSqrt(1 - cosTheta_i * cosTheta_i);
+            result *= cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+        }
+        return std::max(result, 0.0f);
+    }
+
+    static float safeSqrt(float x) { return std::sqrt(std::max(0.0f, x)); }
+    // cos(max(0, a - b))
+    static float cosSubClamped(float sinA, float cosA, float sinB, float cosB)
+    {
+        return cosA > cosB ? 1 : cosA * cosB + sinA * sinB;
+    }
+    // sin(max(0, a - b))
+    static float sinSubClamped(float sinA, float cosA, float sinB, float cosB)
+    {
+        return cosA > cosB ? 0 : sinA * cosB - cosA * sinB;
+    }
+};
+
+// 绕单位轴axis旋转theta弧度（Rodrigues公式）
+inline Vector3f rotateAround(const Vector3f &v, const Vector3f &axis, float theta)
+{
+    float c = std::cos(theta), s = std::sin(theta);
+    return v * c + crossProduct(axis, v) * s + axis * (dotProduct(axis, v) * (1 - c));
+}
+
+/**
+ * @brief 合并两个光源包围：包围盒取并集，功率相加，方向锥取同时覆盖两者的最小锥
+ */
+inline LightBounds Union(const LightBounds &a, const LightBounds &b)
+{
+    if (a.phi == 0)
+        return b;
+    if (b.phi == 0)
+        return a;
+
+    Vector3f w;
+    float cosTheta_o;
+    float theta_a = std::acos(clamp(-1, 1, a.cosTheta_o)), theta_b = std::acos(clamp(-1, 1, b.cosTheta_o));
+    float theta_d = std::acos(clamp(-1, 1, dotProduct(a.w, b.w)));
+    if (std::min(theta_d + theta_b, (float)M_PI) <= theta_a)
+    {
+        w = a.w;
+        cosTheta_o = a.cosTheta_o;
+    }
+    else if (std::min(theta_d + theta_a, (float)M_PI) <= theta_b)
+    {
+        w = b.w;
+        cosTheta_o = b.cosTheta_o;
+    }
+    else
+    {
+        float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+        Vector3f axis = crossProduct(a.w, b.w);
+        if (theta_o >= M_PI || dotProduct(axis, axis) == 0)
+        {
+            w = a.w;
+            cosTheta_o = -1;
+        }
+        else
+        {
+            w = rotateAround(a.w, axis.normalized(), theta_o - theta_a).normalized();
+            cosTheta_o = std::cos(theta_o);
+        }
+    }
+    return LightBounds(Union(a.bounds, b.bounds), w, a.phi + b.phi, cosTheta_o,
+                       std::min(a.cosTheta_e, b.cosTheta_e), a.twoSided || b.twoSided);
+}
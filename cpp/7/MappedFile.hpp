@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * \brief 只读内存映射文件（POSIX下使用mmap，Windows/MinGW下退化为一次性读入内存）
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+
+    const char *data() const { return ptr; }
+    size_t size() const { return len; }
+
+private:
+    const char *ptr = nullptr;
+    size_t len = 0;
+#ifdef _WIN32
+    std::vector<char> buffer;
+#endif
+};
+
+inline bool MappedFile::open(const std::string &path)
+{
+    close();
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        return false;
+    buffer.resize((size_t)in.tellg());
+    in.seekg(0);
+    in.read(buffer.data(), buffer.size());
+    ptr = buffer.data();
+    len = buffer.size();
+    return (bool)in;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    len = (size_t)st.st_size;
+    if (len > 0)
+    {
+        void *p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            len = 0;
+            return false;
+        }
+        ptr = (const char *)p;
+    }
+    // 映射建立后即可关闭文件描述符
+    ::close(fd);
+    return true;
+#endif
+}
+
+inline void MappedFile::close()
+{
+#ifdef _WIN32
+    buffer.clear();
+    buffer.shrink_to_fit();
+#else
+    if (ptr != nullptr)
+        munmap((void *)ptr, len);
+#endif
+    ptr = nullptr;
+    len = 0;
+}
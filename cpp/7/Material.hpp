@@ -1,18 +1,127 @@
 #pragma once
 
 #include "Vector.hpp"
+#include "Simd.hpp"
+#include "Texture.hpp"
+
+#include <cstdint>
+#include <tuple>
+#include <vector>
 
 enum MaterialType
 {
     DIFFUSE,
-    GLOSSY
+    GLOSSY,
+    MICROFACET
+};
+
+// 材质标志：提交材质时预先计算，着色时只做位测试
+enum MaterialFlag : uint32_t
+{
+    MATERIAL_EMISSIVE = 1u << 0,  // 自发光
+    MATERIAL_DELTA = 1u << 1,     // BSDF为delta分布（理想镜面），无法采样光源
+    MATERIAL_TWO_SIDED = 1u << 2, // 双面，从背面到达时按翻转后的法线着色
+    MATERIAL_TEXTURED = 1u << 3,  // 反照率来自diffuseTexture
+};
+
+// 每种材质类型的BSDF核函数。增加新材质：在MaterialType中加一项，特化BSDF<T>
+// （提供flags、由Material构造、sample/pdf/eval），再把它加入MaterialTypes，无需修改着色代码
+template <MaterialType T>
+struct BSDF;
+
+template <MaterialType... Ts>
+struct MaterialTypeList
+{
 };
+using MaterialTypes = MaterialTypeList<DIFFUSE, GLOSSY, MICROFACET>;
+
+template <typename List>
+class MaterialTableOf;
+using MaterialTable = MaterialTableOf<MaterialTypes>;
 
 class Material
 {
+public:
+    MaterialType m_type;
+    // Vector3f m_color;
+    Vector3f m_emission;
+    float ior;
+    Vector3f Kd, Ks;
+    float specularExponent;
+    // 微表面粗糙度（MICROFACET），GGX的alpha = roughness^2
+    float roughness = 0.5f;
+    bool twoSided = false;
+    // 漫反射反照率纹理，替换Kd（由调用者持有）
+    Texture *diffuseTexture = nullptr;
+
+    inline Material(MaterialType t = DIFFUSE, Vector3f e = Vector3f(0, 0, 0));
+    inline MaterialType getType() const;
+    // inline Vector3f getColor();
+    inline Vector3f getColorAt(double u, double v, float footprint = 0) const;
+    inline Vector3f getEmission() const;
+    inline bool hasEmission() const;
+    // MaterialFlag的组合
+    uint32_t flags() const { return m_flags; }
+    // 在场景材质表中的编号，未登记时为invalidId
+    static constexpr uint32_t invalidId = ~0u;
+    uint32_t id() const { return m_id; }
+
+    /**
+     * @brief 按材质类型调用f(const BSDF<T> &)，各类型的调用在编译期展开并可内联。
+     *        已提交到MaterialTable的材质使用表中的核函数，否则按当前参数临时构造
+     */
+    template <typename F>
+    decltype(auto) dispatch(F &&f) const { return dispatchImpl(f, MaterialTypes()); }
+
+    // sample a ray by Material properties
+    inline Vector3f sample(const Vector3f &wi, const Vector3f &N) const;
+    // given a ray, calculate the PdF of this ray
+    inline float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) const;
+    // given a ray, calculate the contribution of this ray
+    inline Vector3f eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) const;
+
 private:
+    template <typename List>
+    friend class MaterialTableOf;
+
+    uint32_t m_flags = 0;
+    uint32_t m_id = invalidId;
+    const void *m_kernel = nullptr; // 指向MaterialTable中BSDF<m_type>的核函数
+
+    inline uint32_t computeFlags() const;
+
+    template <MaterialType... Ts>
+    uint32_t typeFlags(MaterialTypeList<Ts...>) const
+    {
+        uint32_t flags = 0;
+        ((m_type == Ts ? flags = BSDF<Ts>::flags : 0), ...);
+        return flags;
+    }
+
+    template <typename F, MaterialType T, MaterialType... Rest>
+    decltype(auto) dispatchImpl(F &f, MaterialTypeList<T, Rest...>) const
+    {
+        if constexpr (sizeof...(Rest) == 0)
+            return f(kernel<T>());
+        else
+        {
+            if (m_type == T)
+                return f(kernel<T>());
+            return dispatchImpl(f, MaterialTypeList<Rest...>());
+        }
+    }
+
+    template <MaterialType T>
+    BSDF<T> kernel() const
+    {
+        return m_kernel ? *static_cast<const BSDF<T> *>(m_kernel) : BSDF<T>(*this);
+    }
+};
+
+namespace bsdf
+{
     // Compute reflection direction
-    Vector3f reflect(const Vector3f &I, const Vector3f &N) const
+    inline Vector3f reflect(const Vector3f &I, const Vector3f &N)
     {
         return I - 2 * dotProduct(I, N) * N;
     }
@@ -28,7 +137,7 @@ private:
     // If the ray is outside, you need to make cosi positive cosi = -N.I
     //
     // If the ray is inside, you need to invert the refractive indices and negate the normal N
-    Vector3f refract(const Vector3f &I, const Vector3f &N, const float &ior) const
+    inline Vector3f refract(const Vector3f &I, const Vector3f &N, const float &ior)
     {
         float cosi = clamp(-1, 1, dotProduct(I, N));
         float etai = 1, etat = ior;
@@ -56,7 +165,7 @@ private:
     // \param ior is the material refractive index
     //
     // \param[out] kr is the amount of light reflected
-    void fresnel(const Vector3f &I, const Vector3f &N, const float &ior, float &kr) const
+    inline void fresnel(const Vector3f &I, const Vector3f &N, const float &ior, float &kr)
     {
         float cosi = clamp(-1, 1, dotProduct(I, N));
         float etai = 1, etat = ior;
@@ -83,159 +192,346 @@ private:
         // kt = 1 - kr;
     }
 
-    Vector3f toWorld(const Vector3f &a, const Vector3f &N)
+    // 用纹理颜色替换核函数的反照率（需提供setAlbedo），其他BSDF保持不变
+    template <typename Kernel>
+    auto setAlbedo(Kernel &kernel, const Vector3f &albedo, int) -> decltype(kernel.setAlbedo(albedo), void())
+    {
+        kernel.setAlbedo(albedo);
+    }
+    template <typename Kernel>
+    void setAlbedo(Kernel &, const Vector3f &, long) {}
+
+    // 以N为z轴的正交基(B, C, N)
+    inline void tangentFrame(const Vector3f &N, Vector3f &B, Vector3f &C)
     {
-        Vector3f B, C;
         if (std::fabs(N.x) > std::fabs(N.y))
         {
-            float invLen = 1.0f / std::sqrt(N.x * N.x + N.z * N.z);
+            float invLen = fastmath::rsqrt(N.x * N.x + N.z * N.z);
             C = Vector3f(N.z * invLen, 0.0f, -N.x * invLen);
         }
         else
         {
-            float invLen = 1.0f / std::sqrt(N.y * N.y + N.z * N.z);
+            float invLen = fastmath::rsqrt(N.y * N.y + N.z * N.z);
             C = Vector3f(0.0f, N.z * invLen, -N.y * invLen);
         }
         B = crossProduct(C, N);
+    }
+
+    inline Vector3f toWorld(const Vector3f &a, const Vector3f &N)
+    {
+        Vector3f B, C;
+        tangentFrame(N, B, C);
         return a.x * B + a.y * C + a.z * N;
     }
 
-public:
-    MaterialType m_type;
-    // Vector3f m_color;
-    Vector3f m_emission;
-    float ior;
-    Vector3f Kd, Ks;
-    float specularExponent;
-    // Texture tex;
+    inline Vector3f toLocal(const Vector3f &a, const Vector3f &N)
+    {
+        Vector3f B, C;
+        tangentFrame(N, B, C);
+        return Vector3f(dotProduct(a, B), dotProduct(a, C), dotProduct(a, N));
+    }
 
-    inline Material(MaterialType t = DIFFUSE, Vector3f e = Vector3f(0, 0, 0));
-    inline MaterialType getType();
-    // inline Vector3f getColor();
-    inline Vector3f getColorAt(double u, double v);
-    inline Vector3f getEmission();
-    inline bool hasEmission();
+    // Schlick近似的菲涅尔项，F0为法向入射时的反射率
+    inline Vector3f fresnelSchlick(const Vector3f &F0, float cosTheta)
+    {
+        float m = clamp(0, 1, 1 - cosTheta);
+        float m5 = (m * m) * (m * m) * m;
+        return F0 + (Vector3f(1.0f) - F0) * m5;
+    }
 
-    // sample a ray by Material properties
-    inline Vector3f sample(const Vector3f &wi, const Vector3f &N);
-    // given a ray, calculate the PdF of this ray
-    inline float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
-    // given a ray, calculate the contribution of this ray
-    inline Vector3f eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
-};
+    // GGX（Trowbridge-Reitz）各向同性微表面分布，向量均在局部坐标系（z轴为法线）中
+    namespace ggx
+    {
+        // 法线分布函数D(h)
+        inline float D(const Vector3f &h, float alpha)
+        {
+            if (h.z <= 0)
+                return 0;
+            float a2 = alpha * alpha;
+            float d = h.z * h.z * (a2 - 1) + 1;
+            return a2 / (M_PI * d * d);
+        }
 
-Material::Material(MaterialType t, Vector3f e)
-{
-    m_type = t;
-    // m_color = c;
-    m_emission = e;
-}
+        // Smith遮蔽函数的Lambda(w)
+        inline float Lambda(const Vector3f &w, float alpha)
+        {
+            float cos2 = w.z * w.z;
+            if (cos2 <= 0)
+                return 0;
+            float tan2 = std::max(0.0f, 1 - cos2) / cos2;
+            return 0.5f * (std::sqrt(1 + alpha * alpha * tan2) - 1);
+        }
 
-MaterialType Material::getType() { return m_type; }
-/// Vector3f Material::getColor(){return m_color;}
-Vector3f Material::getEmission() { return m_emission; }
-bool Material::hasEmission()
-{
-    if (m_emission.norm() > EPSILON)
-        return true;
-    else
-        return false;
-}
+        inline float G1(const Vector3f &w, float alpha) { return 1 / (1 + Lambda(w, alpha)); }
 
-Vector3f Material::getColorAt(double u, double v)
-{
-    return Vector3f();
+        // 高度相关的遮蔽-阴影函数G2
+        inline float G2(const Vector3f &v, const Vector3f &l, float alpha)
+        {
+            return 1 / (1 + Lambda(v, alpha) + Lambda(l, alpha));
+        }
+
+        /**
+         * @brief 按可见法线分布D_v(h) = G1(v) max(0, v·h) D(h) / v.z 采样半程向量（Heitz 2018），
+         *        要求v.z > 0
+         */
+        inline Vector3f sampleVisibleNormal(const Vector3f &v, float alpha, float u1, float u2)
+        {
+            // 拉伸到alpha = 1的半球
+            Vector3f Vh = Vector3f(alpha * v.x, alpha * v.y, v.z).normalized();
+            float lensq = Vh.x * Vh.x + Vh.y * Vh.y;
+            Vector3f T1 = lensq > 0 ? Vector3f(-Vh.y, Vh.x, 0) * fastmath::rsqrt(lensq) : Vector3f(1, 0, 0);
+            Vector3f T2 = crossProduct(Vh, T1);
+            // 在投影圆盘上采样，按可见部分调整
+            float r = std::sqrt(u1), phi = 2 * M_PI * u2;
+            float sinPhi, cosPhi;
+            fastmath::sincos(phi, sinPhi, cosPhi);
+            float t1 = r * cosPhi, t2 = r * sinPhi;
+            float s = 0.5f * (1 + Vh.z);
+            t2 = (1 - s) * std::sqrt(std::max(0.0f, 1 - t1 * t1)) + s * t2;
+            Vector3f Nh = t1 * T1 + t2 * T2 + std::sqrt(std::max(0.0f, 1 - t1 * t1 - t2 * t2)) * Vh;
+            // 压缩回原来的椭球
+            return Vector3f(alpha * Nh.x, alpha * Nh.y, std::max(0.0f, Nh.z)).normalized();
+        }
+
+        // 反射方向l的pdf：D_v(h) / (4 v·h) = G1(v) D(h) / (4 v.z)
+        inline float pdf(const Vector3f &v, const Vector3f &h, float alpha)
+        {
+            if (v.z <= 0)
+                return 0;
+            return G1(v, alpha) * D(h, alpha) / (4 * v.z);
+        }
+    }
 }
 
-// 采样反射方向
-Vector3f Material::sample(const Vector3f &wi, const Vector3f &N)
+// 漫反射：半球面均匀采样
+template <>
+struct BSDF<DIFFUSE>
 {
-    switch (m_type)
-    {
-    case DIFFUSE:// 随机采样
+    static constexpr uint32_t flags = 0;
+    Vector3f Kd;
+
+    explicit BSDF(const Material &m) : Kd(m.Kd) {}
+
+    void setAlbedo(const Vector3f &albedo) { Kd = albedo; }
+
+    // 采样反射方向（随机采样）
+    Vector3f sample(const Vector3f &, const Vector3f &N) const
     {
         // uniform sample on the hemisphere
         float x_1 = get_random_float(), x_2 = get_random_float();
         float z = std::fabs(1.0f - 2.0f * x_1);
         float r = std::sqrt(1.0f - z * z), phi = 2 * M_PI * x_2;
-        Vector3f localRay(r * std::cos(phi), r * std::sin(phi), z);
-        return toWorld(localRay, N);
-        break;
+        float sinPhi, cosPhi;
+        fastmath::sincos(phi, sinPhi, cosPhi);
+        Vector3f localRay(r * cosPhi, r * sinPhi, z);
+        return bsdf::toWorld(localRay, N);
     }
-    case GLOSSY:// 反射方向追寻反射定律
+
+    // 半球面立体角为2 * PI，因此概率密度函数为1 / (2 * PI)
+    float pdf(const Vector3f &, const Vector3f &wo, const Vector3f &N) const
     {
-        Vector3f localRay = reflect(wi, N);
-        return localRay;
-        break;
+        // uniform sample probability 1 / (2 * PI)
+        return dotProduct(wo, N) > 0.0f ? 0.5f / M_PI : 0.0f;
     }
-    default:
-        break;
+
+    Vector3f eval(const Vector3f &, const Vector3f &wo, const Vector3f &N) const
+    {
+        // calculate the contribution of diffuse   model
+        return dotProduct(N, wo) > 0.0f ? Kd / M_PI : Vector3f(0.0f);
     }
-    return Vector3f();
-}
+};
 
-// 计算概率密度函数
-float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N)
+// 理想镜面：反射方向遵循反射定律，按菲涅尔项衰减
+template <>
+struct BSDF<GLOSSY>
 {
-    switch (m_type)
-    {
-    case DIFFUSE: // 半球面立体角为2 * PI，因此概率密度函数为1 / (2 * PI)
+    static constexpr uint32_t flags = MATERIAL_DELTA;
+    float ior;
+
+    explicit BSDF(const Material &m) : ior(m.ior) {}
+
+    Vector3f sample(const Vector3f &wi, const Vector3f &N) const
     {
-        // uniform sample probability 1 / (2 * PI)
-        if (dotProduct(wo, N) > 0.0f)
-            return 0.5f / M_PI;
-        else
-            return 0.0f;
-        break;
+        return bsdf::reflect(wi, N);
     }
-    case GLOSSY:
+
+    float pdf(const Vector3f &, const Vector3f &wo, const Vector3f &N) const
     {
-        if (dotProduct(wo, N) > EPSILON)
-            return 1.0f;
-        else
-            return 0.0f;
-        break;
+        return dotProduct(wo, N) > EPSILON ? 1.0f : 0.0f;
     }
-    default:
-        break;
+
+    Vector3f eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) const
+    {
+        float cosalpha = dotProduct(N, wo);
+        if (cosalpha <= EPSILON)
+            return Vector3f(0.0f);
+        float kr;
+        bsdf::fresnel(wi, N, ior, kr); // 菲尼尔项
+        return Vector3f(kr / cosalpha);
     }
-    return 0.0f;
-}
+};
 
-// 计算BRDF
-Vector3f Material::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N)
+/**
+ * @brief GGX微表面材质：Ks为镜面反射的F0（金属取其颜色，塑料约0.04），按Schlick近似计算菲涅尔项；
+ *        Kd非零时叠加一层漫反射（塑料），按(1 - F0)衰减。镜面波瓣按可见法线分布采样，
+ *        漫反射波瓣按余弦分布采样，两者按反照率选择，pdf为二者的混合
+ */
+template <>
+struct BSDF<MICROFACET>
 {
-    switch (m_type)
+    static constexpr uint32_t flags = 0;
+    Vector3f Kd, Ks;
+    float alpha;
+    float specularWeight; // 采样镜面波瓣的概率
+
+    explicit BSDF(const Material &m)
+        : Kd(m.Kd * (Vector3f(1.0f) - m.Ks)), Ks(m.Ks), alpha(std::max(1e-3f, m.roughness * m.roughness))
     {
-    case DIFFUSE:
+        float s = std::max(Ks.x, std::max(Ks.y, Ks.z)), d = std::max(Kd.x, std::max(Kd.y, Kd.z));
+        specularWeight = s + d > 0 ? s / (s + d) : 1;
+    }
+
+    // 纹理只替换漫反射层，波瓣选择概率保持不变
+    void setAlbedo(const Vector3f &albedo) { Kd = albedo * (Vector3f(1.0f) - Ks); }
+
+    Vector3f sample(const Vector3f &wi, const Vector3f &N) const
     {
-        // calculate the contribution of diffuse   model
-        float cosalpha = dotProduct(N, wo);
-        if (cosalpha > 0.0f)
+        Vector3f v = bsdf::toLocal(-wi, N);
+        float u1 = get_random_float(), u2 = get_random_float();
+        if (get_random_float() < specularWeight)
         {
-            Vector3f diffuse = Kd / M_PI;
-            return diffuse;
+            if (v.z <= 0)
+                return N;
+            Vector3f h = bsdf::ggx::sampleVisibleNormal(v, alpha, u1, u2);
+            return bsdf::toWorld(2 * dotProduct(v, h) * h - v, N);
         }
-        else
+        // 余弦加权采样
+        float r = std::sqrt(u1), phi = 2 * M_PI * u2;
+        float sinPhi, cosPhi;
+        fastmath::sincos(phi, sinPhi, cosPhi);
+        return bsdf::toWorld(Vector3f(r * cosPhi, r * sinPhi, std::sqrt(std::max(0.0f, 1 - u1))), N);
+    }
+
+    float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) const
+    {
+        Vector3f v = bsdf::toLocal(-wi, N), l = bsdf::toLocal(wo, N);
+        if (l.z <= 0)
+            return 0;
+        float pdf = (1 - specularWeight) * l.z / M_PI;
+        Vector3f h = v + l;
+        if (v.z > 0 && dotProduct(h, h) > 0)
+            pdf += specularWeight * bsdf::ggx::pdf(v, h.normalized(), alpha);
+        return pdf;
+    }
+
+    Vector3f eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) const
+    {
+        Vector3f v = bsdf::toLocal(-wi, N), l = bsdf::toLocal(wo, N);
+        if (l.z <= 0 || v.z <= 0)
             return Vector3f(0.0f);
-        break;
+        Vector3f h = (v + l).normalized();
+        Vector3f F = bsdf::fresnelSchlick(Ks, dotProduct(v, h));
+        float specular = bsdf::ggx::D(h, alpha) * bsdf::ggx::G2(v, l, alpha) / (4 * v.z * l.z);
+        return Kd / M_PI + F * specular;
     }
-    case GLOSSY:
+};
+
+/**
+ * @brief 按类型分开存放的材质核函数表：每种材质类型的BSDF<T>连续存放，
+ *        commit后各Material指向表中自己的核函数，并重新计算标志。
+ *        材质参数修改后需重新commit（Scene::buildBVH时自动提交）
+ */
+template <MaterialType... Ts>
+class MaterialTableOf<MaterialTypeList<Ts...>>
+{
+public:
+    void add(Material *material)
     {
-        float cosalpha = dotProduct(N, wo);
-        float kr;
-        if (cosalpha > EPSILON)
+        material->m_id = materials.size();
+        materials.push_back(material);
+    }
+
+    void commit()
+    {
+        (std::get<std::vector<BSDF<Ts>>>(kernels).clear(), ...);
+        // 按材质的当前参数重新构造核函数（已提交的材质的dispatch会取旧核函数，且旧表已被清空）
+        for (Material *m : materials)
+            m->m_kernel = nullptr;
+        for (Material *m : materials)
+            m->dispatch([&](const auto &kernel)
+                        { std::get<std::vector<std::decay_t<decltype(kernel)>>>(kernels).push_back(kernel); });
+        // 全部插入后再取地址，避免vector扩容使指针失效
+        size_t next[sizeof...(Ts)] = {};
+        for (Material *m : materials)
         {
-            fresnel(wi, N, ior, kr); // 菲尼尔项
-            Vector3f mirror = 1 / cosalpha;
-            return kr * mirror;
+            size_t i = 0;
+            ((m->m_type == Ts ? (m->m_kernel = &std::get<std::vector<BSDF<Ts>>>(kernels)[next[i]++], 0) : 0, ++i), ...);
+            m->m_flags = m->computeFlags();
         }
-        else
-            return Vector3f(0.0f);
-        break;
     }
-    default:
-        break;
-    }
-    return Vector3f();
-}
\ No newline at end of file
+
+    size_t size() const { return materials.size(); }
+    Material *get(uint32_t id) const { return materials[id]; }
+
+private:
+    std::vector<Material *> materials;
+    std::tuple<std::vector<BSDF<Ts>>...> kernels;
+};
+
+// 未指定材质时使用的共享默认材质
+inline Material *defaultMaterial()
+{
+    static Material material;
+    return &material;
+}
+
+Material::Material(MaterialType t, Vector3f e)
+{
+    m_type = t;
+    // m_color = c;
+    m_emission = e;
+    m_flags = computeFlags();
+}
+
+uint32_t Material::computeFlags() const
+{
+    uint32_t flags = typeFlags(MaterialTypes());
+    if (m_emission.norm() > EPSILON)
+        flags |= MATERIAL_EMISSIVE;
+    if (twoSided)
+        flags |= MATERIAL_TWO_SIDED;
+    if (diffuseTexture != nullptr && diffuseTexture->valid())
+        flags |= MATERIAL_TEXTURED;
+    return flags;
+}
+
+MaterialType Material::getType() const { return m_type; }
+/// Vector3f Material::getColor(){return m_color;}
+Vector3f Material::getEmission() const { return m_emission; }
+bool Material::hasEmission() const { return m_flags & MATERIAL_EMISSIVE; }
+
+// 纹理坐标(u, v)处的反照率，footprint为纹理空间中的足迹宽度；无纹理时为Kd
+Vector3f Material::getColorAt(double u, double v, float footprint) const
+{
+    if (diffuseTexture == nullptr || !diffuseTexture->valid())
+        return Kd;
+    return diffuseTexture->sample(u, v, footprint);
+}
+
+// 采样反射方向
+Vector3f Material::sample(const Vector3f &wi, const Vector3f &N) const
+{
+    return dispatch([&](const auto &bsdf) { return bsdf.sample(wi, N); });
+}
+
+// 计算概率密度函数
+float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) const
+{
+    return dispatch([&](const auto &bsdf) { return bsdf.pdf(wi, wo, N); });
+}
+
+// 计算BRDF
+Vector3f Material::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N) const
+{
+    return dispatch([&](const auto &bsdf) { return bsdf.eval(wi, wo, N); });
+}
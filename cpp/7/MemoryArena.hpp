@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief 单调内存池：按块分配、只增不减，析构时一次性释放全部内存。
+ * 非平凡析构的对象会登记析构函数，析构时按创建的逆序调用。非线程安全
+ */
+class MemoryArena
+{
+public:
+    explicit MemoryArena(size_t blockSize = 256 * 1024) : blockSize(blockSize) {}
+    ~MemoryArena() { Reset(); }
+    MemoryArena(const MemoryArena &) = delete;
+    MemoryArena &operator=(const MemoryArena &) = delete;
+
+    void *Alloc(size_t size, size_t align = alignof(std::max_align_t));
+
+    template <typename T, typename... Args>
+    T *Create(Args &&...args)
+    {
+        T *obj = new (Alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value)
+            destructors.emplace_back([](void *p) { static_cast<T *>(p)->~T(); }, obj);
+        return obj;
+    }
+
+    // 分配n个默认构造的T（要求平凡析构）
+    template <typename T>
+    T *CreateArray(size_t n)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "CreateArray requires trivially destructible types");
+        T *arr = static_cast<T *>(Alloc(sizeof(T) * n, alignof(T)));
+        for (size_t i = 0; i < n; ++i)
+            new (&arr[i]) T();
+        return arr;
+    }
+
+    // 调用所有登记的析构函数并释放全部内存块
+    void Reset();
+
+    size_t TotalAllocated() const { return totalAllocated; }
+
+private:
+    struct Block
+    {
+        char *ptr;
+        size_t size;
+    };
+
+    const size_t blockSize;
+    char *current = nullptr;
+    size_t currentOffset = 0, currentSize = 0;
+    size_t totalAllocated = 0;
+    std::vector<Block> blocks;
+    std::vector<std::pair<void (*)(void *), void *>> destructors;
+};
+
+inline void *MemoryArena::Alloc(size_t size, size_t align)
+{
+    auto alignedOffset = [align](char *base, size_t offset)
+    {
+        uintptr_t p = (uintptr_t)base + offset;
+        return (size_t)(((p + align - 1) & ~(uintptr_t)(align - 1)) - (uintptr_t)base);
+    };
+
+    size_t offset = current == nullptr ? 0 : alignedOffset(current, currentOffset);
+    if (current == nullptr || offset + size > currentSize)
+    {
+        // 大于块大小的请求单独成块
+        size_t newSize = std::max(size + align, blockSize);
+        char *ptr = static_cast<char *>(std::malloc(newSize));
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        blocks.push_back({ptr, newSize});
+        totalAllocated += newSize;
+        current = ptr;
+        currentSize = newSize;
+        offset = alignedOffset(current, 0);
+    }
+    currentOffset = offset + size;
+    return current + offset;
+}
+
+inline void MemoryArena::Reset()
+{
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+        it->first(it->second);
+    destructors.clear();
+    for (auto &block : blocks)
+        std::free(block.ptr);
+    blocks.clear();
+    current = nullptr;
+    currentOffset = currentSize = 0;
+    totalAllocated = 0;
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "BVH.hpp"
+#include "MappedFile.hpp"
+#include "Vector.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * \brief 网格与BVH的二进制缓存：保存变换后的三角形顶点与展开后的BVH，加载时通过mmap映射，
+ * 跳过OBJ解析与BVH构建。缓存键覆盖OBJ文件内容、变换参数、BVH构建参数以及缓存格式版本
+ */
+namespace MeshCache
+{
+    // 缓存格式版本，修改文件布局或构建算法时递增
+    const uint32_t version = 4;
+
+    inline bool enabled = true;
+    inline std::string directory = "./cache";
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t numTriangles;
+        uint64_t key;
+        uint32_t numReferences;
+        uint32_t numNodes;
+        float area;
+        float pMin[3], pMax[3];
+    };
+
+    /**
+     * \brief 缓存文件中的一项：头部之后依次为numTriangles*9个float顶点坐标、numTriangles*6个float纹理坐标、numReferences个三角形下标
+     * （BVH重排后的图元顺序，SBVH中同一三角形可出现多次）与numNodes个LinearBVHNode
+     */
+    struct Entry
+    {
+        MappedFile file;
+        const Header *header = nullptr;
+        const float *vertices = nullptr;
+        const float *texcoords = nullptr;
+        const uint32_t *references = nullptr;
+        const LinearBVHNode *nodes = nullptr;
+    };
+
+    // FNV-1a 64位哈希
+    inline uint64_t hash(const void *data, size_t size, uint64_t h = 14695981039346656037ull)
+    {
+        const unsigned char *p = (const unsigned char *)data;
+        for (size_t i = 0; i < size; ++i)
+        {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    /**
+     * @brief 计算缓存键
+     * @return 缓存键，OBJ文件无法读取时返回0
+     */
+    inline uint64_t key(const std::string &filename, const Vector3f &trans, const Vector3f &scale,
+                        int maxPrimsInNode, BVHAccel::SplitMethod splitMethod)
+    {
+        MappedFile obj;
+        if (!obj.open(filename))
+            return 0;
+        uint64_t h = hash(&version, sizeof(version));
+        h = hash(obj.data(), obj.size(), h);
+        float transform[6] = {trans.x, trans.y, trans.z, scale.x, scale.y, scale.z};
+        h = hash(transform, sizeof(transform), h);
+        // LBVH是否做treelet优化会改变树结构，一并计入
+        int32_t settings[3] = {maxPrimsInNode, (int32_t)splitMethod,
+                               splitMethod == BVHAccel::SplitMethod::LBVH && BVHAccel::refineLBVH};
+        h = hash(settings, sizeof(settings), h);
+        if (splitMethod == BVHAccel::SplitMethod::SBVH)
+        {
+            float sbvh[2] = {BVHAccel::sbvhDuplicationBudget, BVHAccel::sbvhAlpha};
+            h = hash(sbvh, sizeof(sbvh), h);
+        }
+        return h == 0 ? 1 : h;
+    }
+
+    inline std::string path(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bvh", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+
+    /**
+     * @brief 校验线性BVH节点数组：节点须按flatten()的深度优先先序存放（左子节点紧随父节点，右子节点下标在范围内
+     * 且恰好是左子树之后的位置），叶节点引用的图元范围不超出numReferences
+     */
+    inline bool validNodes(const LinearBVHNode *nodes, uint32_t numNodes, uint32_t numReferences)
+    {
+        if ((numNodes == 0) != (numReferences == 0))
+            return false;
+        std::vector<uint32_t> stack;
+        if (numNodes > 0)
+            stack.push_back(0);
+        uint32_t visited = 0;
+        while (!stack.empty())
+        {
+            uint32_t index = stack.back();
+            stack.pop_back();
+            // 先序遍历访问节点的顺序必须与存放顺序一致
+            if (index != visited++ || index >= numNodes)
+                return false;
+            const LinearBVHNode &node = nodes[index];
+            if (node.nPrimitives > 0)
+            {
+                if (node.offset < 0 || (uint64_t)node.offset + node.nPrimitives > numReferences)
+                    return false;
+            }
+            else
+            {
+                if (node.offset <= (int64_t)index + 1 || (uint32_t)node.offset >= numNodes || node.axis > 2)
+                    return false;
+                stack.push_back(node.offset);
+                stack.push_back(index + 1);
+            }
+        }
+        return visited == numNodes;
+    }
+
+    /**
+     * @brief 打开并校验缓存文件，魔数、版本、缓存键、长度、三角形下标或BVH节点不符时视为未命中（调用者重新构建并覆盖）
+     */
+    inline bool open(uint64_t key, Entry &entry)
+    {
+        if (!entry.file.open(path(key)))
+            return false;
+        const char *data = entry.file.data();
+        size_t size = entry.file.size();
+        if (size < sizeof(Header))
+            return false;
+        const Header *header = (const Header *)data;
+        if (memcmp(header->magic, "GMSHBVH", 8) != 0 || header->version != version || header->key != key)
+            return false;
+        size_t verticesSize = sizeof(float) * 9 * (size_t)header->numTriangles;
+        size_t texcoordsSize = sizeof(float) * 6 * (size_t)header->numTriangles;
+        size_t referencesSize = sizeof(uint32_t) * (size_t)header->numReferences;
+        size_t expected = sizeof(Header) + verticesSize + texcoordsSize + referencesSize +
+                          sizeof(LinearBVHNode) * (size_t)header->numNodes;
+        if (size != expected)
+            return false;
+        entry.header = header;
+        entry.vertices = (const float *)(data + sizeof(Header));
+        entry.texcoords = (const float *)(data + sizeof(Header) + verticesSize);
+        entry.references = (const uint32_t *)(data + sizeof(Header) + verticesSize + texcoordsSize);
+        entry.nodes = (const LinearBVHNode *)(data + sizeof(Header) + verticesSize + texcoordsSize + referencesSize);
+        for (uint32_t i = 0; i < header->numReferences; ++i)
+            if (entry.references[i] >= header->numTriangles)
+                return false;
+        return validNodes(entry.nodes, header->numNodes, header->numReferences);
+    }
+
+    /**
+     * @brief 写入缓存文件；先写临时文件再重命名，多个进程并发写同一缓存时读者不会看到不完整的文件
+     * @param vertices   变换后的三角形顶点，每个三角形3个顶点
+     * @param texcoords  与vertices对应的纹理坐标（取x、y）
+     * @param references BVH重排后各图元引用对应的三角形下标
+     */
+    inline bool save(uint64_t key, const std::vector<Vector3f> &vertices, const std::vector<Vector3f> &texcoords,
+                     const std::vector<uint32_t> &references,
+                     const std::vector<LinearBVHNode> &nodes, const Bounds3 &bounds, float area)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+
+        Header header{};
+        memcpy(header.magic, "GMSHBVH", 8);
+        header.version = version;
+        header.numTriangles = vertices.size() / 3;
+        header.key = key;
+        header.numReferences = references.size();
+        header.numNodes = nodes.size();
+        header.area = area;
+        for (int i = 0; i < 3; ++i)
+        {
+            header.pMin[i] = bounds.pMin[i];
+            header.pMax[i] = bounds.pMax[i];
+        }
+
+        std::vector<float> coords;
+        coords.reserve(vertices.size() * 3);
+        for (auto &v : vertices)
+        {
+            coords.push_back(v.x);
+            coords.push_back(v.y);
+            coords.push_back(v.z);
+        }
+
+        std::string target = path(key);
+        std::string tmp = target + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+        FILE *fp = fopen(tmp.c_str(), "wb");
+        if (fp == nullptr)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+        ok = ok && fwrite(coords.data(), sizeof(float), coords.size(), fp) == coords.size();
+        std::vector<float> uvs;
+        uvs.reserve(texcoords.size() * 2);
+        for (auto &t : texcoords)
+        {
+            uvs.push_back(t.x);
+            uvs.push_back(t.y);
+        }
+        ok = ok && fwrite(uvs.data(), sizeof(float), uvs.size(), fp) == uvs.size();
+        ok = ok && fwrite(references.data(), sizeof(uint32_t), references.size(), fp) == references.size();
+        ok = ok && fwrite(nodes.data(), sizeof(LinearBVHNode), nodes.size(), fp) == nodes.size();
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        std::filesystem::rename(tmp, target, ec);
+        if (ec)
+        {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+}
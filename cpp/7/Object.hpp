@@ -8,6 +8,9 @@
 #include "Bounds3.hpp"
 #include "Ray.hpp"
 #include "Intersection.hpp"
+#include "LightBounds.hpp"
+
+#include <vector>
 
 class Object
 {
@@ -20,7 +23,23 @@ public:
     virtual void getSurfaceProperties(const Vector3f &, const Vector3f &, const uint32_t &, const Vector2f &, Vector3f &, Vector2f &) const = 0;
     virtual Vector3f evalDiffuseColor(const Vector2f &) const = 0;
     virtual Bounds3 getBounds() = 0;
+    // 裁剪到box内的部分的包围盒，供SBVH空间划分使用；默认与包围盒直接求交，子类可给出更紧的结果
+    virtual Bounds3 getClippedBounds(const Bounds3 &box) { return Overlap(getBounds(), box); }
     virtual float getArea() = 0;
     virtual void Sample(Intersection &pos, float &pdf) = 0;
     virtual bool hasEmit() = 0;
+    // 参与光源采样的自发光图元，默认为物体自身，网格展开为各个三角形
+    virtual void collectEmitters(std::vector<Object *> &emitters)
+    {
+        if (hasEmit())
+            emitters.push_back(this);
+    }
+    // 作为光源时的包围信息；默认不知道朝向，视为向所有方向发光，功率按表面一点的自发光估计
+    virtual LightBounds getLightBounds()
+    {
+        Intersection pos;
+        float pdf;
+        Sample(pos, pdf);
+        return LightBounds(getBounds(), Vector3f(0, 0, 1), luminance(pos.emit) * getArea() * M_PI, -1, 0, false);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,367 @@
+#pragma once
+
+#include "BVH.hpp"
+#include "MappedFile.hpp"
+#include "Object.hpp"
+#include "Stats.hpp"
+#include "Triangle.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+/**
+ * \brief 分页网格：预处理好的三角形与BVH保存在分页文件中，渲染时通过mmap直接遍历，
+ * 三角形数据由操作系统按需换入，不在内存中展开为Triangle与BVHBuildNode。
+ *
+ * 文件布局：头部、numNodes个LinearBVHNode，之后从页边界开始为numTriangles个三角形（每个9个float），
+ * 按BVH叶节点顺序存放，叶节点以offset直接引用三角形区中的连续范围，空间上相邻的三角形落在相同的页中。
+ * 超过residentBudget时用madvise丢弃三角形区的页，换出的页在下次访问时重新从文件换入
+ */
+class PagedMesh : public Object
+{
+public:
+    // 每个分页网格映射区常驻内存的上限（字节），0表示不限制
+    static inline size_t residentBudget = 0;
+    // 每个线程每隔多少次求交检查一次常驻内存
+    static inline int residentCheckInterval = 1 << 16;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t numTriangles;
+        uint32_t numNodes;
+        uint32_t trianglesOffset; // 三角形区在文件中的偏移，按pageAlignment对齐
+        uint64_t source;          // 生成该文件的网格的缓存键（MeshCache::key，覆盖OBJ内容、变换与BVH参数），0表示未知
+        float area;
+        float pMin[3], pMax[3];
+    };
+    static const uint32_t version = 2;
+    static const uint32_t pageAlignment = 4096;
+
+    // 进程自启动以来的缺页次数（getrusage）
+    struct PageFaults
+    {
+        long minor = 0; // 页已在页缓存中，只需建立映射
+        long major = 0; // 需要从磁盘读入
+    };
+    static PageFaults pageFaults();
+
+    /**
+     * @brief 把已构建BVH的网格写为分页文件，SBVH复制的三角形引用各写一份
+     * @param source 源网格的缓存键，记录在头部供current校验
+     */
+    static bool write(const MeshTriangle &mesh, const std::string &path, uint64_t source = 0);
+
+    // 分页文件存在、格式版本与长度正确且由缓存键为source的网格生成时返回true，否则应重新生成
+    static bool current(const std::string &path, uint64_t source);
+
+    PagedMesh(const std::string &path, Material *mt = defaultMaterial());
+
+    PagedMesh(const PagedMesh &) = delete;
+    PagedMesh &operator=(const PagedMesh &) = delete;
+
+    bool valid() const { return header != nullptr; }
+    // 当前常驻内存（页缓存中）的映射字节数（mincore）
+    size_t residentBytes() const;
+    // 常驻内存超出预算后丢弃页的次数
+    int trimCount() const { return trims; }
+
+    bool intersect(const Ray &) { return true; }
+    bool intersect(const Ray &, float &, uint32_t &) const { return false; }
+    Intersection getIntersection(Ray ray);
+    void getSurfaceProperties(const Vector3f &, const Vector3f &, const uint32_t &, const Vector2f &,
+                              Vector3f &, Vector2f &) const {}
+    Vector3f evalDiffuseColor(const Vector2f &) const { return Vector3f(0.5, 0.5, 0.5); }
+    Bounds3 getBounds() { return bounding_box; }
+    float getArea() { return area; }
+    void Sample(Intersection &pos, float &pdf);
+    bool hasEmit() { return m->hasEmission(); }
+
+    Bounds3 bounding_box;
+    float area = 0;
+    Material *m;
+
+private:
+    void trimResidentSet();
+    // 校验映射文件的头部，合法时返回头部，否则返回nullptr
+    static const Header *validate(const MappedFile &file);
+    // 三角形区中第i个三角形的面积，与Triangle的构造函数算法相同
+    float triangleArea(size_t i) const;
+
+    MappedFile file;
+    const Header *header = nullptr;
+    const LinearBVHNode *nodes = nullptr;
+    const float *triangles = nullptr;
+    std::mutex trimMutex;
+    std::atomic<int> trims{0};
+};
+
+inline PagedMesh::PageFaults PagedMesh::pageFaults()
+{
+    PageFaults faults;
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        faults.minor = usage.ru_minflt;
+        faults.major = usage.ru_majflt;
+    }
+#endif
+    return faults;
+}
+
+inline bool PagedMesh::write(const MeshTriangle &mesh, const std::string &path, uint64_t source)
+{
+    std::vector<LinearBVHNode> nodes = mesh.bvh->flatten();
+    const std::vector<Object *> &prims = mesh.bvh->primitives;
+
+    Header header{};
+    memcpy(header.magic, "GMSHPAGE", 8);
+    header.version = version;
+    header.numTriangles = prims.size();
+    header.numNodes = nodes.size();
+    size_t end = sizeof(Header) + sizeof(LinearBVHNode) * nodes.size();
+    header.trianglesOffset = (end + pageAlignment - 1) / pageAlignment * pageAlignment;
+    header.source = source;
+    header.area = mesh.area;
+    for (int i = 0; i < 3; ++i)
+    {
+        header.pMin[i] = mesh.bounding_box.pMin[i];
+        header.pMax[i] = mesh.bounding_box.pMax[i];
+    }
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(nodes.data(), sizeof(LinearBVHNode), nodes.size(), fp) == nodes.size();
+    std::vector<char> padding(header.trianglesOffset - end, 0);
+    ok = ok && fwrite(padding.data(), 1, padding.size(), fp) == padding.size();
+    for (size_t i = 0; i < prims.size() && ok; ++i)
+    {
+        const Triangle *tri = static_cast<const Triangle *>(prims[i]);
+        float v[9] = {tri->v0.x, tri->v0.y, tri->v0.z, tri->v1.x, tri->v1.y, tri->v1.z, tri->v2.x, tri->v2.y, tri->v2.z};
+        ok = fwrite(v, sizeof(float), 9, fp) == 9;
+    }
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok)
+        std::remove(path.c_str());
+    return ok;
+}
+
+inline const PagedMesh::Header *PagedMesh::validate(const MappedFile &file)
+{
+    if (file.size() < sizeof(Header))
+        return nullptr;
+    const Header *h = (const Header *)file.data();
+    size_t nodesEnd = sizeof(Header) + sizeof(LinearBVHNode) * (size_t)h->numNodes;
+    if (memcmp(h->magic, "GMSHPAGE", 8) != 0 || h->version != version || h->numNodes == 0 ||
+        h->trianglesOffset < nodesEnd ||
+        file.size() != h->trianglesOffset + sizeof(float) * 9 * (size_t)h->numTriangles)
+        return nullptr;
+    return h;
+}
+
+inline bool PagedMesh::current(const std::string &path, uint64_t source)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    const Header *h = validate(file);
+    return h != nullptr && h->source == source;
+}
+
+inline PagedMesh::PagedMesh(const std::string &path, Material *mt) : m(mt)
+{
+    if (!file.open(path))
+    {
+        std::cerr << "Cannot open paged mesh " << path << "\n";
+        return;
+    }
+    const Header *h = validate(file);
+    if (h == nullptr)
+    {
+        std::cerr << "Invalid paged mesh " << path << "\n";
+        return;
+    }
+    header = h;
+    nodes = (const LinearBVHNode *)(file.data() + sizeof(Header));
+    triangles = (const float *)(file.data() + h->trianglesOffset);
+    area = h->area;
+    bounding_box = Bounds3(Vector3f(h->pMin[0], h->pMin[1], h->pMin[2]), Vector3f(h->pMax[0], h->pMax[1], h->pMax[2]));
+}
+
+inline Intersection PagedMesh::getIntersection(Ray ray)
+{
+    Intersection isect;
+    if (!header)
+        return isect;
+
+    thread_local int sinceCheck = 0;
+    if (residentBudget > 0 && ++sinceCheck >= residentCheckInterval)
+    {
+        sinceCheck = 0;
+        trimResidentSet();
+    }
+
+    // 按划分轴先访问近侧子节点，已有交点更近时跳过整个节点，尽量少触及三角形页
+    const float origin[3] = {ray.origin.x, ray.origin.y, ray.origin.z};
+    const float invDir[3] = {ray.direction_inv.x, ray.direction_inv.y, ray.direction_inv.z};
+    const bool dirIsNeg[3] = {ray.direction.x < 0, ray.direction.y < 0, ray.direction.z < 0};
+    float tMax = std::numeric_limits<float>::infinity();
+    int stack[128], stackSize = 0, index = 0;
+    while (true)
+    {
+        const LinearBVHNode &node = nodes[index];
+        STAT_INC(nodesVisited);
+        STAT_INC(boxTests);
+        float tEnter = -std::numeric_limits<float>::infinity(), tExit = tMax;
+        for (int i = 0; i < 3; ++i)
+        {
+            float t0 = (node.pMin[i] - origin[i]) * invDir[i];
+            float t1 = (node.pMax[i] - origin[i]) * invDir[i];
+            if (dirIsNeg[i])
+                std::swap(t0, t1);
+            tEnter = std::max(tEnter, t0);
+            tExit = std::min(tExit, t1);
+        }
+        if (tEnter <= tExit && tExit >= 0)
+        {
+            if (node.nPrimitives > 0)
+            {
+                for (int i = 0; i < node.nPrimitives; ++i)
+                {
+                    const float *v = triangles + 9 * (size_t)(node.offset + i);
+                    Triangle tri(Vector3f(v[0], v[1], v[2]), Vector3f(v[3], v[4], v[5]), Vector3f(v[6], v[7], v[8]), m);
+                    Intersection hit = tri.getIntersection(ray);
+                    if (hit.happened && hit.distance < isect.distance)
+                    {
+                        isect = hit;
+                        tMax = hit.distance;
+                    }
+                }
+            }
+            else if (dirIsNeg[node.axis])
+            {
+                assert(stackSize < 128);
+                stack[stackSize++] = index + 1;
+                index = node.offset;
+                continue;
+            }
+            else
+            {
+                assert(stackSize < 128);
+                stack[stackSize++] = node.offset;
+                index = index + 1;
+                continue;
+            }
+        }
+        if (stackSize == 0)
+            break;
+        index = stack[--stackSize];
+    }
+    // 临时Triangle在栈上，交点改为指向网格本身
+    if (isect.happened)
+        isect.obj = this;
+    return isect;
+}
+
+inline void PagedMesh::Sample(Intersection &pos, float &pdf)
+{
+    // 按节点面积向下选择叶节点，叶节点内按三角形面积选择
+    float p = get_random_float() * nodes[0].area;
+    int index = 0;
+    while (nodes[index].nPrimitives == 0)
+    {
+        float leftArea = nodes[index + 1].area;
+        if (p < leftArea)
+            index = index + 1;
+        else
+        {
+            p -= leftArea;
+            index = nodes[index].offset;
+        }
+    }
+    const LinearBVHNode &leaf = nodes[index];
+    float leafArea = 0;
+    for (int i = 0; i < leaf.nPrimitives; ++i)
+        leafArea += triangleArea(leaf.offset + i);
+    // SBVH复制的三角形在叶节点中的面积是均分后的，按叶节点内的实际面积重新归一化，
+    // 再按面积的累加和选出三角形，只为选中的一个构造Triangle
+    p = std::min(p / leaf.area, 1.0f) * leafArea;
+    size_t chosen = leaf.offset + leaf.nPrimitives - 1;
+    for (int i = 0; i < leaf.nPrimitives; ++i)
+    {
+        float a = triangleArea(leaf.offset + i);
+        if (p < a)
+        {
+            chosen = leaf.offset + i;
+            break;
+        }
+        p -= a;
+    }
+    const float *v = triangles + 9 * chosen;
+    Triangle(Vector3f(v[0], v[1], v[2]), Vector3f(v[3], v[4], v[5]), Vector3f(v[6], v[7], v[8]), m).Sample(pos, pdf);
+    pdf = 1.0f / area;
+    pos.emit = m->getEmission();
+}
+
+inline float PagedMesh::triangleArea(size_t i) const
+{
+    const float *v = triangles + 9 * i;
+    Vector3f v0(v[0], v[1], v[2]);
+    return crossProduct(Vector3f(v[3], v[4], v[5]) - v0, Vector3f(v[6], v[7], v[8]) - v0).norm() * 0.5f;
+}
+
+inline size_t PagedMesh::residentBytes() const
+{
+#ifdef _WIN32
+    return file.size();
+#else
+    if (!header)
+        return 0;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t pages = (file.size() + pageSize - 1) / pageSize;
+    std::vector<unsigned char> resident(pages);
+    if (mincore((void *)file.data(), file.size(), resident.data()) != 0)
+        return 0;
+    size_t count = 0;
+    for (unsigned char r : resident)
+        count += r & 1;
+    return count * pageSize;
+#endif
+}
+
+inline void PagedMesh::trimResidentSet()
+{
+#ifndef _WIN32
+    // 已有线程在检查时直接返回
+    std::unique_lock<std::mutex> lock(trimMutex, std::try_to_lock);
+    if (!lock.owns_lock() || residentBytes() <= residentBudget)
+        return;
+    // 节点区很小且每条光线都会访问，只丢弃三角形区；只读映射的页是干净的，丢弃后再次访问时从文件换入。
+    // MADV_PAGEOUT（Linux 5.4+）同时回收页缓存，mincore才会反映出来；不支持时退化为只解除映射的MADV_DONTNEED
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t begin = (header->trianglesOffset + pageSize - 1) / pageSize * pageSize;
+    if (begin >= file.size())
+        return;
+    void *start = (void *)(file.data() + begin);
+    size_t length = file.size() - begin;
+#ifdef MADV_PAGEOUT
+    if (madvise(start, length, MADV_PAGEOUT) != 0)
+#endif
+        madvise(start, length, MADV_DONTNEED);
+    ++trims;
+#endif
+}
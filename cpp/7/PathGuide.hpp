@@ -0,0 +1,309 @@
+#pragma once
+
+#include "Bounds3.hpp"
+#include "Vector.hpp"
+#include "global.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace guiding
+{
+    // 单位方向与[0, 1)²之间的等面积（柱面）映射：u = (cosθ + 1) / 2，v = φ / 2π，dω = 4π du dv
+    inline Vector2f directionToCanonical(const Vector3f &d)
+    {
+        float cosTheta = clamp(-1, 1, d.z);
+        float phi = std::atan2(d.y, d.x);
+        if (phi < 0)
+            phi += 2 * M_PI;
+        return Vector2f(std::min((cosTheta + 1) / 2, 0.99999994f), std::min(phi / (2 * (float)M_PI), 0.99999994f));
+    }
+
+    inline Vector3f canonicalToDirection(const Vector2f &p)
+    {
+        float cosTheta = 2 * p.x - 1, phi = 2 * M_PI * p.y;
+        float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta * cosTheta));
+        return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+}
+
+/**
+ * \brief 方向四叉树：把入射方向等面积映射到[0, 1)²后递归四分，每个节点记录四个象限的入射辐射通量。
+ * nodes是采样用的分布（上一轮记录的结果），recorded是本轮的记录，两者拓扑相同；
+ * 记录可在多线程中并发进行，refine在两轮之间单线程调用
+ */
+class DTree
+{
+public:
+    struct Node
+    {
+        float sum[4] = {0, 0, 0, 0};
+        uint32_t child[4] = {0, 0, 0, 0}; // 0表示该象限是叶子（根节点不会是子节点）
+    };
+
+    DTree() : nodes(1) { resetRecord(); }
+    DTree(const DTree &other) : nodes(other.nodes), total(other.total)
+    {
+        resetRecord();
+        for (size_t i = 0; i < nodes.size() * 4; ++i)
+            recorded[i].store(other.recorded[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        samples = other.samples.load(std::memory_order_relaxed);
+    }
+
+    // 是否已学到可用于采样的分布
+    bool usable() const { return total > 0; }
+    uint32_t sampleCount() const { return samples.load(std::memory_order_relaxed); }
+    size_t bytes() const { return nodes.size() * nodeBytes; }
+    static constexpr size_t nodeBytes = sizeof(Node) + 4 * sizeof(std::atomic<float>);
+
+    // 按学到的分布采样方向
+    Vector3f sample() const
+    {
+        Vector2f origin(0, 0);
+        float size = 1;
+        uint32_t index = 0;
+        while (true)
+        {
+            const Node &node = nodes[index];
+            float nodeTotal = node.sum[0] + node.sum[1] + node.sum[2] + node.sum[3];
+            int q = 3;
+            float r = get_random_float() * nodeTotal;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (r < node.sum[i])
+                {
+                    q = i;
+                    break;
+                }
+                r -= node.sum[i];
+            }
+            if (nodeTotal <= 0)
+                q = std::min(3, int(get_random_float() * 4));
+            size *= 0.5f;
+            origin = origin + Vector2f((q & 1) * size, (q >> 1) * size);
+            if (node.child[q] == 0)
+                return guiding::canonicalToDirection(origin + Vector2f(get_random_float() * size, get_random_float() * size));
+            index = node.child[q];
+        }
+    }
+
+    // 方向dir的概率密度（立体角）
+    float pdf(const Vector3f &dir) const
+    {
+        Vector2f p = guiding::directionToCanonical(dir);
+        float density = 1;
+        uint32_t index = 0;
+        while (true)
+        {
+            const Node &node = nodes[index];
+            float nodeTotal = node.sum[0] + node.sum[1] + node.sum[2] + node.sum[3];
+            if (nodeTotal <= 0)
+                break;
+            int qx = p.x >= 0.5f, qy = p.y >= 0.5f, q = qx + 2 * qy;
+            density *= 4 * node.sum[q] / nodeTotal;
+            if (node.child[q] == 0 || density == 0)
+                break;
+            p = Vector2f(2 * p.x - qx, 2 * p.y - qy);
+            index = node.child[q];
+        }
+        return density / (4 * M_PI);
+    }
+
+    // 记录沿dir入射的辐射亮度估计（已除以采样概率密度），可并发调用
+    void record(const Vector3f &dir, float value)
+    {
+        samples.fetch_add(1, std::memory_order_relaxed);
+        if (!(value > 0) || !std::isfinite(value))
+            return;
+        Vector2f p = guiding::directionToCanonical(dir);
+        uint32_t index = 0;
+        while (true)
+        {
+            int qx = p.x >= 0.5f, qy = p.y >= 0.5f, q = qx + 2 * qy;
+            atomicAdd(recorded[index * 4 + q], value);
+            if (nodes[index].child[q] == 0)
+                return;
+            p = Vector2f(2 * p.x - qx, 2 * p.y - qy);
+            index = nodes[index].child[q];
+        }
+    }
+
+    /**
+     * @brief 用本轮的记录替换采样分布，并调整拓扑：占总通量比例超过threshold的象限继续细分，
+     *        其余象限合并为叶子；节点数不超过maxNodes。本轮没有记录时保留原分布
+     */
+    void refine(float threshold, int maxDepth, size_t maxNodes)
+    {
+        float recordedTotal = 0;
+        for (int q = 0; q < 4; ++q)
+            recordedTotal += recorded[q].load(std::memory_order_relaxed);
+        if (recordedTotal > 0)
+        {
+            struct Item
+            {
+                int64_t old; // 旧拓扑中对应的节点，-1表示新细分出的节点
+                uint32_t index;
+                int depth;
+                float inherited; // 新节点的四个象限平分的通量
+            };
+            std::vector<Node> built(1);
+            std::vector<Item> stack = {{0, 0, 1, 0}};
+            while (!stack.empty())
+            {
+                Item item = stack.back();
+                stack.pop_back();
+                for (int q = 0; q < 4; ++q)
+                {
+                    float s = item.old >= 0 ? recorded[item.old * 4 + q].load(std::memory_order_relaxed) : item.inherited / 4;
+                    built[item.index].sum[q] = s;
+                    if (s > threshold * recordedTotal && item.depth < maxDepth && built.size() < maxNodes)
+                    {
+                        uint32_t child = built.size();
+                        built.emplace_back();
+                        built[item.index].child[q] = child;
+                        int64_t oldChild = item.old >= 0 && nodes[item.old].child[q] ? (int64_t)nodes[item.old].child[q] : -1;
+                        stack.push_back({oldChild, child, item.depth + 1, s});
+                    }
+                }
+            }
+            nodes = std::move(built);
+            total = recordedTotal;
+        }
+        resetRecord();
+    }
+
+    // 把记录中的通量与样本数减半（空间划分后两个子节点各继承一半）
+    void halveRecord()
+    {
+        for (size_t i = 0; i < nodes.size() * 4; ++i)
+            recorded[i].store(recorded[i].load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        samples = samples.load(std::memory_order_relaxed) / 2;
+    }
+
+private:
+    std::vector<Node> nodes;
+    float total = 0;
+    std::unique_ptr<std::atomic<float>[]> recorded;
+    std::atomic<uint32_t> samples{0};
+
+    void resetRecord()
+    {
+        recorded.reset(new std::atomic<float>[nodes.size() * 4]);
+        for (size_t i = 0; i < nodes.size() * 4; ++i)
+            recorded[i].store(0, std::memory_order_relaxed);
+        samples = 0;
+    }
+};
+
+/**
+ * \brief 路径引导（practical path guiding）：空间二叉树把场景包围盒沿x、y、z轮流对半划分，
+ * 每个叶子带一棵方向四叉树（SD-tree）。渐进式渲染的每一轮把路径在各顶点的入射辐射亮度记录到
+ * 当前的树中，两轮之间（update）把记录变为下一轮的采样分布：样本多的空间叶子一分为二，
+ * 通量集中的方向继续细分。整棵树的内存不超过maxBytes
+ */
+class PathGuide
+{
+public:
+    explicit PathGuide(const Bounds3 &sceneBounds) : nodes(1)
+    {
+        // 取包含场景的立方体，使空间划分各向同性
+        Vector3f d = sceneBounds.Diagonal();
+        float extent = std::max(d.x, std::max(d.y, d.z)) * 1.01f;
+        Vector3f center = 0.5f * (sceneBounds.pMin + sceneBounds.pMax);
+        origin = center - Vector3f(extent / 2);
+        size = extent;
+        dtrees.emplace_back(new DTree());
+    }
+
+    // BSDF采样在与引导分布混合采样中所占的比例
+    float bsdfSamplingFraction = 0.5f;
+    // 整棵树（空间节点与方向四叉树）的内存上限（字节）
+    size_t maxBytes = 32 << 20;
+    // 空间叶子在一轮中的样本数超过spatialThreshold · sqrt(该轮spp)时一分为二
+    float spatialThreshold = 12000;
+    // 方向四叉树中占总通量比例超过该值的象限继续细分
+    float directionalThreshold = 0.01f;
+    int maxDirectionalDepth = 20;
+
+    // 点p所在的空间叶子的方向四叉树
+    DTree *lookup(const Vector3f &p) const
+    {
+        Vector3f x = (p - origin) / size;
+        uint32_t index = 0;
+        while (nodes[index].child[0] != 0)
+        {
+            const Node &node = nodes[index];
+            float &c = node.axis == 0 ? x.x : node.axis == 1 ? x.y : x.z;
+            if (c < 0.5f)
+            {
+                c = 2 * c;
+                index = node.child[0];
+            }
+            else
+            {
+                c = 2 * c - 1;
+                index = node.child[1];
+            }
+        }
+        return dtrees[nodes[index].dtree].get();
+    }
+
+    /**
+     * @brief 一轮渲染结束后调用（不能与记录并发）：先按样本数划分空间叶子，再把各方向四叉树的记录变为采样分布
+     * @param passSpp 这一轮的每像素采样数
+     */
+    void update(int passSpp)
+    {
+        float threshold = spatialThreshold * std::sqrt((float)std::max(passSpp, 1));
+        for (size_t i = 0, n = nodes.size(); i < n; ++i)
+        {
+            if (nodes[i].child[0] != 0)
+                continue;
+            DTree &dtree = *dtrees[nodes[i].dtree];
+            if (dtree.sampleCount() <= threshold || bytes() + dtree.bytes() + 2 * sizeof(Node) > maxBytes)
+                continue;
+            // 两个子节点各继承一半的记录，原叶子的方向四叉树留给第一个子节点
+            dtree.halveRecord();
+            uint32_t first = nodes.size();
+            int axis = (nodes[i].axis + 1) % 3;
+            nodes.push_back({axis, {0, 0}, nodes[i].dtree});
+            nodes.push_back({axis, {0, 0}, (uint32_t)dtrees.size()});
+            dtrees.emplace_back(new DTree(dtree));
+            nodes[i].child[0] = first;
+            nodes[i].child[1] = first + 1;
+        }
+        // 空间节点以外的内存平分给各方向四叉树
+        size_t budget = maxBytes > nodes.size() * sizeof(Node) ? maxBytes - nodes.size() * sizeof(Node) : 0;
+        size_t maxNodes = std::max<size_t>(1, budget / DTree::nodeBytes / dtrees.size());
+        for (auto &dtree : dtrees)
+            dtree->refine(directionalThreshold, maxDirectionalDepth, maxNodes);
+        ++iterations;
+    }
+
+    // 已完成的学习轮数
+    int iteration() const { return iterations; }
+    size_t numLeaves() const { return dtrees.size(); }
+    size_t bytes() const
+    {
+        size_t total = nodes.size() * sizeof(Node);
+        for (auto &dtree : dtrees)
+            total += dtree->bytes();
+        return total;
+    }
+
+private:
+    // 空间节点，child[0]为0时是叶子；沿axis对半划分为两个子节点，根节点沿x轴，逐层轮换
+    struct Node
+    {
+        int axis = 0;
+        uint32_t child[2] = {0, 0};
+        uint32_t dtree = 0;
+    };
+    std::vector<Node> nodes;
+    std::vector<std::unique_ptr<DTree>> dtrees;
+    Vector3f origin;
+    float size = 1;
+    int iterations = 0;
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "Bounds3.hpp"
+#include "Vector.hpp"
+#include "global.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+/**
+ * \brief 世界空间的辐射亮度缓存：把表面位置按边长cellSize量化为格子，再按法线主轴方向分为6类，
+ * 格子散列到定长的开放寻址表中（线性探测，插入时对键做CAS，可并发）。每个表项累积落在其中的
+ * 漫反射出射辐射亮度（除以反照率，纹理在查询时重新乘上）的和与样本数，即对时间（所有路径、所有轮）的平均。
+ * 路径在第depth次弹射及之后到达漫反射表面时先查询缓存：样本数已达minSamples时直接返回平均值（命中），
+ * 不再继续追踪；否则（缺失）照常追踪整条路径并把结果记录到格子中。
+ * 格子越大、minSamples越小，命中越早、越快，但偏差（模糊、漏光）越大
+ */
+class RadianceCache
+{
+public:
+    explicit RadianceCache(const Bounds3 &sceneBounds, size_t tableSize = 1 << 18)
+        : size(tableSize), entries(new Entry[tableSize])
+    {
+        Vector3f d = sceneBounds.Diagonal();
+        origin = sceneBounds.pMin;
+        cellSize = std::max(d.x, std::max(d.y, d.z)) / 64;
+    }
+
+    // 格子边长（世界坐标），默认为场景包围盒最长边的1/64
+    float cellSize;
+    // 从第几次弹射（相机光线的交点为第0次）开始查询缓存，至少为1
+    int depth = 1;
+    // 格子中的样本数达到该值后才用于返回
+    uint32_t minSamples = 32;
+    // 命中后仍以该概率追踪整条路径并记录，使缓存随时间继续平均（为0时格子在命中后不再更新）
+    float updateProbability = 0.1f;
+
+    // 缓存对第depth次弹射是否适用
+    bool applies(int pathDepth) const { return pathDepth >= std::max(depth, 1); }
+
+    /**
+     * @brief 查询点p（法线N）所在格子的平均值
+     * @param[out] L 命中时为除以反照率后的出射辐射亮度
+     * @return 格子的样本数已达minSamples（且未被选中更新）时为true，否则调用者应追踪路径并record
+     */
+    bool lookup(const Vector3f &p, const Vector3f &N, Vector3f &L) const
+    {
+        const Entry *entry = find(key(p, N));
+        uint32_t count = entry ? entry->count.load(std::memory_order_acquire) : 0;
+        if (count < minSamples)
+        {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (updateProbability > 0 && get_random_float() < updateProbability)
+        {
+            updates.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        hits.fetch_add(1, std::memory_order_relaxed);
+        L = Vector3f(entry->sum[0].load(std::memory_order_relaxed),
+                     entry->sum[1].load(std::memory_order_relaxed),
+                     entry->sum[2].load(std::memory_order_relaxed)) / count;
+        return true;
+    }
+
+    // 把点p（法线N）处追踪得到的、除以反照率后的出射辐射亮度记入所在格子，表满时丢弃
+    void record(const Vector3f &p, const Vector3f &N, const Vector3f &L)
+    {
+        if (!std::isfinite(L.x) || !std::isfinite(L.y) || !std::isfinite(L.z))
+            return;
+        Entry *entry = insert(key(p, N));
+        if (!entry)
+            return;
+        atomicAdd(entry->sum[0], L.x);
+        atomicAdd(entry->sum[1], L.y);
+        atomicAdd(entry->sum[2], L.z);
+        entry->count.fetch_add(1, std::memory_order_release);
+    }
+
+    uint64_t hitCount() const { return hits.load(std::memory_order_relaxed); }
+    uint64_t missCount() const { return misses.load(std::memory_order_relaxed); }
+    uint64_t updateCount() const { return updates.load(std::memory_order_relaxed); }
+    // 已占用的表项数
+    size_t cellCount() const
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < size; ++i)
+            n += entries[i].key.load(std::memory_order_relaxed) != 0;
+        return n;
+    }
+    size_t bytes() const { return size * sizeof(Entry); }
+
+private:
+    struct Entry
+    {
+        std::atomic<uint64_t> key{0}; // 0表示空
+        std::atomic<float> sum[3] = {{0}, {0}, {0}};
+        std::atomic<uint32_t> count{0};
+    };
+
+    static constexpr int maxProbes = 16;
+    size_t size;
+    std::unique_ptr<Entry[]> entries;
+    Vector3f origin;
+    mutable std::atomic<uint64_t> hits{0}, misses{0}, updates{0};
+
+    // 格子坐标（每轴20位）与法线主轴方向（3位）打包成的键，加1使其非0
+    uint64_t key(const Vector3f &p, const Vector3f &N) const
+    {
+        Vector3f c = (p - origin) / cellSize;
+        uint64_t x = (uint64_t)((int64_t)std::floor(c.x) & 0xfffff);
+        uint64_t y = (uint64_t)((int64_t)std::floor(c.y) & 0xfffff);
+        uint64_t z = (uint64_t)((int64_t)std::floor(c.z) & 0xfffff);
+        Vector3f a(std::fabs(N.x), std::fabs(N.y), std::fabs(N.z));
+        int axis = a.x >= a.y && a.x >= a.z ? 0 : a.y >= a.z ? 1 : 2;
+        uint64_t face = axis * 2 + (N[axis] < 0);
+        return ((x << 43) | (y << 23) | (z << 3) | face) + 1;
+    }
+
+    size_t slot(uint64_t k) const
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        return k % size;
+    }
+
+    const Entry *find(uint64_t k) const
+    {
+        for (size_t i = slot(k), n = 0; n < maxProbes; ++n, i = (i + 1) % size)
+        {
+            uint64_t stored = entries[i].key.load(std::memory_order_acquire);
+            if (stored == k)
+                return &entries[i];
+            if (stored == 0)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    Entry *insert(uint64_t k)
+    {
+        for (size_t i = slot(k), n = 0; n < maxProbes; ++n, i = (i + 1) % size)
+        {
+            uint64_t stored = 0;
+            if (entries[i].key.compare_exchange_strong(stored, k, std::memory_order_acq_rel) || stored == k)
+                return &entries[i];
+        }
+        return nullptr;
+    }
+};
@@ -9,6 +9,8 @@ struct Ray
     Vector3f direction, direction_inv;
     double t; // transportation time,
     double t_min, t_max;
+    // 光锥（ray cone）：起点处的宽度与扩散角，用于选择纹理的mip层；扩散角为0时由相机设定
+    float coneWidth = 0, coneSpread = 0;
 
     Ray(const Vector3f &ori, const Vector3f &dir, const double _t = 0.0) : origin(ori), direction(dir), t(_t)
     {
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Scene.hpp"
+#include "global.hpp"
+
+#include <type_traits>
+
+/**
+ * \brief ReSTIR（基于蓄水池的时空重要性重采样）直接光照：每个像素从Scene::sampleLight流式抽取M个候选光源样本，
+ * 按未考虑遮挡的贡献p̂重采样进加权蓄水池，再与上一轮同一像素、本轮邻近像素的蓄水池合并，
+ * 最后只对保留下来的样本发射一条阴影光线。合并时按几何相似性筛选邻居，
+ * 目标函数不含可见性，各来源的样本以平衡启发式加权，复用本身不引入偏差
+ */
+
+// 面光源上的一个采样点
+struct LightSample
+{
+    Vector3f coords;
+    Vector3f normal;
+    Vector3f emit;
+};
+
+/**
+ * \brief 加权蓄水池：流式处理候选样本，以权重占比保留其中一个。
+ * wSum为权重和，M为已处理的候选数，W为保留样本的贡献权重wSum / (M · p̂(y))
+ */
+struct Reservoir
+{
+    LightSample y;
+    float wSum = 0;
+    float M = 0;
+    float W = 0;
+
+    bool update(const LightSample &sample, float w, float u)
+    {
+        wSum += w;
+        M += 1;
+        if (w > 0 && u * wSum < w)
+        {
+            y = sample;
+            return true;
+        }
+        return false;
+    }
+};
+
+struct ReSTIRSettings
+{
+    // 每个像素每轮的初始候选数
+    int candidates = 32;
+    // 与上一轮同一像素的蓄水池合并，历史长度截断为candidates的maxHistory倍。
+    // 时间复用提高单轮的质量，但相邻轮次保留同一样本的概率很大，累积多轮的静止画面反而更噪，默认关闭
+    bool temporal = false;
+    int maxHistory = 20;
+    // 空间复用的邻居数与搜索半径（像素）
+    int neighbors = 4;
+    float radius = 16;
+};
+
+namespace restir
+{
+    /**
+     * @brief 目标函数p̂：不考虑遮挡时样本y对着色点的贡献f = Le · fr · cosθ · cosθ' / r²的亮度
+     */
+    template <typename BSDFType>
+    float targetPdf(const BSDFType &bsdf, const PrimaryHit &hit, const LightSample &y, Vector3f &f)
+    {
+        f = Vector3f();
+        Vector3f d = y.coords - hit.inter.coords;
+        float dist2 = dotProduct(d, d);
+        if (dist2 <= 0)
+            return 0;
+        Vector3f wi = d / std::sqrt(dist2);
+        float cosSurface = dotProduct(wi, hit.N), cosLight = dotProduct(-wi, y.normal);
+        if (cosSurface <= 0 || cosLight <= 0)
+            return 0;
+        f = y.emit * bsdf.eval(hit.ray.direction, wi, hit.N) * cosSurface * cosLight / dist2;
+        return std::max(luminance(f), 0.0f);
+    }
+
+    template <typename BSDFType>
+    void finalize(Reservoir &r, const BSDFType &bsdf, const PrimaryHit &hit)
+    {
+        Vector3f f;
+        float p = targetPdf(bsdf, hit, r.y, f);
+        r.W = (p > 0 && r.M > 0) ? r.wSum / (r.M * p) : 0;
+    }
+
+    // 邻居的着色点与当前着色点相近（法线夹角与深度差都小）时才复用其样本
+    inline bool similar(const PrimaryHit &a, const PrimaryHit &b)
+    {
+        return b.surface && dotProduct(a.N, b.N) > 0.9f &&
+               std::fabs(a.inter.distance - b.inter.distance) < 0.1f * a.inter.distance;
+    }
+
+    // 按材质类型执行f(bsdf)；delta分布的材质不做光源采样，返回默认值
+    template <typename F>
+    auto withBSDF(const Scene &scene, const PrimaryHit &hit, F &&f)
+    {
+        return scene.dispatchShading(hit.ray, hit.inter, hit.N, [&](const auto &bsdf)
+                                     {
+                                         using BSDFType = std::decay_t<decltype(bsdf)>;
+                                         if constexpr (BSDFType::flags & MATERIAL_DELTA)
+                                             return decltype(f(bsdf))();
+                                         else
+                                             return f(bsdf); });
+    }
+
+    // 参与合并的一个蓄水池及其所在的着色点
+    struct Source
+    {
+        const Reservoir *reservoir;
+        const PrimaryHit *hit;
+    };
+
+    // 着色点hit处样本y的目标函数值
+    inline float targetAt(const Scene &scene, const PrimaryHit &hit, const LightSample &y)
+    {
+        return withBSDF(scene, hit, [&](const auto &bsdf)
+                        {
+                            Vector3f f;
+                            return targetPdf(bsdf, hit, y, f); });
+    }
+
+    /**
+     * @brief 合并多个着色点的蓄水池：来源i的样本以平衡启发式m_i = M_i p̂_i / Σ M_j p̂_j加权，
+     *        再按当前着色点的p̂重采样。邻居的目标函数与当前着色点相差很大时（例如离光源很近），
+     *        简单按候选数归一化会让个别样本的权重极大，平衡启发式可以避免这种情况
+     */
+    template <typename BSDFType>
+    Reservoir combine(const Scene &scene, const BSDFType &bsdf, const PrimaryHit &hit, const Source *sources, int count)
+    {
+        Reservoir r;
+        float M = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const Reservoir &other = *sources[i].reservoir;
+            M += other.M;
+            if (other.W <= 0)
+            {
+                r.update(other.y, 0, 0);
+                continue;
+            }
+            Vector3f f;
+            float p = targetPdf(bsdf, hit, other.y, f);
+            float numerator = 0, denominator = 0;
+            for (int j = 0; j < count; ++j)
+            {
+                float pj = sources[j].hit == &hit ? p : targetAt(scene, *sources[j].hit, other.y);
+                denominator += sources[j].reservoir->M * pj;
+                if (j == i)
+                    numerator = sources[j].reservoir->M * pj;
+            }
+            float mis = denominator > 0 ? numerator / denominator : 0;
+            r.update(other.y, mis * p * other.W, get_random_float());
+        }
+        r.M = M;
+        Vector3f f;
+        float p = targetPdf(bsdf, hit, r.y, f);
+        r.W = p > 0 ? r.wSum / p : 0;
+        return r;
+    }
+
+    // 初始候选：从sampleLight抽取candidates个样本，按p̂ / pdf重采样；previous非空时再与上一轮同一像素的蓄水池合并
+    inline Reservoir initial(const Scene &scene, const PrimaryHit &hit, const ReSTIRSettings &settings,
+                             const Reservoir *previous, const PrimaryHit *previousHit)
+    {
+        return withBSDF(scene, hit, [&](const auto &bsdf)
+                        {
+                            Reservoir r;
+                            for (int c = 0; c < settings.candidates; ++c)
+                            {
+                                Intersection pos;
+                                float pdf;
+                                scene.sampleLight(hit.inter.coords, hit.N, pos, pdf);
+                                LightSample sample{pos.coords, pos.normal, pos.emit};
+                                Vector3f f;
+                                float w = pdf > 0 ? targetPdf(bsdf, hit, sample, f) / pdf : 0;
+                                r.update(sample, w, get_random_float());
+                            }
+                            finalize(r, bsdf, hit);
+                            if (!previous || previous->M <= 0)
+                                return r;
+                            Reservoir history = *previous;
+                            history.M = std::min(history.M, (float)settings.candidates * settings.maxHistory);
+                            Source sources[2] = {{&r, &hit}, {&history, previousHit}};
+                            return combine(scene, bsdf, hit, sources, 2); });
+    }
+
+    /**
+     * @brief 空间复用：在radius像素内随机取neighbors个几何相似的邻居，把它们的蓄水池并入像素(i, j)的蓄水池
+     */
+    inline Reservoir spatial(const Scene &scene, const std::vector<PrimaryHit> &gbuffer, const std::vector<Reservoir> &reservoirs,
+                             int i, int j, const ReSTIRSettings &settings)
+    {
+        int m = j * scene.width + i;
+        const PrimaryHit &hit = gbuffer[m];
+        const int maxNeighbors = 16;
+        Source sources[maxNeighbors + 1] = {{&reservoirs[m], &hit}};
+        int count = 1;
+        for (int k = 0; k < std::min(settings.neighbors, maxNeighbors); ++k)
+        {
+            float radius = settings.radius * std::sqrt(get_random_float()), angle = 2 * M_PI * get_random_float();
+            int x = i + (int)std::lround(radius * std::cos(angle)), y = j + (int)std::lround(radius * std::sin(angle));
+            if (x < 0 || y < 0 || x >= scene.width || y >= scene.height || (x == i && y == j))
+                continue;
+            int n = y * scene.width + x;
+            if (reservoirs[n].M > 0 && similar(hit, gbuffer[n]))
+                sources[count++] = {&reservoirs[n], &gbuffer[n]};
+        }
+        return withBSDF(scene, hit, [&](const auto &bsdf)
+                        { return combine(scene, bsdf, hit, sources, count); });
+    }
+
+    // 对保留的样本发射一条阴影光线，返回直接光照
+    inline Vector3f shade(const Scene &scene, const PrimaryHit &hit, const Reservoir &r)
+    {
+        if (r.W <= 0)
+            return Vector3f();
+        return withBSDF(scene, hit, [&](const auto &bsdf)
+                        {
+                            Vector3f f;
+                            if (targetPdf(bsdf, hit, r.y, f) <= 0)
+                                return Vector3f();
+                            Vector3f d = r.y.coords - hit.inter.coords;
+                            STAT_INC(shadowRays);
+                            if (scene.intersect(Ray(hit.inter.coords, d.normalized())).distance - d.norm() <= -EPSILON)
+                                return Vector3f();
+                            return f * r.W; });
+    }
+}
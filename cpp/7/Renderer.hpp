@@ -2,8 +2,18 @@
 
 #include "Scene.hpp"
 #include "Renderer.hpp"
+#include "BDPT.hpp"
+#include "GBuffer.hpp"
+#include "ReSTIR.hpp"
+#include "SPPM.hpp"
+#include "Simd.hpp"
+#include "Stats.hpp"
+#include "Triangle.hpp"
 
 #include <fstream>
+#include <chrono>
+#include <atomic>
+#include <string>
 #include <omp.h>
 
 struct hit_payload
@@ -19,8 +29,50 @@ class Renderer
 public:
     void Render(const Scene &scene, int spp);
     void Render(const Scene &scene, int spp, const int num_workers);
+    int RenderProgressive(const Scene &scene, int spp, const int num_workers, double time_budget = 0);
+    void RenderDebug(const Scene &scene, int spp, const int num_workers);
+    void RenderReSTIR(const Scene &scene, int spp, const int num_workers);
+    void RenderSPPM(const Scene &scene, int spp, const int num_workers);
+    void RenderBDPT(const Scene &scene, int spp, const int num_workers);
+
+    // 输出图像路径
+    std::string filename = "binary.ppm";
+    // 是否输出进度信息
+    bool verbose = true;
+    // 输出时的Gamma矫正指数，1表示不做矫正
+    float gamma = 0.6f;
+    // RenderReSTIR的重采样参数
+    ReSTIRSettings restir;
+    // RenderSPPM的光子数与收集半径
+    SPPMSettings sppm;
+    // RenderBDPT的最大路径长度
+    BDPTSettings bdpt;
+    // 在多次渲染之间复用相机光线的首个交点（Render、RenderProgressive与RenderReSTIR），
+    // 只修改光照或材质参数后重新渲染时跳过相机光线的求交。修改材质参数（含光源的自发光）后须先调用
+    // scene.materials.commit()，否则着色仍使用旧的核函数；几何体经buildBVH、updateBVH变化后记录自动失效
+    bool reusePrimaryHits = false;
+    GBuffer primaryHits;
 
 private:
+    // 子采样网格为gridWidth x gridHeight时，为复用首个交点做准备
+    void preparePrimaryHits(const Scene &scene, int gridWidth, int gridHeight, int spp)
+    {
+        if (reusePrimaryHits)
+            primaryHits.prepare(scene, gridWidth, gridHeight, spp);
+    }
+    // 像素m的第k个子采样的首个交点
+    PrimaryHit primaryHit(const Scene &scene, const Ray &ray, int m, int k)
+    {
+        return reusePrimaryHits ? primaryHits.primary(scene, ray, m, k) : scene.tracePrimary(ray);
+    }
+    // 像素m的第k个子采样的路径追踪，复用首个交点时从记录出发
+    Vector3f castCameraRay(const Scene &scene, const Ray &ray, int m, int k)
+    {
+        return reusePrimaryHits ? scene.shadePrimary(primaryHits.primary(scene, ray, m, k)) : scene.castRay(ray, 0);
+    }
+    void savePPM(const Scene &scene, const std::vector<Vector3f> &framebuffer) const;
+    void saveStats(const Scene &scene, int spp, int num_workers, double seconds) const;
+    void saveHeatmap(const Scene &scene, const std::vector<float> &values, const std::string &path) const;
 };
 
 inline float deg2rad(const float &deg) { return deg * M_PI / 180.0; }
@@ -50,6 +102,9 @@ void Renderer::Render(const Scene &scene, int spp)
 
     float wstep = 1.0f / width;
     float hstep = 1.0f / height;
+
+    Stats::reset();
+    auto start = std::chrono::steady_clock::now();
     
     for (uint32_t j = 0; j < scene.height; ++j)
     {
@@ -71,19 +126,12 @@ void Renderer::Render(const Scene &scene, int spp)
         UpdateProgress(j / (float)scene.height);
     }
     UpdateProgress(1.f);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
     // save framebuffer to file
-    FILE *fp = fopen("binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i)
-    {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);
+    savePPM(scene, framebuffer);
+    if (Stats::enabled)
+        saveStats(scene, spp, 1, elapsed.count());
 }
 
 /**
@@ -101,7 +149,8 @@ void Renderer::Render(const Scene &scene, int spp, const int num_workers)
     Vector3f eye_pos(278, 273, -800);
 
     // change the spp value to change sample ammount
-    std::cout << "SPP: " << spp << " num_workers: " << num_workers << "\n";
+    if (verbose)
+        std::cout << "SPP: " << spp << " num_workers: " << num_workers << "\n";
     int prog = 0;
 
     int width = std::sqrt(1.0 * spp * scene.width / scene.height);
@@ -111,6 +160,9 @@ void Renderer::Render(const Scene &scene, int spp, const int num_workers)
     float hstep = 1.0f / height;
 
     omp_set_num_threads(num_workers);
+    preparePrimaryHits(scene, width, height, spp);
+    Stats::reset();
+    auto start = std::chrono::steady_clock::now();
     
 #pragma omp parallel for
     for (uint32_t j = 0; j < scene.height; ++j)
@@ -128,28 +180,567 @@ void Renderer::Render(const Scene &scene, int spp, const int num_workers)
                 float y = (1 - 2 * (j + hstep / 2 + hstep * (k / height)) / (float)scene.height) * scale;
 
                 Vector3f dir = normalize(Vector3f(-x, y, 1));
-                framebuffer[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp;
+                framebuffer[m] += castCameraRay(scene, Ray(eye_pos, dir), m, k) / spp;
             }
 
         }
-#pragma omp critical
+        if (verbose)
         {
-            UpdateProgress(prog / (float)scene.height);
-            prog++;
+#pragma omp critical
+            {
+                UpdateProgress(prog / (float)scene.height);
+                prog++;
+            }
         }
     }
-    UpdateProgress(1.f);
+    if (verbose)
+        UpdateProgress(1.f);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
     // save framebuffer to file
-    FILE *fp = fopen("binary.ppm", "wb");
+    savePPM(scene, framebuffer);
+    if (Stats::enabled)
+        saveStats(scene, spp, num_workers, elapsed.count());
+}
+
+/**
+ * @brief 渐进式渲染：先以1spp渲染整幅图像并立即输出预览，随后逐轮细化（每轮采样数翻倍），
+ *        每轮结束后刷新输出图像，到达墙钟截止时间或目标spp时（以先到者为准）停止
+ * @param scene         待渲染的场景
+ * @param spp           目标每像素采样数（亚像素位置与Render一致）
+ * @param num_workers   并行线程数目
+ * @param time_budget   墙钟时间预算（秒），<=0表示不限时
+ * @return 所有像素均已完成的采样数
+ */
+int Renderer::RenderProgressive(const Scene &scene, int spp, const int num_workers, double time_budget)
+{
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto deadline = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(time_budget));
+
+    std::vector<Vector3f> accum(scene.width * scene.height);
+    std::vector<int> samples(scene.width * scene.height, 0);
+    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+
+    float scale = tan(deg2rad(scene.fov * 0.5));
+    float imageAspectRatio = scene.width / (float)scene.height;
+    Vector3f eye_pos(278, 273, -800);
+
+    if (verbose)
+        std::cout << "SPP: " << spp << " num_workers: " << num_workers << " time budget: " << time_budget << "s\n";
+
+    int width = std::sqrt(1.0 * spp * scene.width / scene.height);
+    int height = std::sqrt(1.0 * spp * scene.height / scene.width);
+
+    float wstep = 1.0f / width;
+    float hstep = 1.0f / height;
+
+    omp_set_num_threads(num_workers);
+    preparePrimaryHits(scene, width, height, spp);
+    Stats::reset();
+
+    std::atomic<bool> expired(false);
+    int done = 0;
+    for (int pass = 0, pass_spp = 1; done < spp && !expired; ++pass)
+    {
+        // 前两轮各1spp，之后每轮采样数翻倍，使累计采样数保持为2的幂
+        int n = std::min(pass_spp, spp - done);
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (uint32_t j = 0; j < scene.height; ++j)
+        {
+            for (uint32_t i = 0; i < scene.width; ++i)
+            {
+                // 以像素为粒度检查截止时间，超时后剩余像素保持上一轮的结果
+                if (expired.load(std::memory_order_relaxed))
+                    break;
+                if (time_budget > 0 && clock::now() >= deadline)
+                {
+                    expired = true;
+                    break;
+                }
+
+                int m = j * scene.width + i;
+                for (int k = done; k < done + n; k++)
+                {
+                    // 使用MSAA反走样
+                    float x = (2 * (i + wstep / 2 + wstep * (k % width)) / (float)scene.width - 1) *
+                            imageAspectRatio * scale;
+                    float y = (1 - 2 * (j + hstep / 2 + hstep * (k / height)) / (float)scene.height) * scale;
+
+                    Vector3f dir = normalize(Vector3f(-x, y, 1));
+                    accum[m] += castCameraRay(scene, Ray(eye_pos, dir), m, k);
+                }
+                samples[m] += n;
+            }
+        }
+        if (!expired)
+            done += n;
+        if (pass > 0)
+            pass_spp *= 2;
+        // 路径引导用这一轮的记录更新下一轮的采样分布
+        if (scene.guide && !expired)
+            scene.guide->update(n);
+
+        // 每轮结束后刷新输出图像
+        for (int m = 0; m < scene.width * scene.height; ++m)
+            framebuffer[m] = samples[m] > 0 ? accum[m] / samples[m] : Vector3f();
+        savePPM(scene, framebuffer);
+
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        if (verbose)
+            std::cout << "Pass " << pass << ": " << done << " spp" << (expired ? " (deadline reached)" : "")
+                      << ", elapsed " << elapsed.count() << "s\n";
+    }
+
+    if (Stats::enabled)
+        saveStats(scene, done, num_workers, std::chrono::duration<double>(clock::now() - start).count());
+    return done;
+}
+
+/**
+ * @brief ReSTIR直接光照的渲染：每轮每像素1个采样，先求相机光线的首个交点（G-buffer），
+ *        再依次做初始候选与时间复用、空间复用，每像素只为最终样本发射一条阴影光线；
+ *        间接光照与环境光仍由路径追踪计算。相机不动，上一轮同一像素的蓄水池即时间上的邻居
+ * @param scene         待渲染的场景
+ * @param spp           每个像素采样数目（轮数，亚像素位置与Render一致）
+ * @param num_workers   并行线程数目
+ */
+void Renderer::RenderReSTIR(const Scene &scene, int spp, const int num_workers)
+{
+    int n = scene.width * scene.height;
+    std::vector<Vector3f> accum(n), framebuffer(n);
+    Ray none(Vector3f(), Vector3f(0, 0, 1));
+    std::vector<PrimaryHit> gbuffer(n, PrimaryHit(none)), previousGbuffer(n, PrimaryHit(none));
+    std::vector<Reservoir> reservoirs(n), previous(n);
+
+    float scale = tan(deg2rad(scene.fov * 0.5));
+    float imageAspectRatio = scene.width / (float)scene.height;
+    Vector3f eye_pos(278, 273, -800);
+
+    if (verbose)
+        std::cout << "SPP: " << spp << " num_workers: " << num_workers << " ReSTIR candidates: " << restir.candidates << "\n";
+
+    int width = std::sqrt(1.0 * spp * scene.width / scene.height);
+    int height = std::sqrt(1.0 * spp * scene.height / scene.width);
+
+    float wstep = 1.0f / width;
+    float hstep = 1.0f / height;
+
+    omp_set_num_threads(num_workers);
+    preparePrimaryHits(scene, width, height, spp);
+    Stats::reset();
+    auto start = std::chrono::steady_clock::now();
+
+    for (int k = 0; k < spp; ++k)
+    {
+        // 首个交点与初始候选，并入上一轮的蓄水池
+#pragma omp parallel for schedule(dynamic, 1)
+        for (uint32_t j = 0; j < scene.height; ++j)
+        {
+            for (uint32_t i = 0; i < scene.width; ++i)
+            {
+                int m = j * scene.width + i;
+                float x = (2 * (i + wstep / 2 + wstep * (k % width)) / (float)scene.width - 1) *
+                        imageAspectRatio * scale;
+                float y = (1 - 2 * (j + hstep / 2 + hstep * (k / height)) / (float)scene.height) * scale;
+
+                Vector3f dir = normalize(Vector3f(-x, y, 1));
+                gbuffer[m] = primaryHit(scene, Ray(eye_pos, dir), m, k);
+                const PrimaryHit &hit = gbuffer[m];
+                bool history = restir.temporal && k > 0 && restir::similar(hit, previousGbuffer[m]);
+                reservoirs[m] = hit.surface ? restir::initial(scene, hit, restir, history ? &previous[m] : nullptr, &previousGbuffer[m]) : Reservoir();
+            }
+        }
+
+        // 空间复用（结果写入previous，本轮着色后即作为下一轮的历史）
+#pragma omp parallel for schedule(dynamic, 1)
+        for (uint32_t j = 0; j < scene.height; ++j)
+            for (uint32_t i = 0; i < scene.width; ++i)
+            {
+                int m = j * scene.width + i;
+                previous[m] = gbuffer[m].surface && restir.neighbors > 0 ? restir::spatial(scene, gbuffer, reservoirs, i, j, restir)
+                                                                         : reservoirs[m];
+            }
+
+        // 一条阴影光线的直接光照，加上路径追踪的间接光照
+#pragma omp parallel for schedule(dynamic, 1)
+        for (uint32_t j = 0; j < scene.height; ++j)
+            for (uint32_t i = 0; i < scene.width; ++i)
+            {
+                int m = j * scene.width + i;
+                const PrimaryHit &hit = gbuffer[m];
+                if (hit.surface)
+                    accum[m] += restir::shade(scene, hit, previous[m]) + scene.shadePrimary(hit, false);
+                else
+                    accum[m] += hit.Le;
+            }
+        std::swap(gbuffer, previousGbuffer);
+        if (verbose)
+            UpdateProgress((k + 1) / (float)spp);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (int m = 0; m < n; ++m)
+        framebuffer[m] = accum[m] / spp;
+    savePPM(scene, framebuffer);
+    if (Stats::enabled)
+        saveStats(scene, spp, num_workers, elapsed.count());
+}
+
+/**
+ * @brief 随机渐进式光子映射：每轮每像素1条相机路径（亚像素位置与Render一致）确定可见点，
+ *        建立可见点的哈希网格后发射一轮光子，再收缩各像素的收集半径；
+ *        累计轮数为2的幂时及最后一轮刷新输出图像
+ * @param scene         待渲染的场景
+ * @param spp           轮数
+ * @param num_workers   并行线程数目
+ */
+void Renderer::RenderSPPM(const Scene &scene, int spp, const int num_workers)
+{
+    int n = scene.width * scene.height;
+    std::vector<SPPMPixel> pixels(n);
+    std::vector<Vector3f> framebuffer(n);
+    PhotonGrid grid;
+    float radius = sppm.initialRadius > 0 ? sppm.initialRadius : sppm::defaultRadius(scene);
+    for (SPPMPixel &pixel : pixels)
+        pixel.radius = radius;
+    long long photons = sppm.photonsPerPass > 0 ? sppm.photonsPerPass : n;
+
+    float scale = tan(deg2rad(scene.fov * 0.5));
+    float imageAspectRatio = scene.width / (float)scene.height;
+    Vector3f eye_pos(278, 273, -800);
+
+    if (verbose)
+        std::cout << "SPP: " << spp << " num_workers: " << num_workers << " photons per pass: " << photons
+                  << " initial radius: " << radius << "\n";
+
+    int width = std::sqrt(1.0 * spp * scene.width / scene.height);
+    int height = std::sqrt(1.0 * spp * scene.height / scene.width);
+
+    float wstep = 1.0f / width;
+    float hstep = 1.0f / height;
+
+    omp_set_num_threads(num_workers);
+    Stats::reset();
+    auto start = std::chrono::steady_clock::now();
+
+    for (int k = 0; k < spp; ++k)
+    {
+        // 相机路径与可见点
+#pragma omp parallel for schedule(dynamic, 1)
+        for (uint32_t j = 0; j < scene.height; ++j)
+        {
+            for (uint32_t i = 0; i < scene.width; ++i)
+            {
+                float x = (2 * (i + wstep / 2 + wstep * (k % width)) / (float)scene.width - 1) *
+                        imageAspectRatio * scale;
+                float y = (1 - 2 * (j + hstep / 2 + hstep * (k / height)) / (float)scene.height) * scale;
+
+                Vector3f dir = normalize(Vector3f(-x, y, 1));
+                sppm::traceCamera(scene, Ray(eye_pos, dir), pixels[j * scene.width + i], sppm);
+            }
+        }
+
+        // 可见点的哈希网格与光子
+        grid.build(pixels);
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (long long p = 0; p < photons; ++p)
+            sppm::tracePhoton(scene, grid, pixels, sppm);
+
+#pragma omp parallel for
+        for (int m = 0; m < n; ++m)
+            sppm::update(pixels[m], sppm.alpha);
+
+        if (((k + 1) & k) == 0 || k + 1 == spp)
+        {
+            for (int m = 0; m < n; ++m)
+                framebuffer[m] = sppm::radiance(pixels[m], k + 1, photons);
+            savePPM(scene, framebuffer);
+        }
+        if (verbose)
+            UpdateProgress((k + 1) / (float)spp);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (verbose)
+        std::cout << "\nSPPM memory: " << (n * sizeof(SPPMPixel) + grid.bytes()) / 1024 << " KB\n";
+
+    if (Stats::enabled)
+        saveStats(scene, spp, num_workers, elapsed.count());
+}
+
+/**
+ * @brief 双向路径追踪：每个采样（亚像素位置与Render一致）生成一条相机子路径与一条光源子路径，
+ *        累加所有连接策略的加权贡献；连到相机的策略（t = 1）可能落在其他像素上，以原子操作写入胶片，
+ *        最后与各像素自身的结果一起除以spp
+ * @param scene         待渲染的场景
+ * @param spp           每个像素采样数目
+ * @param num_workers   并行线程数目
+ */
+void Renderer::RenderBDPT(const Scene &scene, int spp, const int num_workers)
+{
+    int n = scene.width * scene.height;
+    std::vector<Vector3f> accum(n), framebuffer(n);
+    std::unique_ptr<std::atomic<float>[]> splat(new std::atomic<float>[3 * n]);
+    for (int c = 0; c < 3 * n; ++c)
+        splat[c].store(0, std::memory_order_relaxed);
+
+    float scale = tan(deg2rad(scene.fov * 0.5));
+    float imageAspectRatio = scene.width / (float)scene.height;
+    Vector3f eye_pos(278, 273, -800);
+    bdpt::Context context(scene, bdpt::Camera{eye_pos, imageAspectRatio * scale, scale, scene.width, scene.height}, bdpt);
+
+    if (verbose)
+        std::cout << "SPP: " << spp << " num_workers: " << num_workers << " BDPT max depth: " << bdpt.maxDepth << "\n";
+    int prog = 0;
+
+    int width = std::sqrt(1.0 * spp * scene.width / scene.height);
+    int height = std::sqrt(1.0 * spp * scene.height / scene.width);
+
+    float wstep = 1.0f / width;
+    float hstep = 1.0f / height;
+
+    omp_set_num_threads(num_workers);
+    Stats::reset();
+    auto start = std::chrono::steady_clock::now();
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (uint32_t j = 0; j < scene.height; ++j)
+    {
+        std::vector<bdpt::Vertex> cameraPath(bdpt.maxDepth + 2), lightPath(bdpt.maxDepth + 1);
+        for (uint32_t i = 0; i < scene.width; ++i)
+        {
+            int m = j * scene.width + i;
+            for (int k = 0; k < spp; k++)
+            {
+                // 使用MSAA反走样
+                float x = (2 * (i + wstep / 2 + wstep * (k % width)) / (float)scene.width - 1) *
+                        imageAspectRatio * scale;
+                float y = (1 - 2 * (j + hstep / 2 + hstep * (k / height)) / (float)scene.height) * scale;
+
+                Vector3f dir = normalize(Vector3f(-x, y, 1));
+                Vector3f L;
+                int nCamera = context.cameraSubpath(Ray(eye_pos, dir), cameraPath.data(), L);
+                int nLight = context.lightSubpath(lightPath.data());
+                for (int t = 1; t <= nCamera; ++t)
+                    for (int s = 0; s <= nLight; ++s)
+                    {
+                        int depth = s + t - 2;
+                        if ((s == 1 && t == 1) || depth < 0 || depth > bdpt.maxDepth)
+                            continue;
+                        float rasterX, rasterY;
+                        Vector3f c = context.connect(lightPath.data(), cameraPath.data(), s, t, rasterX, rasterY);
+                        if (t != 1)
+                            L += c;
+                        else if (luminance(c) > 0)
+                        {
+                            int p = 3 * ((int)rasterY * scene.width + (int)rasterX);
+                            atomicAdd(splat[p], c.x);
+                            atomicAdd(splat[p + 1], c.y);
+                            atomicAdd(splat[p + 2], c.z);
+                        }
+                    }
+                accum[m] += L;
+            }
+        }
+        if (verbose)
+        {
+#pragma omp critical
+            {
+                UpdateProgress(prog / (float)scene.height);
+                prog++;
+            }
+        }
+    }
+    if (verbose)
+        UpdateProgress(1.f);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (int m = 0; m < n; ++m)
+        framebuffer[m] = (accum[m] + Vector3f(splat[3 * m].load(), splat[3 * m + 1].load(), splat[3 * m + 2].load())) / spp;
+    savePPM(scene, framebuffer);
+    if (Stats::enabled)
+        saveStats(scene, spp, num_workers, elapsed.count());
+}
+
+/**
+ * @brief 将帧缓冲Gamma矫正后写入PPM文件；先写临时文件再重命名，保证渐进式渲染刷新时输出文件始终完整
+ */
+void Renderer::savePPM(const Scene &scene, const std::vector<Vector3f> &framebuffer) const
+{
+    std::string tmp = filename + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        std::cerr << "Cannot open " << tmp << " for writing\n";
+        return;
+    }
+    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
+    // 帧缓冲视为float数组，每次对8个分量做截断与Gamma编码
+    const float *data = &framebuffer[0].x;
+    size_t n = (size_t)scene.height * scene.width * 3;
+    std::vector<unsigned char> bytes(n);
+    alignas(32) float encoded[8];
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        // 与clamp相同的顺序，NaN被截断为1
+        Vec8f c = simd::max(simd::min(Vec8f::load(data + i), Vec8f(1.0f)), Vec8f(0.0f));
+        (Vec8f(255.0f) * fastmath::pow(c, Vec8f(gamma))).store(encoded);
+        for (int k = 0; k < 8; ++k)
+            bytes[i + k] = (unsigned char)encoded[k];
+    }
+    for (; i < n; ++i)
+        bytes[i] = (unsigned char)(255 * fastmath::pow(clamp(0, 1, data[i]), gamma));
+    fwrite(bytes.data(), 1, n, fp);
+    fclose(fp);
+#ifdef _WIN32
+    // Windows上rename不能覆盖已存在的文件；POSIX的rename原子地替换，不能先删除，否则读者会短暂看不到输出文件
+    std::remove(filename.c_str());
+#endif
+    std::rename(tmp.c_str(), filename.c_str());
+}
+
+/**
+ * @brief 合并各线程的光线追踪统计并以JSON格式写到输出图像旁（binary.ppm -> binary.json）
+ */
+void Renderer::saveStats(const Scene &scene, int spp, int num_workers, double seconds) const
+{
+    RayStats stats = Stats::collect();
+    std::string path = filename.substr(0, filename.find_last_of('.')) + ".json";
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr)
+    {
+        std::cerr << "Cannot open " << path << " for writing\n";
+        return;
+    }
+    double rays = (double)stats.totalRays();
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"image\": \"%s\",\n", filename.c_str());
+    fprintf(fp, "  \"width\": %d,\n  \"height\": %d,\n  \"spp\": %d,\n  \"threads\": %d,\n",
+            scene.width, scene.height, spp, num_workers);
+    fprintf(fp, "  \"seconds\": %.6f,\n", seconds);
+    fprintf(fp, "  \"rays\": {\"camera\": %llu, \"bounce\": %llu, \"shadow\": %llu, \"total\": %llu},\n",
+            (unsigned long long)stats.cameraRays, (unsigned long long)stats.bounceRays,
+            (unsigned long long)stats.shadowRays, (unsigned long long)stats.totalRays());
+    fprintf(fp, "  \"mrays_per_second\": %.4f,\n", seconds > 0 ? rays / seconds * 1e-6 : 0.0);
+    fprintf(fp, "  \"traversal\": {\"nodes_visited\": %llu, \"box_tests\": %llu, \"triangle_tests\": %llu,"
+                " \"sphere_tests\": %llu, \"nodes_per_ray\": %.3f, \"triangles_per_ray\": %.3f},\n",
+            (unsigned long long)stats.nodesVisited, (unsigned long long)stats.boxTests,
+            (unsigned long long)stats.triangleTests, (unsigned long long)stats.sphereTests,
+            rays > 0 ? stats.nodesVisited / rays : 0.0, rays > 0 ? stats.triangleTests / rays : 0.0);
+    fprintf(fp, "  \"bvh\": {\"interior_nodes\": %d, \"leaf_nodes\": %d, \"primitives\": %d},\n",
+            interiorNodes.load(), totalLeafNodes.load(), totalPrimitives.load());
+    fprintf(fp, "  \"path_length_histogram\": [");
+    for (int i = 0; i <= RayStats::maxPathLength; ++i)
+        fprintf(fp, "%s%llu", i ? ", " : "", (unsigned long long)stats.pathLength[i]);
+    fprintf(fp, "]\n}\n");
+    fclose(fp);
+}
+
+/**
+ * @brief 调试渲染：输出每像素平均BVH节点访问数、图元求交数与路径长度的伪彩色图
+ *        （binary_nodes.ppm、binary_prims.ppm、binary_pathlen.ppm），
+ *        并将场景BVH与各网格BVH的逐层SAH开销写入binary_bvh.txt，用于按资产调整maxPrimsInNode与划分策略
+ */
+void Renderer::RenderDebug(const Scene &scene, int spp, const int num_workers)
+{
+    std::string base = filename.substr(0, filename.find_last_of('.'));
+
+    std::ofstream summary(base + "_bvh.txt");
+    summary << "scene BVH (" << scene.objects.size() << " objects)\n";
+    if (scene.bvh)
+        scene.bvh->printSAHSummary(summary);
+    for (auto object : scene.objects)
+        if (auto mesh = dynamic_cast<MeshTriangle *>(object); mesh && mesh->bvh)
+        {
+            summary << "\nmesh BVH (" << mesh->triangles.size() << " triangles)\n";
+            mesh->bvh->printSAHSummary(summary);
+        }
+    summary.close();
+    if (verbose)
+        std::cout << "BVH SAH summary written to " << base << "_bvh.txt\n";
+
+    if (!Stats::enabled)
+    {
+        std::cerr << "RenderDebug: per-pixel cost images require building with -DRT_STATS\n";
+        return;
+    }
+
+    int n = scene.width * scene.height;
+    std::vector<float> nodes(n), prims(n), pathlen(n);
+
+    float scale = tan(deg2rad(scene.fov * 0.5));
+    float imageAspectRatio = scene.width / (float)scene.height;
+    Vector3f eye_pos(278, 273, -800);
+
+    int width = std::sqrt(1.0 * spp * scene.width / scene.height);
+    int height = std::sqrt(1.0 * spp * scene.height / scene.width);
+
+    float wstep = 1.0f / width;
+    float hstep = 1.0f / height;
+
+    omp_set_num_threads(num_workers);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (uint32_t j = 0; j < scene.height; ++j)
+    {
+        for (uint32_t i = 0; i < scene.width; ++i)
+        {
+            int m = j * scene.width + i;
+            RayCost cost;
+            for (int k = 0; k < spp; k++)
+            {
+                float x = (2 * (i + wstep / 2 + wstep * (k % width)) / (float)scene.width - 1) *
+                        imageAspectRatio * scale;
+                float y = (1 - 2 * (j + hstep / 2 + hstep * (k / height)) / (float)scene.height) * scale;
+
+                Vector3f dir = normalize(Vector3f(-x, y, 1));
+                scene.castRayCost(Ray(eye_pos, dir), cost);
+            }
+            nodes[m] = (float)cost.nodesVisited / spp;
+            prims[m] = (float)cost.primitiveTests / spp;
+            pathlen[m] = (float)cost.pathVertices / spp;
+        }
+    }
+
+    saveHeatmap(scene, nodes, base + "_nodes.ppm");
+    saveHeatmap(scene, prims, base + "_prims.ppm");
+    saveHeatmap(scene, pathlen, base + "_pathlen.ppm");
+}
+
+/**
+ * @brief 以turbo色表输出伪彩色图，取值按第99百分位数归一化以免个别像素压缩色阶
+ */
+void Renderer::saveHeatmap(const Scene &scene, const std::vector<float> &values, const std::string &path) const
+{
+    std::vector<float> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    float maxValue = std::max(sorted[(sorted.size() - 1) * 99 / 100], 1e-6f);
+    double mean = 0;
+    for (float v : values)
+        mean += v;
+    mean /= values.size();
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        std::cerr << "Cannot open " << path << " for writing\n";
+        return;
+    }
     (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i)
+    for (float v : values)
     {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
+        // turbo色表的多项式近似
+        float t = clamp(0, 1, v / maxValue);
+        float r = 0.13572138f + t * (4.61539260f + t * (-42.66032258f + t * (132.13108234f + t * (-152.94239396f + t * 59.28637943f))));
+        float g = 0.09140261f + t * (2.19418839f + t * (4.84296658f + t * (-14.18503333f + t * (4.27729857f + t * 2.82956604f))));
+        float b = 0.10667330f + t * (12.64194608f + t * (-60.58204836f + t * (110.36276771f + t * (-89.90310912f + t * 27.34824973f))));
+        unsigned char color[3] = {(unsigned char)(255 * clamp(0, 1, r)), (unsigned char)(255 * clamp(0, 1, g)),
+                                  (unsigned char)(255 * clamp(0, 1, b))};
         fwrite(color, 1, 3, fp);
     }
     fclose(fp);
+    if (verbose)
+        std::cout << path << ": mean " << mean << ", color range [0, " << maxValue << "] (p99)\n";
 }
\ No newline at end of file
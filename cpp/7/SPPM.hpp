@@ -0,0 +1,360 @@
+#pragma once
+
+#include "Scene.hpp"
+#include "global.hpp"
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * \brief 随机渐进式光子映射（SPPM）：每轮先从相机出发，经镜面反射到达第一个非镜面表面，
+ * 在该处记录可见点并计算直接光照；再从面光源发射光子，光子在非镜面表面上（第一次弹射之后）
+ * 被半径内的可见点收集。每个像素的收集半径按α逐轮收缩，统计量逐轮累积，估计随轮数增加收敛到无偏解。
+ * 镜面反射到漫反射表面上的焦散由光子携带，路径追踪从相机一侧几乎无法采样到。
+ * 所有存储（每像素的统计量与可见点的哈希网格）只与像素数有关，不随轮数增长
+ */
+
+struct SPPMSettings
+{
+    // 每轮发射的光子数，<=0时取像素数
+    int photonsPerPass = 0;
+    // 初始收集半径（世界坐标），<=0时取场景包围盒最长边的1/100
+    float initialRadius = 0;
+    // 每轮新收集的光子保留的比例α，越小半径收缩越快
+    float alpha = 2.0f / 3;
+    // 相机路径经镜面反射的最大次数，光子路径的最大弹射次数
+    int maxCameraDepth = 8;
+    int maxPhotonDepth = 8;
+};
+
+// 一个像素在本轮的可见点与跨轮累积的统计量
+struct SPPMPixel
+{
+    Vector3f p, N;          // 可见点的位置与着色法线
+    Vector3f wi;            // 到达可见点的相机光线方向
+    Vector3f beta;          // 相机路径的吞吐量，为0时本轮没有可见点
+    const Material *m = nullptr;
+    Vector3f albedo;        // 纹理材质在可见点处的反照率
+
+    float radius = 0;       // 收集半径
+    float count = 0;        // 累积的光子数N
+    Vector3f tau;           // 半径内累积的通量
+    Vector3f Ld;            // 相机路径上累积的直接光照（含经镜面看到的光源）
+    std::atomic<float> phi[3];
+    std::atomic<int> M;     // 本轮收集到的光子数
+
+    SPPMPixel()
+    {
+        for (auto &c : phi)
+            c.store(0, std::memory_order_relaxed);
+        M.store(0, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * \brief 可见点的哈希网格：格子边长为最大收集半径的两倍，每个可见点放入其收集球覆盖的格子（每轴至多两个），
+ * 格子坐标散列到与像素数等长的表中。每轮先并行计数、前缀和，再并行填入，表项数至多为像素数的8倍，
+ * 两轮之间复用同一块内存
+ */
+class PhotonGrid
+{
+public:
+    void build(const std::vector<SPPMPixel> &pixels);
+
+    // 对点p所在格子中的可见点（像素下标）调用f，散列冲突的其他格子的可见点需由调用者按距离排除
+    template <typename F>
+    void forEach(const Vector3f &p, F &&f) const
+    {
+        int x, y, z;
+        if (empty || !cellOf(p, x, y, z))
+            return;
+        uint32_t h = hash(x, y, z);
+        for (uint32_t k = offsets[h]; k < offsets[h + 1]; ++k)
+            f(entries[k]);
+    }
+
+    size_t bytes() const
+    {
+        return offsets.capacity() * sizeof(uint32_t) + entries.capacity() * sizeof(uint32_t) + size * sizeof(std::atomic<uint32_t>);
+    }
+
+private:
+    Bounds3 bounds;
+    float cellSize = 1;
+    int resolution[3] = {1, 1, 1};
+    bool empty = true;
+    size_t size = 0;
+    std::vector<uint32_t> offsets; // 各散列项在entries中的起点，长度size + 1
+    std::vector<uint32_t> entries;
+    std::unique_ptr<std::atomic<uint32_t>[]> cursor;
+
+    bool cellOf(const Vector3f &p, int &x, int &y, int &z) const
+    {
+        Vector3f c = (p - bounds.pMin) / cellSize;
+        x = (int)std::floor(c.x), y = (int)std::floor(c.y), z = (int)std::floor(c.z);
+        return x >= 0 && y >= 0 && z >= 0 && x < resolution[0] && y < resolution[1] && z < resolution[2];
+    }
+
+    uint32_t hash(int x, int y, int z) const
+    {
+        return (uint32_t)(((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u)) % size;
+    }
+
+    // 可见点收集球覆盖的格子范围
+    void cellRange(const SPPMPixel &pixel, int lo[3], int hi[3]) const
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            lo[a] = std::max(0, (int)std::floor((pixel.p[a] - pixel.radius - bounds.pMin[a]) / cellSize));
+            hi[a] = std::min(resolution[a] - 1, (int)std::floor((pixel.p[a] + pixel.radius - bounds.pMin[a]) / cellSize));
+        }
+    }
+};
+
+inline void PhotonGrid::build(const std::vector<SPPMPixel> &pixels)
+{
+    int n = pixels.size();
+    if (size != (size_t)n)
+    {
+        size = n;
+        cursor.reset(new std::atomic<uint32_t>[size]);
+        offsets.assign(size + 1, 0);
+    }
+
+    bounds = Bounds3();
+    float maxRadius = 0;
+    for (const SPPMPixel &pixel : pixels)
+        if (luminance(pixel.beta) > 0)
+        {
+            bounds = Union(bounds, pixel.p - Vector3f(pixel.radius));
+            bounds = Union(bounds, pixel.p + Vector3f(pixel.radius));
+            maxRadius = std::max(maxRadius, pixel.radius);
+        }
+    empty = maxRadius <= 0;
+    if (empty)
+        return;
+    cellSize = 2 * maxRadius;
+    Vector3f d = bounds.Diagonal();
+    for (int a = 0; a < 3; ++a)
+        resolution[a] = std::max(1, (int)std::ceil(d[a] / cellSize));
+
+#pragma omp parallel for
+    for (int h = 0; h < n; ++h)
+        cursor[h].store(0, std::memory_order_relaxed);
+
+    // 计数
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int m = 0; m < n; ++m)
+    {
+        if (!(luminance(pixels[m].beta) > 0))
+            continue;
+        int lo[3], hi[3];
+        cellRange(pixels[m], lo, hi);
+        for (int z = lo[2]; z <= hi[2]; ++z)
+            for (int y = lo[1]; y <= hi[1]; ++y)
+                for (int x = lo[0]; x <= hi[0]; ++x)
+                    cursor[hash(x, y, z)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 前缀和
+    uint32_t total = 0;
+    for (size_t h = 0; h < size; ++h)
+    {
+        offsets[h] = total;
+        total += cursor[h].load(std::memory_order_relaxed);
+        cursor[h].store(offsets[h], std::memory_order_relaxed);
+    }
+    offsets[size] = total;
+    entries.resize(total);
+
+    // 填入
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int m = 0; m < n; ++m)
+    {
+        if (!(luminance(pixels[m].beta) > 0))
+            continue;
+        int lo[3], hi[3];
+        cellRange(pixels[m], lo, hi);
+        for (int z = lo[2]; z <= hi[2]; ++z)
+            for (int y = lo[1]; y <= hi[1]; ++y)
+                for (int x = lo[0]; x <= hi[0]; ++x)
+                    entries[cursor[hash(x, y, z)].fetch_add(1, std::memory_order_relaxed)] = m;
+    }
+}
+
+namespace sppm
+{
+    // 场景包围盒最长边的1/100
+    inline float defaultRadius(const Scene &scene)
+    {
+        Bounds3 bounds;
+        for (Object *object : scene.get_objects())
+            bounds = Union(bounds, object->getBounds());
+        Vector3f d = bounds.Diagonal();
+        return std::max(d.x, std::max(d.y, d.z)) / 100;
+    }
+
+    // 可见点处的BSDF值，wo为指向光子来处的方向
+    inline Vector3f evalVisible(const SPPMPixel &pixel, const Vector3f &wo)
+    {
+        return pixel.m->dispatch([&](const auto &kernel)
+                                 {
+                                     if (!(pixel.m->flags() & MATERIAL_TEXTURED))
+                                         return kernel.eval(pixel.wi, wo, pixel.N);
+                                     auto textured = kernel;
+                                     bsdf::setAlbedo(textured, pixel.albedo, 0);
+                                     return textured.eval(pixel.wi, wo, pixel.N); });
+    }
+
+    /**
+     * @brief 相机路径：经镜面反射直到第一个非镜面表面，在其上记录可见点并计算直接光照（环境光不与BSDF采样做MIS，
+     *        光子不携带环境光）；途中看到的光源与环境光计入Ld
+     */
+    inline void traceCamera(const Scene &scene, Ray ray, SPPMPixel &pixel, const SPPMSettings &settings)
+    {
+        pixel.beta = Vector3f();
+        Vector3f beta(1.0f);
+        for (int depth = 0; depth <= settings.maxCameraDepth; ++depth)
+        {
+            if (depth == 0)
+                STAT_INC(cameraRays);
+            else
+                STAT_INC(bounceRays);
+            Intersection inter = scene.intersect(ray);
+            if (!inter.happened)
+            {
+                if (scene.environment)
+                    pixel.Ld += beta * scene.environment->eval(ray.direction);
+                return;
+            }
+            if (inter.m->flags() & MATERIAL_EMISSIVE)
+            {
+                pixel.Ld += beta * inter.m->getEmission();
+                return;
+            }
+
+            Vector3f N = scene.shadingNormal(ray, inter);
+            bool specular = scene.dispatchShading(ray, inter, N, [&](const auto &bsdf)
+                                                  {
+                                                      using BSDFType = std::decay_t<decltype(bsdf)>;
+                                                      if constexpr (BSDFType::flags & MATERIAL_DELTA)
+                                                      {
+                                                          Vector3f dir = bsdf.sample(ray.direction, N).normalized();
+                                                          float pdf = bsdf.pdf(ray.direction, dir, N);
+                                                          if (pdf <= EPSILON)
+                                                              return false;
+                                                          beta = beta * bsdf.eval(ray.direction, dir, N) * dotProduct(dir, N) / pdf;
+                                                          // 镜面反射不展宽光锥
+                                                          Ray next(inter.coords, dir);
+                                                          float spread = ray.coneSpread > 0 ? ray.coneSpread : scene.pixelSpreadAngle();
+                                                          next.coneWidth = ray.coneWidth + spread * inter.distance;
+                                                          next.coneSpread = spread;
+                                                          ray = next;
+                                                          return true;
+                                                      }
+                                                      else
+                                                      {
+                                                          pixel.Ld += beta * scene.directLight(bsdf, ray, inter, N, true, false);
+                                                          pixel.p = inter.coords;
+                                                          pixel.N = N;
+                                                          pixel.wi = ray.direction;
+                                                          pixel.beta = beta;
+                                                          pixel.m = inter.m;
+                                                          if (inter.m->flags() & MATERIAL_TEXTURED)
+                                                              pixel.albedo = scene.textureAlbedo(ray, inter, N);
+                                                          return false;
+                                                      } });
+            if (!specular || !(luminance(beta) > 0))
+                return;
+        }
+    }
+
+    /**
+     * @brief 从面光源按面积采样一点、按余弦分布发射一个光子，沿路径在非镜面表面上沉积到附近的可见点；
+     *        光源出发后的第一个交点是直接光照，已由相机一侧计算，不沉积
+     */
+    inline void tracePhoton(const Scene &scene, const PhotonGrid &grid, std::vector<SPPMPixel> &pixels, const SPPMSettings &settings)
+    {
+        Intersection light;
+        float pdf;
+        scene.sampleLight(light, pdf);
+        if (!(pdf > 0))
+            return;
+        float u1 = get_random_float(), u2 = get_random_float();
+        float r = std::sqrt(u1), phi = 2 * M_PI * u2;
+        Vector3f dir = bsdf::toWorld(Vector3f(r * std::cos(phi), r * std::sin(phi), std::sqrt(std::max(0.0f, 1 - u1))), light.normal);
+        // 余弦分布下cosθ / pdf(ω) = π
+        Vector3f beta = light.emit * M_PI / pdf;
+        Ray ray(light.coords, dir);
+
+        for (int depth = 0; depth < settings.maxPhotonDepth; ++depth)
+        {
+            STAT_INC(bounceRays);
+            Intersection inter = scene.intersect(ray);
+            if (!inter.happened || (inter.m->flags() & MATERIAL_EMISSIVE))
+                return;
+            Vector3f N = scene.shadingNormal(ray, inter);
+            bool alive = scene.dispatchShading(ray, inter, N, [&](const auto &bsdf)
+                                               {
+                                                   using BSDFType = std::decay_t<decltype(bsdf)>;
+                                                   if constexpr (!(BSDFType::flags & MATERIAL_DELTA))
+                                                       if (depth > 0)
+                                                           grid.forEach(inter.coords, [&](uint32_t index)
+                                                                        {
+                                                                            SPPMPixel &pixel = pixels[index];
+                                                                            Vector3f d = pixel.p - inter.coords;
+                                                                            if (dotProduct(d, d) > pixel.radius * pixel.radius)
+                                                                                return;
+                                                                            Vector3f phi = beta * evalVisible(pixel, -ray.direction);
+                                                                            atomicAdd(pixel.phi[0], phi.x);
+                                                                            atomicAdd(pixel.phi[1], phi.y);
+                                                                            atomicAdd(pixel.phi[2], phi.z);
+                                                                            pixel.M.fetch_add(1, std::memory_order_relaxed); });
+
+                                                   Vector3f next = bsdf.sample(ray.direction, N).normalized();
+                                                   float pdf = bsdf.pdf(ray.direction, next, N);
+                                                   if (pdf <= EPSILON)
+                                                       return false;
+                                                   Vector3f betaNew = beta * bsdf.eval(ray.direction, next, N) * std::fabs(dotProduct(next, N)) / pdf;
+                                                   // 俄罗斯轮盘赌：按吞吐量的衰减比例终止
+                                                   float q = std::max(0.0f, 1 - luminance(betaNew) / luminance(beta));
+                                                   if (get_random_float() < q)
+                                                       return false;
+                                                   beta = betaNew / (1 - q);
+                                                   ray = Ray(inter.coords, next);
+                                                   return true; });
+            if (!alive)
+                return;
+        }
+    }
+
+    // 一轮结束后按本轮收集的光子数收缩半径并累积通量：N' = N + αM，R' = R sqrt(N' / (N + M))
+    inline void update(SPPMPixel &pixel, float alpha)
+    {
+        int M = pixel.M.load(std::memory_order_relaxed);
+        if (M > 0)
+        {
+            float count = pixel.count + alpha * M;
+            float radius = pixel.radius * std::sqrt(count / (pixel.count + M));
+            Vector3f phi(pixel.phi[0].load(std::memory_order_relaxed), pixel.phi[1].load(std::memory_order_relaxed),
+                         pixel.phi[2].load(std::memory_order_relaxed));
+            pixel.tau = (pixel.tau + pixel.beta * phi) * (radius * radius) / (pixel.radius * pixel.radius);
+            pixel.count = count;
+            pixel.radius = radius;
+            for (auto &c : pixel.phi)
+                c.store(0, std::memory_order_relaxed);
+            pixel.M.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // passes轮后像素的辐射亮度估计：直接光照的平均值加上光子的密度估计
+    inline Vector3f radiance(const SPPMPixel &pixel, int passes, long long photonsPerPass)
+    {
+        Vector3f L = pixel.Ld / passes;
+        if (pixel.radius > 0)
+            L += pixel.tau / ((float)passes * photonsPerPass * M_PI * pixel.radius * pixel.radius);
+        return L;
+    }
+}
@@ -6,7 +6,33 @@
 #include "Light.hpp"
 #include "AreaLight.hpp"
 #include "BVH.hpp"
+#include "EnvironmentLight.hpp"
+#include "LightBVH.hpp"
+#include "PathGuide.hpp"
+#include "RadianceCache.hpp"
 #include "Ray.hpp"
+#include "MemoryArena.hpp"
+#include "Stats.hpp"
+
+// 一条相机光线（含其后续整条路径）的开销，用于调试热力图
+struct RayCost
+{
+    uint64_t nodesVisited = 0;
+    uint64_t primitiveTests = 0;
+    uint64_t pathVertices = 0;
+};
+
+// 相机光线的首个交点（G-buffer中的一个像素）
+struct PrimaryHit
+{
+    Ray ray;
+    Intersection inter;
+    Vector3f N;           // 着色法线
+    Vector3f Le;          // 未命中表面时的环境光，或命中光源时的自发光
+    bool surface = false; // 是否命中非光源表面
+
+    explicit PrimaryHit(const Ray &ray) : ray(ray) {}
+};
 
 class Scene
 {
@@ -20,6 +46,26 @@ public:
     float RussianRoulette = 0.8;
 
     Scene(int w, int h) : width(w), height(h) {}
+    ~Scene()
+    {
+        delete bvh;
+        delete lightBVH;
+    }
+    Scene(const Scene &) = delete;
+    Scene &operator=(const Scene &) = delete;
+
+    /**
+     * \brief 在场景内存池中创建对象（材质、网格等），随场景析构一次性释放。
+     * 材质同时登记到材质表，buildBVH时提交
+     */
+    template <typename T, typename... Args>
+    T *Create(Args &&...args)
+    {
+        T *obj = arena.Create<T>(std::forward<Args>(args)...);
+        if constexpr (std::is_same<T, Material>::value)
+            materials.add(obj);
+        return obj;
+    }
 
     void Add(Object *object) { objects.push_back(object); }
     void Add(std::unique_ptr<Light> light) { lights.push_back(std::move(light)); }
@@ -27,10 +73,52 @@ public:
     const std::vector<Object *> &get_objects() const { return objects; }
     const std::vector<std::unique_ptr<Light>> &get_lights() const { return lights; }
     Intersection intersect(const Ray &ray) const;
-    BVHAccel *bvh;
-    void buildBVH();
+    BVHAccel *bvh = nullptr;
+    void buildBVH(BVHAccel::SplitMethod splitMethod = BVHAccel::SplitMethod::NAIVE);
+    // 物体移动后更新场景BVH（重新拟合，质量下降时重建），光源层次结构随之重建
+    BVHAccel::UpdateResult updateBVH()
+    {
+        BVHAccel::UpdateResult result = bvh->update();
+        buildLightBVH();
+        geometryGeneration = nextGeneration();
+        return result;
+    }
+    // 几何体的代数：每次buildBVH或updateBVH后取一个全局唯一的新值，缓存了交点的对象据此判断是否失效
+    uint64_t geometryGeneration = 0;
+    // 自发光图元的层次结构，按对着色点的重要性采样光源；为空时按面积采样
+    LightBVH *lightBVH = nullptr;
+    // 为false时不建立光源层次结构（用于对比）
+    bool useLightBVH = true;
+    void buildLightBVH();
     Vector3f castRay(const Ray &ray, int depth) const;
+    // 相机光线的光锥扩散角（一个像素对应的角度）
+    float pixelSpreadAngle() const { return 2 * std::tan(fov * M_PI / 360) / height; }
+    // 非镜面反射后光锥扩散角的增量（弧度）
+    float roughConeSpread = 0.2f;
+    // 路径在一个非光源表面上的着色，按材质类型特化；sampleAreaLights为false时不计面光源的直接光照
+    template <typename BSDFType>
+    Vector3f shade(const BSDFType &bsdf, const Ray &ray, const Intersection &inter, const Vector3f &N, int depth,
+                   bool sampleAreaLights = true) const;
+    // 着色点上对面光源与环境光采样的直接光照；misEnvironment为false时环境光不与BSDF采样做多重重要性采样。
+    // 方向按路径引导与BSDF混合采样时（guideTree可用），多重重要性采样中BSDF一侧的概率密度取同样的混合
+    template <typename BSDFType>
+    Vector3f directLight(const BSDFType &bsdf, const Ray &ray, const Intersection &inter, const Vector3f &N,
+                         bool sampleAreaLights = true, bool misEnvironment = true,
+                         const DTree *guideTree = nullptr, float bsdfFraction = 1) const;
+    // 交点处的着色法线（双面材质朝向光线一侧）
+    Vector3f shadingNormal(const Ray &ray, const Intersection &inter) const;
+    // 纹理材质在交点处按光锥足迹过滤后的反照率
+    Vector3f textureAlbedo(const Ray &ray, const Intersection &inter, const Vector3f &N) const;
+    // 按交点的材质类型调用f(bsdf)，纹理材质已代入交点处的反照率
+    template <typename F>
+    auto dispatchShading(const Ray &ray, const Intersection &inter, const Vector3f &N, F &&f) const;
+    // 相机光线的首个交点，及在其上继续路径追踪（供在像素间复用着色点的渲染方式使用）
+    PrimaryHit tracePrimary(const Ray &ray) const;
+    Vector3f shadePrimary(const PrimaryHit &hit, bool sampleAreaLights = true) const;
+    Vector3f castRayCost(const Ray &ray, RayCost &cost) const;
     void sampleLight(Intersection &pos, float &pdf) const;
+    // 为着色点p（法线n）采样光源，有光源层次结构时按重要性选择光源
+    void sampleLight(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf) const;
     bool trace(const Ray &ray, const std::vector<Object *> &objects, float &tNear, uint32_t &index, Object **hitObject);
     std::tuple<Vector3f, Vector3f> HandleAreaLight(const AreaLight &light, const Vector3f &hitPoint, const Vector3f &N,
                                                    const Vector3f &shadowPointOrig,
@@ -40,6 +128,26 @@ public:
     // creating the scene (adding objects and lights)
     std::vector<Object *> objects;
     std::vector<std::unique_ptr<Light>> lights;
+    // 环境光（可选），逃出场景的光线取其辐射亮度，并与BSDF采样做多重重要性采样
+    EnvironmentLight *environment = nullptr;
+    // 路径引导（可选），由渐进式渲染在各轮之间学习
+    PathGuide *guide = nullptr;
+    // 创建覆盖整个场景的路径引导，需在buildBVH之后调用
+    void enablePathGuiding();
+    // 辐射亮度缓存（可选），第depth次弹射及之后的漫反射表面查询缓存而不再继续追踪
+    RadianceCache *radianceCache = nullptr;
+    // 创建覆盖整个场景的辐射亮度缓存，需在buildBVH之后调用
+    void enableRadianceCache();
+    // 场景拥有的材质与网格
+    MemoryArena arena;
+    // 按类型分开存放的材质核函数
+    MaterialTable materials;
+
+    static uint64_t nextGeneration()
+    {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
 
     // Compute reflection direction
     Vector3f reflect(const Vector3f &I, const Vector3f &N) const
@@ -114,10 +222,44 @@ public:
     }
 };
 
-void Scene::buildBVH()
+void Scene::buildBVH(BVHAccel::SplitMethod splitMethod)
+{
+    if (BVHAccel::verbose)
+        printf(" - Generating BVH...\n\n");
+    materials.commit();
+    delete this->bvh;
+    this->bvh = new BVHAccel(objects, 1, splitMethod);
+    buildLightBVH();
+    geometryGeneration = nextGeneration();
+}
+
+void Scene::enablePathGuiding()
+{
+    Bounds3 bounds;
+    for (Object *object : objects)
+        bounds = Union(bounds, object->getBounds());
+    guide = Create<PathGuide>(bounds);
+}
+
+void Scene::enableRadianceCache()
+{
+    Bounds3 bounds;
+    for (Object *object : objects)
+        bounds = Union(bounds, object->getBounds());
+    radianceCache = Create<RadianceCache>(bounds);
+}
+
+void Scene::buildLightBVH()
 {
-    printf(" - Generating BVH...\n\n");
-    this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    delete lightBVH;
+    lightBVH = nullptr;
+    if (!useLightBVH)
+        return;
+    std::vector<Object *> emitters;
+    for (Object *object : objects)
+        object->collectEmitters(emitters);
+    if (!emitters.empty())
+        lightBVH = new LightBVH(emitters);
 }
 
 Intersection Scene::intersect(const Ray &ray) const
@@ -135,7 +277,12 @@ void Scene::sampleLight(Intersection &pos, float &pdf) const
             emit_area_sum += objects[k]->getArea();
         }
     }
-    float p = get_random_float() * emit_area_sum;
+    // 没有面光源
+    pdf = 0;
+    if (emit_area_sum <= 0)
+        return;
+    float total = emit_area_sum;
+    float p = get_random_float() * total;
     emit_area_sum = 0;
     for (uint32_t k = 0; k < objects.size(); ++k)
     {
@@ -144,13 +291,23 @@ void Scene::sampleLight(Intersection &pos, float &pdf) const
             emit_area_sum += objects[k]->getArea();
             if (p <= emit_area_sum)
             {
+                // 物体内按面积均匀采样，再乘以按面积选中该物体的概率
                 objects[k]->Sample(pos, pdf);
+                pdf *= objects[k]->getArea() / total;
                 break;
             }
         }
     }
 }
 
+void Scene::sampleLight(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf) const
+{
+    if (lightBVH)
+        lightBVH->sample(p, n, pos, pdf);
+    else
+        sampleLight(pos, pdf);
+}
+
 bool Scene::trace(
     const Ray &ray,
     const std::vector<Object *> &objects,
@@ -173,69 +330,250 @@ bool Scene::trace(
     return (*hitObject != nullptr);
 }
 
+Vector3f Scene::shadingNormal(const Ray &ray, const Intersection &inter) const
+{
+    if ((inter.m->flags() & MATERIAL_TWO_SIDED) && dotProduct(ray.direction, inter.normal) > 0)
+        return -inter.normal;
+    return inter.normal;
+}
+
+Vector3f Scene::textureAlbedo(const Ray &ray, const Intersection &inter, const Vector3f &N) const
+{
+    // 光锥在交点处的宽度换算为纹理空间的足迹，选择mip层
+    float spread = ray.coneSpread > 0 ? ray.coneSpread : pixelSpreadAngle();
+    float width = ray.coneWidth + spread * inter.distance;
+    float cosTheta = std::max(std::fabs(dotProduct(ray.direction, N)), 0.05f);
+    return inter.m->getColorAt(inter.tcoords.x, inter.tcoords.y, width * inter.uvScale / cosTheta);
+}
+
+template <typename F>
+auto Scene::dispatchShading(const Ray &ray, const Intersection &inter, const Vector3f &N, F &&f) const
+{
+    const Material &material = *inter.m;
+    if (!(material.flags() & MATERIAL_TEXTURED))
+        return material.dispatch(f);
+
+    Vector3f albedo = textureAlbedo(ray, inter, N);
+    return material.dispatch([&](const auto &kernel)
+                             {
+                                 auto textured = kernel;
+                                 bsdf::setAlbedo(textured, albedo, 0);
+                                 return f(textured); });
+}
+
 // Implementation of Path Tracing
 Vector3f Scene::castRay(const Ray &ray, int depth) const
 {
     // TO DO Implement Path Tracing Algorithm here
+    if (depth == 0)
+        STAT_INC(cameraRays);
+    else
+        STAT_INC(bounceRays);
     Intersection inter_obj = this->intersect(ray);
 
-    if (!inter_obj.happened) // 若光线与场景没有交点，返回0
-        return Vector3f();
-    
-    if (inter_obj.m->hasEmission()) // 若光线打到光源，则返回emission
-        return inter_obj.m->getEmission();
+    if (!inter_obj.happened) // 若光线与场景没有交点，返回环境光（没有时为0）
+    {
+        STAT_PATH_LENGTH(depth);
+        return environment ? environment->eval(ray.direction) : Vector3f();
+    }
     
-    Vector3f L_dir, L_indir;
+    const Material &material = *inter_obj.m;
+    if (material.flags() & MATERIAL_EMISSIVE) // 若光线打到光源，则返回emission
+    {
+        STAT_PATH_LENGTH(depth + 1);
+        return material.getEmission();
+    }
 
-    switch (inter_obj.m->getType())
+    Vector3f N = shadingNormal(ray, inter_obj);
+    return dispatchShading(ray, inter_obj, N, [&](const auto &bsdf)
+                           { return shade(bsdf, ray, inter_obj, N, depth); });
+}
+
+PrimaryHit Scene::tracePrimary(const Ray &ray) const
+{
+    PrimaryHit hit(ray);
+    STAT_INC(cameraRays);
+    hit.inter = this->intersect(ray);
+    if (!hit.inter.happened)
     {
-    case DIFFUSE: //漫反射
+        STAT_PATH_LENGTH(0);
+        hit.Le = environment ? environment->eval(ray.direction) : Vector3f();
+        return hit;
+    }
+    if (hit.inter.m->flags() & MATERIAL_EMISSIVE)
     {
-        // 采样光源
-        Intersection inter_light;
-        float pdf_light;
-        this->sampleLight(inter_light, pdf_light);
+        STAT_PATH_LENGTH(1);
+        hit.Le = hit.inter.m->getEmission();
+        return hit;
+    }
+    hit.N = shadingNormal(ray, hit.inter);
+    hit.surface = true;
+    return hit;
+}
 
-        Vector3f obj2light = inter_light.coords - inter_obj.coords;
-        Vector3f obj2light_dir = obj2light.normalized();
-        if (this->intersect(Ray(inter_obj.coords, obj2light_dir)).distance - obj2light.norm() > -EPSILON)
+Vector3f Scene::shadePrimary(const PrimaryHit &hit, bool sampleAreaLights) const
+{
+    if (!hit.surface)
+        return hit.Le;
+    return dispatchShading(hit.ray, hit.inter, hit.N, [&](const auto &bsdf)
+                           { return shade(bsdf, hit.ray, hit.inter, hit.N, 0, sampleAreaLights); });
+}
+
+template <typename BSDFType>
+Vector3f Scene::directLight(const BSDFType &bsdf, const Ray &ray, const Intersection &inter_obj, const Vector3f &N,
+                            bool sampleAreaLights, bool misEnvironment, const DTree *guideTree, float bsdfFraction) const
+{
+    Vector3f L_dir;
+    // 采样光源（面光源的直接光照由调用者另行计算时跳过）
+    Intersection inter_light;
+    float pdf_light = 0;
+    if (sampleAreaLights)
+        this->sampleLight(inter_obj.coords, N, inter_light, pdf_light);
+
+    Vector3f obj2light = inter_light.coords - inter_obj.coords;
+    Vector3f obj2light_dir = obj2light.normalized();
+    // 面光源单面发光，着色点在光源背面时没有贡献，也不必发射阴影光线
+    if (dotProduct(-obj2light_dir, inter_light.normal) <= 0)
+        pdf_light = 0;
+    if (pdf_light > 0)
+        STAT_INC(shadowRays);
+    if (pdf_light > 0 && this->intersect(Ray(inter_obj.coords, obj2light_dir)).distance - obj2light.norm() > -EPSILON)
+    {
+        L_dir = inter_light.emit * 
+        bsdf.eval(ray.direction, obj2light_dir, N) * 
+        dotProduct(obj2light_dir, N) *
+        dotProduct(-obj2light_dir, inter_light.normal) /
+        dotProduct(obj2light, obj2light) / 
+        pdf_light;
+    }
+
+    // 采样环境光，与BSDF采样按幂启发式加权
+    if (environment)
+    {
+        Vector3f env_dir;
+        float pdf_env;
+        Vector3f Le = environment->sample(env_dir, pdf_env);
+        float cos_env = dotProduct(env_dir, N);
+        if (pdf_env > 0 && cos_env > 0)
         {
-            L_dir = inter_light.emit * 
-            inter_obj.m->eval(ray.direction, obj2light_dir, inter_obj.normal) * 
-            dotProduct(obj2light_dir, inter_obj.normal) *
-            dotProduct(-obj2light_dir, inter_light.normal) /
-            dotProduct(obj2light, obj2light) / 
-            pdf_light;
+            STAT_INC(shadowRays);
+            if (!this->intersect(Ray(inter_obj.coords, env_dir)).happened)
+            {
+                float pdf_bsdf = bsdf.pdf(ray.direction, env_dir, N);
+                if (guideTree && guideTree->usable())
+                    pdf_bsdf = bsdfFraction * pdf_bsdf + (1 - bsdfFraction) * guideTree->pdf(env_dir);
+                L_dir += Le * bsdf.eval(ray.direction, env_dir, N) * cos_env / pdf_env *
+                         (misEnvironment ? powerHeuristic(pdf_env, pdf_bsdf) : 1.0f);
+            }
         }
     }
-    case GLOSSY:
+    return L_dir;
+}
+
+template <typename BSDFType>
+Vector3f Scene::shade(const BSDFType &bsdf, const Ray &ray, const Intersection &inter_obj, const Vector3f &N, int depth, bool sampleAreaLights) const
+{
+    Vector3f L_dir, L_indir;
+    bool extended = false; // 路径是否继续延伸
+
+    // 辐射亮度缓存只用于漫反射（出射辐射亮度与方向无关），缓存中存放除以反照率后的值
+    bool cacheRecord = false;
+    if constexpr (std::is_same<BSDFType, BSDF<DIFFUSE>>::value)
+        if (radianceCache && radianceCache->applies(depth))
+        {
+            Vector3f cached;
+            if (radianceCache->lookup(inter_obj.coords, N, cached))
+            {
+                STAT_PATH_LENGTH(depth + 1);
+                return cached * bsdf.Kd;
+            }
+            cacheRecord = true;
+        }
+
+    // 路径引导：按学到的入射辐射亮度分布与BSDF混合采样（delta分布只能按BSDF采样）
+    DTree *guideTree = nullptr;
+    if constexpr (!(BSDFType::flags & MATERIAL_DELTA))
+        if (guide)
+            guideTree = guide->lookup(inter_obj.coords);
+    bool guided = guideTree && guideTree->usable();
+    float bsdfFraction = guided ? guide->bsdfSamplingFraction : 1;
+
+    // delta分布的材质（镜面）不采样光源；环境光的多重重要性采样与下面的方向采样使用同一混合概率密度
+    if constexpr (!(BSDFType::flags & MATERIAL_DELTA))
+        L_dir = directLight(bsdf, ray, inter_obj, N, sampleAreaLights, true, guideTree, bsdfFraction);
+
+    // 俄罗斯轮盘赌
+    if (get_random_float() <= RussianRoulette)
     {
-        // 俄罗斯轮盘赌
-        if (get_random_float() <= RussianRoulette)
+        Vector3f obj2nobj_dir = guided && get_random_float() >= bsdfFraction ? guideTree->sample()
+                                                                             : bsdf.sample(ray.direction, N).normalized();
+        float pdf = bsdf.pdf(ray.direction, obj2nobj_dir, N);
+        if (guided)
+            pdf = bsdfFraction * pdf + (1 - bsdfFraction) * guideTree->pdf(obj2nobj_dir);
+        Ray nray(inter_obj.coords, obj2nobj_dir);
+        // 光锥沿路径延续，非镜面反射后按经验展宽
+        float spread = ray.coneSpread > 0 ? ray.coneSpread : pixelSpreadAngle();
+        nray.coneWidth = ray.coneWidth + spread * inter_obj.distance;
+        nray.coneSpread = (BSDFType::flags & MATERIAL_DELTA) ? spread : spread + roughConeSpread;
+        STAT_INC(bounceRays);
+        Intersection nextObjInter = this->intersect(nray);
+        Vector3f L_i; // 沿采样方向入射的辐射亮度（不含面光源，由光源采样计入）
+        // 光线逃出场景时计入环境光；delta分布无法采样光源，权重为1
+        if (!nextObjInter.happened && environment)
         {
-            Vector3f obj2nobj_dir = inter_obj.m->sample(ray.direction, inter_obj.normal).normalized();
-            Ray nray(inter_obj.coords, obj2nobj_dir);
-            Intersection nextObjInter = this->intersect(nray);
-            // 若光线命中非光源的物体
-            if (nextObjInter.happened && !nextObjInter.m->hasEmission()) 
+            if (pdf > EPSILON)
             {
-                // 计算概率密度函数值PDF
-                float pdf = inter_obj.m->pdf(ray.direction, obj2nobj_dir, inter_obj.normal);
-                if (pdf > EPSILON)
-                {
-                    L_indir = castRay(nray, depth + 1) * 
-                    inter_obj.m->eval(ray.direction, obj2nobj_dir, inter_obj.normal) * 
-                    dotProduct(obj2nobj_dir, inter_obj.normal) / 
-                    pdf / 
-                    RussianRoulette;
-                }
+                L_i = environment->eval(obj2nobj_dir);
+                float weight = (BSDFType::flags & MATERIAL_DELTA) ? 1 : powerHeuristic(pdf, environment->pdf(obj2nobj_dir));
+                L_indir = L_i *
+                bsdf.eval(ray.direction, obj2nobj_dir, N) *
+                dotProduct(obj2nobj_dir, N) / 
+                pdf / 
+                RussianRoulette * weight;
             }
         }
-        break;
-    }
-    default:
-        break;
+        // 若光线命中非光源的物体
+        else if (nextObjInter.happened && !(nextObjInter.m->flags() & MATERIAL_EMISSIVE)) 
+        {
+            if (pdf > EPSILON)
+            {
+                extended = true;
+                L_i = castRay(nray, depth + 1);
+                L_indir = L_i * 
+                bsdf.eval(ray.direction, obj2nobj_dir, N) * 
+                dotProduct(obj2nobj_dir, N) / 
+                pdf / 
+                RussianRoulette;
+            }
+        }
+        if (guideTree && pdf > EPSILON)
+            guideTree->record(obj2nobj_dir, luminance(L_i) / pdf);
     }
 
+    if (!extended)
+        STAT_PATH_LENGTH(depth + 1);
+    if constexpr (std::is_same<BSDFType, BSDF<DIFFUSE>>::value)
+        if (cacheRecord)
+        {
+            Vector3f L = L_dir + L_indir;
+            radianceCache->record(inter_obj.coords, N, Vector3f(bsdf.Kd.x > 0 ? L.x / bsdf.Kd.x : 0,
+                                                                bsdf.Kd.y > 0 ? L.y / bsdf.Kd.y : 0,
+                                                                bsdf.Kd.z > 0 ? L.z / bsdf.Kd.z : 0));
+        }
     return L_dir + L_indir;
+}
+
+/**
+ * @brief 调试积分器：与castRay相同的路径追踪，同时累加该路径的BVH节点访问数、图元求交数与路径顶点数
+ *        （依赖线程局部的统计计数器，需以 -DRT_STATS 编译）
+ */
+Vector3f Scene::castRayCost(const Ray &ray, RayCost &cost) const
+{
+    const RayStats &stats = Stats::local();
+    uint64_t nodes = stats.nodesVisited, prims = stats.triangleTests + stats.sphereTests, vertices = stats.pathVertices;
+    Vector3f L = castRay(ray, 0);
+    cost.nodesVisited += stats.nodesVisited - nodes;
+    cost.primitiveTests += stats.triangleTests + stats.sphereTests - prims;
+    cost.pathVertices += stats.pathVertices - vertices;
+    return L;
 }
\ No newline at end of file
@@ -0,0 +1,288 @@
+#pragma once
+
+#include "Scene.hpp"
+#include "Triangle.hpp"
+#include "Material.hpp"
+#include "PagedMesh.hpp"
+
+// HW7中的三个Cornell Box场景，材质与网格均由场景的内存池持有。
+// 场景的分辨率由调用者在构造Scene时指定，函数内部会构建场景BVH
+
+// 场景1，返回左墙（红色）的材质，供在多次渲染之间修改材质参数
+inline Material *buildCornellScene(Scene &scene)
+{
+    Material *red = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
+    Material *green = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+    Material *light = scene.Create<Material>(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
+    light->Kd = Vector3f(0.65f);
+
+    MeshTriangle *floor = scene.Create<MeshTriangle>("./models/cornellbox/floor.obj", white);
+    MeshTriangle *shortbox = scene.Create<MeshTriangle>("./models/cornellbox/shortbox.obj", white);
+    MeshTriangle *tallbox = scene.Create<MeshTriangle>("./models/cornellbox/tallbox.obj", white);
+    MeshTriangle *left = scene.Create<MeshTriangle>("./models/cornellbox/left.obj", red);
+    MeshTriangle *right = scene.Create<MeshTriangle>("./models/cornellbox/right.obj", green);
+    MeshTriangle *light_ = scene.Create<MeshTriangle>("./models/cornellbox/light.obj", light);
+
+    scene.Add(floor);
+    scene.Add(shortbox);
+    scene.Add(tallbox);
+    scene.Add(left);
+    scene.Add(right);
+    scene.Add(light_);
+
+    scene.buildBVH();
+    return red;
+}
+
+inline void buildScene1(Scene &scene) { buildCornellScene(scene); }
+
+// 棋盘格纹理图像（PPM）：size x size像素，每格cell像素，两种灰度交替。首次调用时写入Texture::directory，返回其路径
+inline std::string checkerTexture(int size = 512, int cell = 32)
+{
+    std::string path = Texture::directory + "/checker_" + std::to_string(size) + "_" + std::to_string(cell) + ".ppm";
+    if (std::filesystem::exists(path))
+        return path;
+    std::error_code ec;
+    std::filesystem::create_directories(Texture::directory, ec);
+    std::vector<unsigned char> bytes((size_t)size * size * 3);
+    for (int y = 0; y < size; ++y)
+        for (int x = 0; x < size; ++x)
+        {
+            unsigned char c = ((x / cell + y / cell) & 1) ? 230 : 40;
+            unsigned char *p = &bytes[((size_t)y * size + x) * 3];
+            p[0] = c, p[1] = c, p[2] = c;
+        }
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr)
+        return path;
+    fprintf(fp, "P6\n%d %d\n255\n", size, size);
+    fwrite(bytes.data(), 1, bytes.size(), fp);
+    fclose(fp);
+    return path;
+}
+
+// 纹理场景：场景1的布局，地面、天花板与后墙（floor_uv.obj，带纹理坐标）贴棋盘格纹理
+inline void buildTexturedScene(Scene &scene)
+{
+    Material *red = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
+    Material *green = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+    Material *checker = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    checker->diffuseTexture = scene.Create<Texture>(checkerTexture());
+    Material *light = scene.Create<Material>(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
+    light->Kd = Vector3f(0.65f);
+
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/floor_uv.obj", checker));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/shortbox.obj", white));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/tallbox.obj", white));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/left.obj", red));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/right.obj", green));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/light.obj", light));
+
+    scene.buildBVH();
+}
+
+// 场景2，返回其中的bunny供动画逐帧修改变换
+inline MeshTriangle *buildTurntableScene(Scene &scene)
+{
+    Material *red = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
+    Material *green = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+    Material *glossy_white = scene.Create<Material>(GLOSSY, Vector3f(0.0f));
+    glossy_white->Kd = Vector3f(0.0f, 0.0f, 0.0f);
+    glossy_white->ior = 40.0f;
+    Material *light = scene.Create<Material>(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
+    light->Kd = Vector3f(0.65f);
+
+    MeshTriangle *floor = scene.Create<MeshTriangle>("./models/cornellbox/floor.obj", white);
+    MeshTriangle *tallbox = scene.Create<MeshTriangle>("./models/cornellbox/tallbox.obj", glossy_white);
+    MeshTriangle *bunny = scene.Create<MeshTriangle>("./models/bunny/bunny.obj", glossy_white, Vector3f(200, -60, 150), Vector3f(-1500, 1500, -1500));
+    MeshTriangle *left = scene.Create<MeshTriangle>("./models/cornellbox/left.obj", red);
+    MeshTriangle *right = scene.Create<MeshTriangle>("./models/cornellbox/right.obj", green);
+    MeshTriangle *light_ = scene.Create<MeshTriangle>("./models/cornellbox/light.obj", light);
+
+    scene.Add(floor);
+    scene.Add(tallbox);
+    scene.Add(bunny);
+    scene.Add(left);
+    scene.Add(right);
+    scene.Add(light_);
+
+    scene.buildBVH();
+    return bunny;
+}
+
+inline void buildScene2(Scene &scene) { buildTurntableScene(scene); }
+
+inline void buildScene3(Scene &scene)
+{
+    Material *red = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
+    Material *green = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+    Material *glossy_white = scene.Create<Material>(GLOSSY, Vector3f(0.0f));
+    glossy_white->Kd = Vector3f(0.0f, 0.0f, 0.0f);
+    glossy_white->ior = 40.0f;
+    Material *light = scene.Create<Material>(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
+    light->Kd = Vector3f(0.65f);
+
+    MeshTriangle *floor = scene.Create<MeshTriangle>("./models/cornellbox/floor.obj", white);
+    MeshTriangle *shortbox = scene.Create<MeshTriangle>("./models/cornellbox/shortbox.obj", glossy_white);
+    MeshTriangle *tallbox = scene.Create<MeshTriangle>("./models/cornellbox/tallbox.obj", glossy_white);
+    MeshTriangle *left = scene.Create<MeshTriangle>("./models/cornellbox/left.obj", red);
+    MeshTriangle *right = scene.Create<MeshTriangle>("./models/cornellbox/right.obj", green);
+    MeshTriangle *light_ = scene.Create<MeshTriangle>("./models/cornellbox/light.obj", light);
+
+    scene.Add(floor);
+    scene.Add(shortbox);
+    scene.Add(tallbox);
+    scene.Add(left);
+    scene.Add(right);
+    scene.Add(light_);
+
+    scene.buildBVH();
+}
+// 场景4：场景2的布局，bunny为粗糙金属（GGX），高盒子为粗糙塑料
+inline void buildScene4(Scene &scene)
+{
+    Material *red = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
+    Material *green = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+    Material *gold = scene.Create<Material>(MICROFACET, Vector3f(0.0f));
+    gold->Ks = Vector3f(1.0f, 0.71f, 0.29f);
+    gold->roughness = 0.35f;
+    Material *plastic = scene.Create<Material>(MICROFACET, Vector3f(0.0f));
+    plastic->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+    plastic->Ks = Vector3f(0.04f);
+    plastic->roughness = 0.2f;
+    Material *light = scene.Create<Material>(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
+    light->Kd = Vector3f(0.65f);
+
+    MeshTriangle *floor = scene.Create<MeshTriangle>("./models/cornellbox/floor.obj", white);
+    MeshTriangle *tallbox = scene.Create<MeshTriangle>("./models/cornellbox/tallbox.obj", plastic);
+    MeshTriangle *bunny = scene.Create<MeshTriangle>("./models/bunny/bunny.obj", gold, Vector3f(200, -60, 150), Vector3f(-1500, 1500, -1500));
+    MeshTriangle *left = scene.Create<MeshTriangle>("./models/cornellbox/left.obj", red);
+    MeshTriangle *right = scene.Create<MeshTriangle>("./models/cornellbox/right.obj", green);
+    MeshTriangle *light_ = scene.Create<MeshTriangle>("./models/cornellbox/light.obj", light);
+
+    scene.Add(floor);
+    scene.Add(tallbox);
+    scene.Add(bunny);
+    scene.Add(left);
+    scene.Add(right);
+    scene.Add(light_);
+
+    scene.buildBVH();
+}
+
+// 环境光场景：没有墙壁与面光源，地面、粗糙金属bunny与镜面高盒子由经纬度HDR贴图（PFM）照明
+inline void buildEnvironmentScene(Scene &scene, const std::string &environmentMap, float scale = 1)
+{
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+    Material *gold = scene.Create<Material>(MICROFACET, Vector3f(0.0f));
+    gold->Ks = Vector3f(1.0f, 0.71f, 0.29f);
+    gold->roughness = 0.35f;
+    Material *glossy_white = scene.Create<Material>(GLOSSY, Vector3f(0.0f));
+    glossy_white->ior = 40.0f;
+
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/floor.obj", white));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/tallbox.obj", glossy_white));
+    scene.Add(scene.Create<MeshTriangle>("./models/bunny/bunny.obj", gold, Vector3f(200, -60, 150), Vector3f(-1500, 1500, -1500)));
+    scene.environment = scene.Create<EnvironmentLight>(environmentMap, scale);
+
+    scene.buildBVH();
+}
+
+// 多光源场景：Cornell Box的墙壁与两个盒子，没有原来的顶灯，
+// 天花板上铺lightsPerSide × lightsPerSide个朝下的小三角形光源、后墙上再铺一半数量的朝前光源，颜色与亮度各不相同
+inline void buildManyLightsScene(Scene &scene, int lightsPerSide = 32)
+{
+    Material *red = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
+    Material *green = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/floor.obj", white));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/shortbox.obj", white));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/tallbox.obj", white));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/left.obj", red));
+    scene.Add(scene.Create<MeshTriangle>("./models/cornellbox/right.obj", green));
+
+    // 8种颜色，亮度跨两个数量级
+    const Vector3f colors[] = {{1, 0.8f, 0.6f}, {0.6f, 0.8f, 1}, {1, 0.3f, 0.2f}, {0.3f, 1, 0.4f},
+                               {0.9f, 0.9f, 0.9f}, {1, 0.6f, 1}, {0.4f, 0.5f, 1}, {1, 1, 0.3f}};
+    Material *lights[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        lights[i] = scene.Create<Material>(DIFFUSE, colors[i] * (200.0f * std::pow(0.55f, i)));
+        lights[i]->Kd = Vector3f(0.65f);
+    }
+    auto pick = [&](int i, int j) { return lights[(i * 7 + j * 3 + i * j) % 8]; };
+
+    float step = 540.0f / lightsPerSide, size = 0.4f * step;
+    for (int i = 0; i < lightsPerSide; ++i)
+        for (int j = 0; j < lightsPerSide; ++j)
+        {
+            Vector3f v(8 + i * step, 548.0f, 8 + j * step);
+            scene.Add(scene.Create<Triangle>(v, v + Vector3f(size, 0, 0), v + Vector3f(0, 0, size), pick(i, j)));
+        }
+    for (int i = 0; i < lightsPerSide; ++i)
+        for (int j = 0; j < lightsPerSide / 2; ++j)
+        {
+            Vector3f v(8 + i * step, 280 + j * step / 2, 558.0f);
+            scene.Add(scene.Create<Triangle>(v, v + Vector3f(0, size, 0), v + Vector3f(size, 0, 0), pick(j, i)));
+        }
+
+    scene.buildBVH();
+}
+
+// 场景2，bunny由分页文件（PagedMesh::write生成）按需换入，返回其中的bunny以查询常驻内存
+inline PagedMesh *buildPagedScene(Scene &scene, const std::string &pagedFile)
+{
+    Material *red = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
+    Material *green = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
+    Material *glossy_white = scene.Create<Material>(GLOSSY, Vector3f(0.0f));
+    glossy_white->Kd = Vector3f(0.0f, 0.0f, 0.0f);
+    glossy_white->ior = 40.0f;
+    Material *light = scene.Create<Material>(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
+    light->Kd = Vector3f(0.65f);
+
+    MeshTriangle *floor = scene.Create<MeshTriangle>("./models/cornellbox/floor.obj", white);
+    MeshTriangle *tallbox = scene.Create<MeshTriangle>("./models/cornellbox/tallbox.obj", glossy_white);
+    PagedMesh *bunny = scene.Create<PagedMesh>(pagedFile, glossy_white);
+    MeshTriangle *left = scene.Create<MeshTriangle>("./models/cornellbox/left.obj", red);
+    MeshTriangle *right = scene.Create<MeshTriangle>("./models/cornellbox/right.obj", green);
+    MeshTriangle *light_ = scene.Create<MeshTriangle>("./models/cornellbox/light.obj", light);
+
+    scene.Add(floor);
+    scene.Add(tallbox);
+    scene.Add(bunny);
+    scene.Add(left);
+    scene.Add(right);
+    scene.Add(light_);
+
+    scene.buildBVH();
+    return bunny;
+}
@@ -0,0 +1,474 @@
+#pragma once
+
+#include "Vector.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+/**
+ * \brief 4路/8路float向量与SoA三维向量，供批量求交、帧缓冲编码等数据并行的内核使用。
+ * Vec4f在SSE2下用__m128实现，Vec8f在AVX下用__m256实现（无AVX时由两个Vec4f拼成），都不可用时退化为标量循环。
+ *
+ * 比较运算返回逐通道全1/全0的掩码，配合select使用。min/max与SSE指令语义相同：
+ * 任一操作数为NaN时返回第二个操作数，因此min(x, hi)中x为NaN时结果为hi。
+ * 全部定义在simd命名空间中（其中的标量min/max/floor等重载不影响全局），常用类型与fastmath在文件末尾导出
+ */
+namespace simd
+{
+    // ---------------------------------------------------------------- Vec4f
+
+    struct alignas(16) Vec4f
+    {
+#ifdef __SSE2__
+        __m128 v;
+        Vec4f() : v(_mm_setzero_ps()) {}
+        Vec4f(__m128 v) : v(v) {}
+        Vec4f(float s) : v(_mm_set1_ps(s)) {}
+        Vec4f(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+        static Vec4f load(const float *p) { return _mm_loadu_ps(p); }
+        void store(float *p) const { _mm_storeu_ps(p, v); }
+#else
+        float v[4];
+        Vec4f() : v{0, 0, 0, 0} {}
+        Vec4f(float s) : v{s, s, s, s} {}
+        Vec4f(float a, float b, float c, float d) : v{a, b, c, d} {}
+        static Vec4f load(const float *p) { return Vec4f(p[0], p[1], p[2], p[3]); }
+        void store(float *p) const { memcpy(p, v, sizeof(v)); }
+#endif
+        static constexpr int lanes = 4;
+        float operator[](int i) const
+        {
+            alignas(16) float f[4];
+            store(f);
+            return f[i];
+        }
+    };
+
+#ifdef __SSE2__
+    inline Vec4f operator+(const Vec4f &a, const Vec4f &b) { return _mm_add_ps(a.v, b.v); }
+    inline Vec4f operator-(const Vec4f &a, const Vec4f &b) { return _mm_sub_ps(a.v, b.v); }
+    inline Vec4f operator*(const Vec4f &a, const Vec4f &b) { return _mm_mul_ps(a.v, b.v); }
+    inline Vec4f operator/(const Vec4f &a, const Vec4f &b) { return _mm_div_ps(a.v, b.v); }
+    inline Vec4f operator-(const Vec4f &a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+    inline Vec4f operator<(const Vec4f &a, const Vec4f &b) { return _mm_cmplt_ps(a.v, b.v); }
+    inline Vec4f operator<=(const Vec4f &a, const Vec4f &b) { return _mm_cmple_ps(a.v, b.v); }
+    inline Vec4f operator>(const Vec4f &a, const Vec4f &b) { return _mm_cmpgt_ps(a.v, b.v); }
+    inline Vec4f operator>=(const Vec4f &a, const Vec4f &b) { return _mm_cmpge_ps(a.v, b.v); }
+    inline Vec4f operator==(const Vec4f &a, const Vec4f &b) { return _mm_cmpeq_ps(a.v, b.v); }
+    inline Vec4f operator&(const Vec4f &a, const Vec4f &b) { return _mm_and_ps(a.v, b.v); }
+    inline Vec4f operator|(const Vec4f &a, const Vec4f &b) { return _mm_or_ps(a.v, b.v); }
+    inline Vec4f min(const Vec4f &a, const Vec4f &b) { return _mm_min_ps(a.v, b.v); }
+    inline Vec4f max(const Vec4f &a, const Vec4f &b) { return _mm_max_ps(a.v, b.v); }
+    inline Vec4f select(const Vec4f &mask, const Vec4f &a, const Vec4f &b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+    }
+    // 每个通道掩码的最高位组成的4位整数
+    inline int movemask(const Vec4f &mask) { return _mm_movemask_ps(mask.v); }
+    inline Vec4f sqrt(const Vec4f &a) { return _mm_sqrt_ps(a.v); }
+    // 硬件近似倒数平方根，相对误差不超过1.5 * 2^-12
+    inline Vec4f rsqrtApprox(const Vec4f &a) { return _mm_rsqrt_ps(a.v); }
+    inline Vec4f floor(const Vec4f &a)
+    {
+#ifdef __SSE4_1__
+        return _mm_floor_ps(a.v);
+#else
+        // 截断后对负的非整数减1，要求|a| < 2^31
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+#endif
+    }
+    // 正规数拆为 mantissa * 2^exponent，mantissa位于[1, 2)
+    inline Vec4f frexp2(const Vec4f &a, Vec4f &exponent)
+    {
+        __m128i bits = _mm_castps_si128(a.v);
+        exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+        return _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+    }
+    // 2^n，n为[-126, 127]内的整数值
+    inline Vec4f exp2i(const Vec4f &n)
+    {
+        return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n.v), _mm_set1_epi32(127)), 23));
+    }
+#else
+#define VEC4F_LANEWISE(expr)          \
+        Vec4f r;                          \
+        for (int i = 0; i < 4; ++i)       \
+            r.v[i] = (expr);              \
+        return r
+    inline float maskBits(bool m)
+    {
+        uint32_t bits = m ? 0xffffffffu : 0u;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+    inline bool maskSet(float m)
+    {
+        uint32_t bits;
+        memcpy(&bits, &m, sizeof(bits));
+        return bits >> 31;
+    }
+    inline Vec4f operator+(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(a.v[i] + b.v[i]); }
+    inline Vec4f operator-(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(a.v[i] - b.v[i]); }
+    inline Vec4f operator*(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(a.v[i] * b.v[i]); }
+    inline Vec4f operator/(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(a.v[i] / b.v[i]); }
+    inline Vec4f operator-(const Vec4f &a) { VEC4F_LANEWISE(-a.v[i]); }
+    inline Vec4f operator<(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(maskBits(a.v[i] < b.v[i])); }
+    inline Vec4f operator<=(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(maskBits(a.v[i] <= b.v[i])); }
+    inline Vec4f operator>(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(maskBits(a.v[i] > b.v[i])); }
+    inline Vec4f operator>=(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(maskBits(a.v[i] >= b.v[i])); }
+    inline Vec4f operator==(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(maskBits(a.v[i] == b.v[i])); }
+    inline Vec4f operator&(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(maskBits(maskSet(a.v[i]) && maskSet(b.v[i]))); }
+    inline Vec4f operator|(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(maskBits(maskSet(a.v[i]) || maskSet(b.v[i]))); }
+    inline Vec4f min(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(a.v[i] < b.v[i] ? a.v[i] : b.v[i]); }
+    inline Vec4f max(const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(a.v[i] > b.v[i] ? a.v[i] : b.v[i]); }
+    inline Vec4f select(const Vec4f &mask, const Vec4f &a, const Vec4f &b) { VEC4F_LANEWISE(maskSet(mask.v[i]) ? a.v[i] : b.v[i]); }
+    inline int movemask(const Vec4f &mask)
+    {
+        int m = 0;
+        for (int i = 0; i < 4; ++i)
+            m |= maskSet(mask.v[i]) << i;
+        return m;
+    }
+    inline Vec4f sqrt(const Vec4f &a) { VEC4F_LANEWISE(std::sqrt(a.v[i])); }
+    inline Vec4f rsqrtApprox(const Vec4f &a) { VEC4F_LANEWISE(1 / std::sqrt(a.v[i])); }
+    inline Vec4f floor(const Vec4f &a) { VEC4F_LANEWISE(std::floor(a.v[i])); }
+    inline Vec4f frexp2(const Vec4f &a, Vec4f &exponent)
+    {
+        Vec4f r;
+        for (int i = 0; i < 4; ++i)
+        {
+            int e;
+            r.v[i] = 2 * std::frexp(a.v[i], &e);
+            exponent.v[i] = e - 1;
+        }
+        return r;
+    }
+    inline Vec4f exp2i(const Vec4f &n) { VEC4F_LANEWISE(std::ldexp(1.0f, (int)n.v[i])); }
+#undef VEC4F_LANEWISE
+#endif
+
+    // ---------------------------------------------------------------- Vec8f
+
+    struct alignas(32) Vec8f
+    {
+#ifdef __AVX__
+        __m256 v;
+        Vec8f() : v(_mm256_setzero_ps()) {}
+        Vec8f(__m256 v) : v(v) {}
+        Vec8f(float s) : v(_mm256_set1_ps(s)) {}
+        Vec8f(const Vec4f &lo, const Vec4f &hi) : v(_mm256_insertf128_ps(_mm256_castps128_ps256(lo.v), hi.v, 1)) {}
+        Vec4f low() const { return _mm256_castps256_ps128(v); }
+        Vec4f high() const { return _mm256_extractf128_ps(v, 1); }
+        static Vec8f load(const float *p) { return _mm256_loadu_ps(p); }
+        void store(float *p) const { _mm256_storeu_ps(p, v); }
+#else
+        Vec4f lo, hi;
+        Vec8f() {}
+        Vec8f(float s) : lo(s), hi(s) {}
+        Vec8f(const Vec4f &lo, const Vec4f &hi) : lo(lo), hi(hi) {}
+        Vec4f low() const { return lo; }
+        Vec4f high() const { return hi; }
+        static Vec8f load(const float *p) { return Vec8f(Vec4f::load(p), Vec4f::load(p + 4)); }
+        void store(float *p) const
+        {
+            lo.store(p);
+            hi.store(p + 4);
+        }
+#endif
+        static constexpr int lanes = 8;
+        float operator[](int i) const
+        {
+            alignas(32) float f[8];
+            store(f);
+            return f[i];
+        }
+    };
+
+#ifdef __AVX__
+    inline Vec8f operator+(const Vec8f &a, const Vec8f &b) { return _mm256_add_ps(a.v, b.v); }
+    inline Vec8f operator-(const Vec8f &a, const Vec8f &b) { return _mm256_sub_ps(a.v, b.v); }
+    inline Vec8f operator*(const Vec8f &a, const Vec8f &b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Vec8f operator/(const Vec8f &a, const Vec8f &b) { return _mm256_div_ps(a.v, b.v); }
+    inline Vec8f operator-(const Vec8f &a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+    inline Vec8f operator<(const Vec8f &a, const Vec8f &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    inline Vec8f operator<=(const Vec8f &a, const Vec8f &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+    inline Vec8f operator>(const Vec8f &a, const Vec8f &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    inline Vec8f operator>=(const Vec8f &a, const Vec8f &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    inline Vec8f operator==(const Vec8f &a, const Vec8f &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+    inline Vec8f operator&(const Vec8f &a, const Vec8f &b) { return _mm256_and_ps(a.v, b.v); }
+    inline Vec8f operator|(const Vec8f &a, const Vec8f &b) { return _mm256_or_ps(a.v, b.v); }
+    inline Vec8f min(const Vec8f &a, const Vec8f &b) { return _mm256_min_ps(a.v, b.v); }
+    inline Vec8f max(const Vec8f &a, const Vec8f &b) { return _mm256_max_ps(a.v, b.v); }
+    inline Vec8f select(const Vec8f &mask, const Vec8f &a, const Vec8f &b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+    inline int movemask(const Vec8f &mask) { return _mm256_movemask_ps(mask.v); }
+    inline Vec8f sqrt(const Vec8f &a) { return _mm256_sqrt_ps(a.v); }
+    inline Vec8f rsqrtApprox(const Vec8f &a) { return _mm256_rsqrt_ps(a.v); }
+    inline Vec8f floor(const Vec8f &a) { return _mm256_floor_ps(a.v); }
+#ifdef __AVX2__
+    inline Vec8f frexp2(const Vec8f &a, Vec8f &exponent)
+    {
+        __m256i bits = _mm256_castps_si256(a.v);
+        exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+        return _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+                                                   _mm256_set1_epi32(0x3f800000)));
+    }
+    inline Vec8f exp2i(const Vec8f &n)
+    {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127)), 23));
+    }
+#else
+    // AVX没有256位整数运算，按128位两半处理
+    inline Vec8f frexp2(const Vec8f &a, Vec8f &exponent)
+    {
+        Vec4f elo, ehi;
+        Vec8f m(frexp2(a.low(), elo), frexp2(a.high(), ehi));
+        exponent = Vec8f(elo, ehi);
+        return m;
+    }
+    inline Vec8f exp2i(const Vec8f &n) { return Vec8f(exp2i(n.low()), exp2i(n.high())); }
+#endif
+#else
+#define VEC8F_HALVES(f) return Vec8f(f(a.lo, b.lo), f(a.hi, b.hi))
+    inline Vec8f operator+(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo + b.lo, a.hi + b.hi); }
+    inline Vec8f operator-(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo - b.lo, a.hi - b.hi); }
+    inline Vec8f operator*(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo * b.lo, a.hi * b.hi); }
+    inline Vec8f operator/(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo / b.lo, a.hi / b.hi); }
+    inline Vec8f operator-(const Vec8f &a) { return Vec8f(-a.lo, -a.hi); }
+    inline Vec8f operator<(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo < b.lo, a.hi < b.hi); }
+    inline Vec8f operator<=(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo <= b.lo, a.hi <= b.hi); }
+    inline Vec8f operator>(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo > b.lo, a.hi > b.hi); }
+    inline Vec8f operator>=(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo >= b.lo, a.hi >= b.hi); }
+    inline Vec8f operator==(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo == b.lo, a.hi == b.hi); }
+    inline Vec8f operator&(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo & b.lo, a.hi & b.hi); }
+    inline Vec8f operator|(const Vec8f &a, const Vec8f &b) { return Vec8f(a.lo | b.lo, a.hi | b.hi); }
+    inline Vec8f min(const Vec8f &a, const Vec8f &b) { VEC8F_HALVES(min); }
+    inline Vec8f max(const Vec8f &a, const Vec8f &b) { VEC8F_HALVES(max); }
+#undef VEC8F_HALVES
+    inline Vec8f select(const Vec8f &mask, const Vec8f &a, const Vec8f &b)
+    {
+        return Vec8f(select(mask.lo, a.lo, b.lo), select(mask.hi, a.hi, b.hi));
+    }
+    inline int movemask(const Vec8f &mask) { return movemask(mask.lo) | movemask(mask.hi) << 4; }
+    inline Vec8f sqrt(const Vec8f &a) { return Vec8f(sqrt(a.lo), sqrt(a.hi)); }
+    inline Vec8f rsqrtApprox(const Vec8f &a) { return Vec8f(rsqrtApprox(a.lo), rsqrtApprox(a.hi)); }
+    inline Vec8f floor(const Vec8f &a) { return Vec8f(floor(a.lo), floor(a.hi)); }
+    inline Vec8f frexp2(const Vec8f &a, Vec8f &exponent) { return Vec8f(frexp2(a.lo, exponent.lo), frexp2(a.hi, exponent.hi)); }
+    inline Vec8f exp2i(const Vec8f &n) { return Vec8f(exp2i(n.lo), exp2i(n.hi)); }
+#endif
+
+    // ---------------------------------------------------------------- 标量版本，使fastmath中的模板同样适用于float
+
+    inline float select(bool mask, float a, float b) { return mask ? a : b; }
+    inline float min(float a, float b) { return a < b ? a : b; }
+    inline float max(float a, float b) { return a > b ? a : b; }
+    inline float floor(float a) { return std::floor(a); }
+    inline float sqrt(float a) { return std::sqrt(a); }
+    inline float rsqrtApprox(float a)
+    {
+#ifdef __SSE2__
+        return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(a)));
+#else
+        return 1 / std::sqrt(a);
+#endif
+    }
+    inline float frexp2(float a, float &exponent)
+    {
+        uint32_t bits;
+        memcpy(&bits, &a, sizeof(bits));
+        exponent = int(bits >> 23 & 0xff) - 127;
+        bits = (bits & 0x007fffff) | 0x3f800000;
+        float m;
+        memcpy(&m, &bits, sizeof(m));
+        return m;
+    }
+    inline float exp2i(float n)
+    {
+        uint32_t bits = uint32_t(int(n) + 127) << 23;
+        float r;
+        memcpy(&r, &bits, sizeof(r));
+        return r;
+    }
+
+    // ---------------------------------------------------------------- SoA三维向量
+
+    /**
+     * \brief 结构数组形式的三维向量：x、y、z各为一个N路向量，一次处理N个三维向量（如N条光线或N个包围盒）
+     */
+    template <typename V>
+    struct Vec3x
+    {
+        V x, y, z;
+        Vec3x() {}
+        Vec3x(const V &x, const V &y, const V &z) : x(x), y(y), z(z) {}
+        // 把同一个Vector3f广播到所有通道
+        explicit Vec3x(const Vector3f &v) : x(v.x), y(v.y), z(v.z) {}
+        V operator[](int axis) const { return axis == 0 ? x : axis == 1 ? y : z; }
+    };
+    using Vec3x4 = Vec3x<Vec4f>;
+    using Vec3x8 = Vec3x<Vec8f>;
+
+    template <typename V>
+    inline Vec3x<V> operator+(const Vec3x<V> &a, const Vec3x<V> &b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+    template <typename V>
+    inline Vec3x<V> operator-(const Vec3x<V> &a, const Vec3x<V> &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+    template <typename V>
+    inline Vec3x<V> operator*(const Vec3x<V> &a, const V &s) { return {a.x * s, a.y * s, a.z * s}; }
+    template <typename V>
+    inline V dotProduct(const Vec3x<V> &a, const Vec3x<V> &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    template <typename V>
+    inline Vec3x<V> crossProduct(const Vec3x<V> &a, const Vec3x<V> &b)
+    {
+        return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    }
+
+    /**
+     * @brief 一条光线与N个包围盒的slab测试（与Bounds3::IntersectP相同的取舍与NaN处理），
+     *        返回相交通道的掩码
+     * @param dirIsNeg 光线方向各分量是否不为正（此时交换近/远平面）
+     */
+    template <typename V>
+    inline V intersectBoxes(const Vec3x<V> &pMin, const Vec3x<V> &pMax, const Vector3f &origin, const Vector3f &invDir,
+                            const bool dirIsNeg[3])
+    {
+        V tEnter(-std::numeric_limits<float>::infinity()), tExit(std::numeric_limits<float>::infinity());
+        for (int i = 0; i < 3; ++i)
+        {
+            V o(origin[i]), inv(invDir[i]);
+            V t0 = (pMin[i] - o) * inv, t1 = (pMax[i] - o) * inv;
+            if (dirIsNeg[i])
+                std::swap(t0, t1);
+            tEnter = max(t0, tEnter);
+            tExit = min(t1, tExit);
+        }
+        return (tEnter <= tExit) & (tExit >= V(0.0f));
+    }
+
+    // ---------------------------------------------------------------- 快速数学函数
+
+    /**
+     * \brief 多项式近似的初等函数，模板参数可为float、Vec4f或Vec8f（所有通道同时计算，无分支）。
+     * 误差为在给定区间内与double精度结果比较测得的最大值（见benchmark.cpp中的fastmath一节）
+     */
+    namespace fastmath
+    {
+        /**
+         * @brief 倒数平方根：硬件近似再做一次牛顿迭代，x > 0时相对误差 < 3e-7（标准库1/sqrt约6e-8）
+         */
+        template <typename T>
+        inline T rsqrt(const T &x)
+        {
+            T y = rsqrtApprox(x);
+            return y * (T(1.5f) - T(0.5f) * x * y * y);
+        }
+
+        /**
+         * @brief 同时计算sin与cos：按pi/2做三段Cody-Waite约化到[-pi/4, pi/4]后用Cephes的极小化多项式，
+         *        |x| <= 8192时绝对误差 < 1e-7·max(1, |x|/pi)
+         */
+        template <typename T>
+        inline void sincos(const T &x, T &s, T &c)
+        {
+            T k = floor(x * T(0.636619772367581f) + T(0.5f));
+            T r = x - k * T(1.5703125f);
+            r = r - k * T(4.837512969970703125e-4f);
+            r = r - k * T(7.54978995489188216e-8f);
+            T r2 = r * r;
+            T ps = r + r * r2 * (T(-1.6666654611e-1f) + r2 * (T(8.3321608736e-3f) + r2 * T(-1.9515295891e-4f)));
+            T pc = T(1.0f) - T(0.5f) * r2 +
+                   r2 * r2 * (T(4.166664568298827e-2f) + r2 * (T(-1.388731625493765e-3f) + r2 * T(2.443315711809948e-5f)));
+            // 象限q = k mod 4：sin依次为 ps, pc, -ps, -pc；cos依次为 pc, -ps, -pc, ps
+            T q = k - T(4.0f) * floor(k * T(0.25f));
+            auto odd = (q == T(1.0f)) | (q == T(3.0f));
+            T sinv = select(odd, pc, ps), cosv = select(odd, ps, pc);
+            s = select(q >= T(2.0f), -sinv, sinv);
+            c = select((q == T(1.0f)) | (q == T(2.0f)), -cosv, cosv);
+        }
+
+        template <typename T>
+        inline T sin(const T &x)
+        {
+            T s, c;
+            sincos(x, s, c);
+            return s;
+        }
+
+        template <typename T>
+        inline T cos(const T &x)
+        {
+            T s, c;
+            sincos(x, s, c);
+            return c;
+        }
+
+        /**
+         * @brief 2^x：x截断到[-126, 127]后拆为整数与[-0.5, 0.5]内的小数部分，小数部分用Cephes的5次多项式，
+         *        相对误差 < 1e-7
+         */
+        template <typename T>
+        inline T exp2(const T &x)
+        {
+            T xc = min(max(x, T(-126.0f)), T(127.0f));
+            T n = floor(xc + T(0.5f));
+            T f = xc - n;
+            T p = T(1.535336188319500e-4f);
+            p = p * f + T(1.339887440266574e-3f);
+            p = p * f + T(9.618437357674640e-3f);
+            p = p * f + T(5.550332471162809e-2f);
+            p = p * f + T(2.402264791363012e-1f);
+            p = p * f + T(6.931472028550421e-1f);
+            return (T(1.0f) + f * p) * exp2i(n);
+        }
+
+        /**
+         * @brief log2(x)，x为正规数：拆出指数后对[sqrt(1/2), sqrt(2))内的尾数用Cephes logf的8次多项式，
+         *        误差 < 1e-7·max(1, |log2(x)|)
+         */
+        template <typename T>
+        inline T log2(const T &x)
+        {
+            T e;
+            T m = frexp2(x, e); // m位于[1, 2)
+            auto big = m > T(1.41421356237f);
+            m = select(big, m * T(0.5f), m);
+            e = select(big, e + T(1.0f), e);
+            T f = m - T(1.0f);
+            T f2 = f * f;
+            T p = T(7.0376836292e-2f);
+            p = p * f + T(-1.1514610310e-1f);
+            p = p * f + T(1.1676998740e-1f);
+            p = p * f + T(-1.2420140846e-1f);
+            p = p * f + T(1.4249322787e-1f);
+            p = p * f + T(-1.6668057665e-1f);
+            p = p * f + T(2.0000714765e-1f);
+            p = p * f + T(-2.4999993993e-1f);
+            p = p * f + T(3.3333331174e-1f);
+            T y = f * f2 * p - T(0.5f) * f2; // ln(1 + f) - f
+            const T log2e(1.44269504088896341f);
+            return (y + f) * log2e + e;
+        }
+
+        /**
+         * @brief x^y，x >= 0（x为0时返回0）：exp2(y * log2(x))，相对误差 < 2e-7·max(1, |y * log2(x)|)
+         */
+        template <typename T>
+        inline T pow(const T &x, const T &y)
+        {
+            return select(x > T(0.0f), exp2(y * log2(x)), T(0.0f));
+        }
+    }
+}
+
+using simd::Vec3x4;
+using simd::Vec3x8;
+using simd::Vec4f;
+using simd::Vec8f;
+namespace fastmath = simd::fastmath;
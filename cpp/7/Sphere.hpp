@@ -4,6 +4,7 @@
 #include "Vector.hpp"
 #include "Bounds3.hpp"
 #include "Material.hpp"
+#include "Stats.hpp"
 
 class Sphere : public Object
 {
@@ -12,7 +13,7 @@ public:
     float radius, radius2;
     Material *m;
     float area;
-    Sphere(const Vector3f &c, const float &r, Material *mt = new Material()) : center(c), radius(r), radius2(r * r), m(mt), area(4 * M_PI * r * r) {}
+    Sphere(const Vector3f &c, const float &r, Material *mt = defaultMaterial()) : center(c), radius(r), radius2(r * r), m(mt), area(4 * M_PI * r * r) {}
     bool intersect(const Ray &ray)
     {
         // analytic solution
@@ -50,6 +51,7 @@ public:
     }
     Intersection getIntersection(Ray ray)
     {
+        STAT_INC(sphereTests);
         Intersection result;
         result.happened = false;
         Vector3f L = ray.origin - center;
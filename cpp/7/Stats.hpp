@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * \brief 光线追踪统计计数器。编译时增加 -DRT_STATS 开启，否则统计宏为空操作。
+ * 每个线程独立计数（thread_local，热路径上无原子操作），渲染结束后合并
+ */
+struct RayStats
+{
+    static const int maxPathLength = 32;
+
+    uint64_t cameraRays = 0;
+    uint64_t bounceRays = 0;
+    uint64_t shadowRays = 0;
+    uint64_t nodesVisited = 0;
+    uint64_t boxTests = 0;
+    uint64_t triangleTests = 0;
+    uint64_t sphereTests = 0;
+    // 所有路径的顶点数之和
+    uint64_t pathVertices = 0;
+    // 路径长度（表面顶点数）直方图，最后一格统计所有更长的路径
+    uint64_t pathLength[maxPathLength + 1] = {};
+
+    uint64_t totalRays() const { return cameraRays + bounceRays + shadowRays; }
+
+    void merge(const RayStats &o)
+    {
+        cameraRays += o.cameraRays;
+        bounceRays += o.bounceRays;
+        shadowRays += o.shadowRays;
+        nodesVisited += o.nodesVisited;
+        boxTests += o.boxTests;
+        triangleTests += o.triangleTests;
+        sphereTests += o.sphereTests;
+        pathVertices += o.pathVertices;
+        for (int i = 0; i <= maxPathLength; ++i)
+            pathLength[i] += o.pathLength[i];
+    }
+};
+
+namespace Stats
+{
+#ifdef RT_STATS
+    const bool enabled = true;
+#else
+    const bool enabled = false;
+#endif
+
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<RayStats *> threads;
+        // 已退出线程的计数
+        RayStats retired;
+    };
+
+    inline Registry &registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    // 线程首次计数时登记，退出时将计数并入retired
+    struct ThreadStats
+    {
+        RayStats stats;
+        ThreadStats()
+        {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            registry().threads.push_back(&stats);
+        }
+        ~ThreadStats()
+        {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            auto &threads = registry().threads;
+            for (auto it = threads.begin(); it != threads.end(); ++it)
+                if (*it == &stats)
+                {
+                    threads.erase(it);
+                    break;
+                }
+            registry().retired.merge(stats);
+        }
+    };
+
+    inline RayStats &local()
+    {
+        thread_local ThreadStats t;
+        return t.stats;
+    }
+
+    inline void recordPathLength(int n)
+    {
+        local().pathVertices += n;
+        local().pathLength[n < RayStats::maxPathLength ? n : RayStats::maxPathLength]++;
+    }
+
+    // 合并所有线程的计数，须在并行区域之外调用
+    inline RayStats collect()
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        RayStats total = registry().retired;
+        for (RayStats *s : registry().threads)
+            total.merge(*s);
+        return total;
+    }
+
+    // 清零所有线程的计数，须在并行区域之外调用
+    inline void reset()
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().retired = RayStats();
+        for (RayStats *s : registry().threads)
+            *s = RayStats();
+    }
+}
+
+#ifdef RT_STATS
+#define STAT_INC(counter) (++Stats::local().counter)
+#define STAT_ADD(counter, n) (Stats::local().counter += (n))
+#define STAT_PATH_LENGTH(n) Stats::recordPathLength(n)
+#else
+#define STAT_INC(counter) ((void)0)
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_PATH_LENGTH(n) ((void)0)
+#endif
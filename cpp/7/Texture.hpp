@@ -0,0 +1,479 @@
+#pragma once
+
+#include "Vector.hpp"
+#include "global.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * \brief 读取PPM（P6，8位，按sRGB解码为线性值）或PFM（PF，32位浮点RGB）图像，
+ * 结果为自上而下逐行的RGB浮点数组
+ */
+inline bool loadImage(const std::string &path, int &width, int &height, std::vector<float> &rgb)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::string magic;
+    in >> magic >> width >> height;
+    if (!in || width <= 0 || height <= 0)
+        return false;
+    size_t count = (size_t)width * height * 3;
+    rgb.resize(count);
+    if (magic == "P6")
+    {
+        int maxval;
+        in >> maxval;
+        in.get();
+        if (maxval != 255)
+            return false;
+        std::vector<unsigned char> bytes(count);
+        in.read((char *)bytes.data(), count);
+        float table[256];
+        for (int i = 0; i < 256; ++i)
+        {
+            float c = i / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (size_t i = 0; i < count; ++i)
+            rgb[i] = table[bytes[i]];
+    }
+    else if (magic == "PF")
+    {
+        // scale为负表示小端；PFM的行自下而上存放
+        float scale;
+        in >> scale;
+        in.get();
+        std::vector<float> rows(count);
+        in.read((char *)rows.data(), count * sizeof(float));
+        const uint16_t one = 1;
+        bool swap = (scale < 0) != (*(const unsigned char *)&one == 1);
+        for (size_t i = 0; swap && i < count; ++i)
+        {
+            uint32_t bits;
+            memcpy(&bits, &rows[i], 4);
+            bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+            memcpy(&rows[i], &bits, 4);
+        }
+        size_t rowSize = (size_t)width * 3;
+        for (int y = 0; y < height; ++y)
+            std::copy(rows.begin() + (height - 1 - y) * rowSize, rows.begin() + (height - y) * rowSize,
+                      rgb.begin() + y * rowSize);
+    }
+    else
+        return false;
+    return (bool)in;
+}
+
+class Texture;
+
+/**
+ * \brief 纹理分块缓存：所有纹理共享的固定容量缓存，按(纹理, mip层, 块坐标)缓存纹理块，
+ * 未命中时从纹理的分块文件中读入，超出容量时按LRU淘汰。缓存分为若干分片各自加锁，
+ * 块以shared_ptr返回，被淘汰的块在仍被使用时不会释放。纹理总量超过内存时只有被访问的块常驻
+ */
+class TextureCache
+{
+public:
+    static constexpr int tileSize = 16;
+    using Tile = std::array<float, tileSize * tileSize * 3>;
+
+    // 缓存容量（字节），所有纹理共享
+    static inline size_t capacity = 64u << 20;
+
+    static TextureCache &instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const Tile> get(const Texture &texture, int level, int tx, int ty);
+
+    // 丢弃所有缓存的块（各线程最近使用的块仍可能被引用）并清零计数，用于比较不同容量
+    void clear()
+    {
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.tiles.clear();
+            shard.lru.clear();
+            shard.bytes = 0;
+        }
+        hitCount = 0;
+        missCount = 0;
+    }
+
+    uint64_t hits() const { return hitCount; }
+    uint64_t misses() const { return missCount; }
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (auto &shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.bytes;
+        }
+        return total;
+    }
+
+private:
+    static constexpr int numShards = 16;
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        // 最近使用的在前
+        std::list<uint64_t> lru;
+        std::unordered_map<uint64_t, std::pair<std::shared_ptr<const Tile>, std::list<uint64_t>::iterator>> tiles;
+        size_t bytes = 0;
+    };
+    Shard shards[numShards];
+    std::atomic<uint64_t> hitCount{0}, missCount{0};
+};
+
+/**
+ * \brief 分块存储的mip纹理。首次打开图像时生成分块文件（各mip层按16x16分块，块内逐行存放RGB浮点数），
+ * 之后只读取被访问的块，经TextureCache缓存。sample按纹理空间中的足迹宽度在相邻两层间三线性过滤，
+ * 纹理坐标按repeat方式环绕，v轴向上（与OBJ一致）
+ */
+class Texture
+{
+public:
+    // 分块文件所在目录
+    static inline std::string directory = "./cache";
+    static const uint32_t version = 1;
+
+    explicit Texture(const std::string &imagePath);
+    ~Texture();
+    Texture(const Texture &) = delete;
+    Texture &operator=(const Texture &) = delete;
+
+    bool valid() const { return !levels.empty(); }
+    int width() const { return valid() ? levels[0].width : 0; }
+    int height() const { return valid() ? levels[0].height : 0; }
+    int numLevels() const { return levels.size(); }
+
+    /**
+     * @brief 三线性过滤
+     * @param footprint 采样点足迹在纹理坐标空间中的宽度（整张纹理为1），0表示取最精细的一层
+     */
+    Vector3f sample(float u, float v, float footprint = 0) const;
+    // 第level层的双线性过滤，x、y为该层的纹素坐标（纹素中心在半整数处）
+    Vector3f bilinear(int level, float x, float y) const;
+    Vector3f texel(int level, int x, int y) const;
+
+private:
+    friend class TextureCache;
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t tileSize;
+        uint32_t numLevels;
+        uint32_t reserved;
+    };
+    struct Level
+    {
+        int32_t width, height;
+        int32_t tilesX, tilesY;
+        uint64_t offset; // 第一块在文件中的偏移
+    };
+
+    std::vector<Level> levels;
+    uint32_t id;
+#ifdef _WIN32
+    mutable std::mutex fileMutex;
+    FILE *file = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    static std::string tiledPath(const std::string &imagePath);
+    static bool writeTiled(const std::string &imagePath, const std::string &path);
+    bool readTile(int level, int tx, int ty, TextureCache::Tile &tile) const;
+};
+
+inline std::shared_ptr<const TextureCache::Tile> TextureCache::get(const Texture &texture, int level, int tx, int ty)
+{
+    uint64_t key = (uint64_t)texture.id << 44 | (uint64_t)level << 40 | (uint64_t)ty << 20 | (uint64_t)tx;
+
+    // 每个线程保留最近使用的几块，连续的查找大多落在同一块内，不必加锁
+    struct Recent
+    {
+        uint64_t key = ~0ull;
+        std::shared_ptr<const Tile> tile;
+    };
+    thread_local Recent recent[4];
+    Recent &slot = recent[(tx ^ ty) & 3];
+    if (slot.key == key)
+        return slot.tile;
+
+    Shard &shard = shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.tiles.find(key);
+        if (it != shard.tiles.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.second);
+            ++hitCount;
+            slot = {key, it->second.first};
+            return slot.tile;
+        }
+    }
+
+    // 在锁外读文件，其他线程同时读入同一块时保留先插入的一份
+    ++missCount;
+    auto tile = std::make_shared<Tile>();
+    if (!texture.readTile(level, tx, ty, *tile))
+        tile->fill(0.0f);
+    std::shared_ptr<const Tile> result = tile;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.tiles.find(key);
+        if (it != shard.tiles.end())
+            result = it->second.first;
+        else
+        {
+            shard.lru.push_front(key);
+            shard.tiles.emplace(key, std::make_pair(result, shard.lru.begin()));
+            shard.bytes += sizeof(Tile);
+            size_t budget = std::max(capacity / numShards, sizeof(Tile));
+            while (shard.bytes > budget)
+            {
+                shard.tiles.erase(shard.lru.back());
+                shard.lru.pop_back();
+                shard.bytes -= sizeof(Tile);
+            }
+        }
+    }
+    slot = {key, result};
+    return result;
+}
+
+inline std::string Texture::tiledPath(const std::string &imagePath)
+{
+    // 以图像内容的FNV-1a哈希命名
+    std::ifstream in(imagePath, std::ios::binary);
+    uint64_t h = 14695981039346656037ull ^ version;
+    char buffer[1 << 16];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0)
+        for (std::streamsize i = 0; i < in.gcount(); ++i)
+        {
+            h ^= (unsigned char)buffer[i];
+            h *= 1099511628211ull;
+        }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.tex", (unsigned long long)h);
+    return directory + "/" + name;
+}
+
+/**
+ * @brief 生成分块文件：逐层写出各块后以2x2盒式滤波得到下一层（奇数尺寸时边缘重复），直到1x1
+ */
+inline bool Texture::writeTiled(const std::string &imagePath, const std::string &path)
+{
+    int width, height;
+    std::vector<float> image;
+    if (!loadImage(imagePath, width, height, image))
+        return false;
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+
+    const int T = TextureCache::tileSize;
+    std::vector<Level> table;
+    uint64_t offset = 0;
+    for (int w = width, h = height;; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        Level level{w, h, (w + T - 1) / T, (h + T - 1) / T, 0};
+        table.push_back(level);
+        if (w == 1 && h == 1)
+            break;
+    }
+    offset = sizeof(FileHeader) + sizeof(Level) * table.size();
+    for (auto &level : table)
+    {
+        level.offset = offset;
+        offset += (uint64_t)level.tilesX * level.tilesY * sizeof(TextureCache::Tile);
+    }
+
+    std::string tmp = path + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (fp == nullptr)
+        return false;
+    FileHeader header{};
+    memcpy(header.magic, "GTEXTILE", 8);
+    header.version = version;
+    header.tileSize = T;
+    header.numLevels = table.size();
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(table.data(), sizeof(Level), table.size(), fp) == table.size();
+
+    for (size_t l = 0; ok && l < table.size(); ++l)
+    {
+        const Level &level = table[l];
+        if (l > 0)
+        {
+            const Level &prev = table[l - 1];
+            std::vector<float> next((size_t)level.width * level.height * 3);
+            for (int y = 0; y < level.height; ++y)
+                for (int x = 0; x < level.width; ++x)
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        float sum = 0;
+                        for (int dy = 0; dy < 2; ++dy)
+                            for (int dx = 0; dx < 2; ++dx)
+                            {
+                                int sx = std::min(2 * x + dx, prev.width - 1), sy = std::min(2 * y + dy, prev.height - 1);
+                                sum += image[((size_t)sy * prev.width + sx) * 3 + c];
+                            }
+                        next[((size_t)y * level.width + x) * 3 + c] = sum * 0.25f;
+                    }
+            image.swap(next);
+        }
+        TextureCache::Tile tile;
+        for (int ty = 0; ok && ty < level.tilesY; ++ty)
+            for (int tx = 0; ok && tx < level.tilesX; ++tx)
+            {
+                // 越出图像的部分重复边缘纹素
+                for (int y = 0; y < T; ++y)
+                    for (int x = 0; x < T; ++x)
+                    {
+                        int sx = std::min(tx * T + x, level.width - 1), sy = std::min(ty * T + y, level.height - 1);
+                        memcpy(&tile[(y * T + x) * 3], &image[((size_t)sy * level.width + sx) * 3], 3 * sizeof(float));
+                    }
+                ok = fwrite(tile.data(), sizeof(tile), 1, fp) == 1;
+            }
+    }
+    ok = (fclose(fp) == 0) && ok;
+    if (ok)
+        std::filesystem::rename(tmp, path, ec);
+    if (!ok || ec)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline Texture::Texture(const std::string &imagePath)
+{
+    static std::atomic<uint32_t> nextId{0};
+    id = nextId++;
+
+    std::string path = tiledPath(imagePath);
+    if (!std::filesystem::exists(path) && !writeTiled(imagePath, path))
+    {
+        std::cerr << "Cannot load texture " << imagePath << "\n";
+        return;
+    }
+
+    FileHeader header;
+    std::ifstream in(path, std::ios::binary);
+    if (!in.read((char *)&header, sizeof(header)) || memcmp(header.magic, "GTEXTILE", 8) != 0 ||
+        header.version != version || header.tileSize != TextureCache::tileSize || header.numLevels == 0)
+    {
+        std::cerr << "Invalid tiled texture " << path << "\n";
+        return;
+    }
+    std::vector<Level> table(header.numLevels);
+    if (!in.read((char *)table.data(), sizeof(Level) * table.size()))
+        return;
+#ifdef _WIN32
+    file = fopen(path.c_str(), "rb");
+    if (file != nullptr)
+        levels = std::move(table);
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0)
+        levels = std::move(table);
+#endif
+}
+
+inline Texture::~Texture()
+{
+#ifdef _WIN32
+    if (file != nullptr)
+        fclose(file);
+#else
+    if (fd >= 0)
+        ::close(fd);
+#endif
+}
+
+inline bool Texture::readTile(int level, int tx, int ty, TextureCache::Tile &tile) const
+{
+    const Level &l = levels[level];
+    uint64_t offset = l.offset + ((uint64_t)ty * l.tilesX + tx) * sizeof(tile);
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(fileMutex);
+    return _fseeki64(file, offset, SEEK_SET) == 0 && fread(tile.data(), sizeof(tile), 1, file) == 1;
+#else
+    return pread(fd, tile.data(), sizeof(tile), offset) == (ssize_t)sizeof(tile);
+#endif
+}
+
+inline Vector3f Texture::texel(int level, int x, int y) const
+{
+    const Level &l = levels[level];
+    x %= l.width;
+    y %= l.height;
+    if (x < 0)
+        x += l.width;
+    if (y < 0)
+        y += l.height;
+    const int T = TextureCache::tileSize;
+    auto tile = TextureCache::instance().get(*this, level, x / T, y / T);
+    const float *c = &(*tile)[((y % T) * T + x % T) * 3];
+    return Vector3f(c[0], c[1], c[2]);
+}
+
+inline Vector3f Texture::bilinear(int level, float x, float y) const
+{
+    x -= 0.5f;
+    y -= 0.5f;
+    float fx = std::floor(x), fy = std::floor(y);
+    float dx = x - fx, dy = y - fy;
+    int x0 = (int)fx, y0 = (int)fy;
+    return (1 - dy) * ((1 - dx) * texel(level, x0, y0) + dx * texel(level, x0 + 1, y0)) +
+           dy * ((1 - dx) * texel(level, x0, y0 + 1) + dx * texel(level, x0 + 1, y0 + 1));
+}
+
+inline Vector3f Texture::sample(float u, float v, float footprint) const
+{
+    if (!valid())
+        return Vector3f();
+    // 环绕到[0, 1)，避免大坐标下纹素坐标损失精度
+    u -= std::floor(u);
+    v -= std::floor(v);
+    int maxLevel = levels.size() - 1;
+    float lod = footprint > 0 ? std::log2(footprint * std::max(levels[0].width, levels[0].height)) : 0;
+    lod = clamp(0, maxLevel, lod);
+    int l0 = (int)lod;
+    float t = lod - l0;
+    auto at = [&](int l)
+    { return bilinear(l, u * levels[l].width, (1 - v) * levels[l].height); };
+    Vector3f c = at(l0);
+    if (t > 0 && l0 < maxLevel)
+        c = lerp(c, at(l0 + 1), t);
+    return c;
+}
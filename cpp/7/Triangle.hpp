@@ -3,6 +3,7 @@
 #include "BVH.hpp"
 #include "Intersection.hpp"
 #include "Material.hpp"
+#include "MeshCache.hpp"
 #include "OBJ_Loader.hpp"
 #include "Object.hpp"
 #include "Triangle.hpp"
@@ -48,6 +49,7 @@ public:
     Vector3f t0, t1, t2; // texture coords
     Vector3f normal;
     float area;
+    float uvScale = 0; // sqrt(纹理空间面积 / area)
     Material *m;
 
     Triangle(Vector3f _v0, Vector3f _v1, Vector3f _v2, Material *_m = nullptr)
@@ -59,6 +61,15 @@ public:
         area = crossProduct(e1, e2).norm() * 0.5f;
     }
 
+    void setTexcoords(const Vector3f &_t0, const Vector3f &_t1, const Vector3f &_t2)
+    {
+        t0 = _t0;
+        t1 = _t1;
+        t2 = _t2;
+        float uvArea = crossProduct(t1 - t0, t2 - t0).norm() * 0.5f;
+        uvScale = area > 0 ? std::sqrt(uvArea / area) : 0;
+    }
+
     bool intersect(const Ray &ray) override;
     bool intersect(const Ray &ray, float &tnear,
                    uint32_t &index) const override;
@@ -73,11 +84,13 @@ public:
     }
     Vector3f evalDiffuseColor(const Vector2f &) const override;
     Bounds3 getBounds() override;
+    Bounds3 getClippedBounds(const Bounds3 &box) override;
     void Sample(Intersection &pos, float &pdf)
     {
         float x = std::sqrt(get_random_float()), y = get_random_float();
         pos.coords = v0 * (1.0f - x) + v1 * (x * (1.0f - y)) + v2 * (x * y);
         pos.normal = this->normal;
+        pos.emit = m->getEmission();
         pdf = 1.0f / area;
     }
     float getArea()
@@ -88,6 +101,11 @@ public:
     {
         return m->hasEmission();
     }
+    // 单面的漫反射面光源：沿法线的半球发光
+    LightBounds getLightBounds() override
+    {
+        return LightBounds(getBounds(), normal, luminance(m->getEmission()) * area * M_PI, 1, 0, false);
+    }
 };
 
 class MeshTriangle : public Object
@@ -95,16 +113,52 @@ class MeshTriangle : public Object
 public:
     MeshTriangle(
         const std::string &filename, 
-        Material *mt = new Material(),
+        Material *mt = defaultMaterial(),
         Vector3f trans = Vector3f(0.0, 0.0, 0.0), 
-        Vector3f scale = Vector3f(1.0, 1.0, 1.0)
+        Vector3f scale = Vector3f(1.0, 1.0, 1.0),
+        int maxPrimsInNode = 1,
+        BVHAccel::SplitMethod splitMethod = BVHAccel::SplitMethod::NAIVE
     ) {
-        objl::Loader loader;
-        loader.LoadFile(filename);
         area = 0;
         m = mt;
+
+        // 优先从二进制缓存加载变换后的顶点与BVH
+        uint64_t key = MeshCache::enabled ? MeshCache::key(filename, trans, scale, maxPrimsInNode, splitMethod) : 0;
+        MeshCache::Entry entry;
+        if (key != 0 && MeshCache::open(key, entry))
+        {
+            const float *v = entry.vertices;
+            triangles.reserve(entry.header->numTriangles);
+            objectVertices.reserve(entry.header->numTriangles * 3);
+            const float *t = entry.texcoords;
+            for (uint32_t i = 0; i < entry.header->numTriangles; ++i, v += 9, t += 6)
+            {
+                triangles.emplace_back(Vector3f(v[0], v[1], v[2]), Vector3f(v[3], v[4], v[5]),
+                                       Vector3f(v[6], v[7], v[8]), mt);
+                triangles.back().setTexcoords(Vector3f(t[0], t[1], 0), Vector3f(t[2], t[3], 0), Vector3f(t[4], t[5], 0));
+                for (int j = 0; j < 9; j += 3)
+                {
+                    Vector3f d = Vector3f(v[j], v[j + 1], v[j + 2]) - trans;
+                    objectVertices.push_back(Vector3f(d.x / scale.x, d.y / scale.y, d.z / scale.z));
+                }
+            }
+            bounding_box = Bounds3(Vector3f(entry.header->pMin[0], entry.header->pMin[1], entry.header->pMin[2]),
+                                   Vector3f(entry.header->pMax[0], entry.header->pMax[1], entry.header->pMax[2]));
+
+            for (auto &tri : triangles)
+                area += tri.area;
+            std::vector<Object *> ptrs;
+            ptrs.reserve(entry.header->numReferences);
+            for (uint32_t i = 0; i < entry.header->numReferences; ++i)
+                ptrs.push_back(&triangles[entry.references[i]]);
+            bvh = std::make_unique<BVHAccel>(ptrs, entry.nodes, maxPrimsInNode, splitMethod);
+            return;
+        }
+
+        objl::Loader loader;
+        loader.LoadFile(filename);
         assert(loader.LoadedMeshes.size() == 1);
-        auto mesh = loader.LoadedMeshes[0];
+        auto &mesh = loader.LoadedMeshes[0];
 
         Vector3f min_vert = Vector3f{std::numeric_limits<float>::infinity(),
                                      std::numeric_limits<float>::infinity(),
@@ -114,19 +168,22 @@ public:
                                      -std::numeric_limits<float>::infinity()};
         for (int i = 0; i < mesh.Vertices.size(); i += 3)
         {
-            std::array<Vector3f, 3> face_vertices;
+            std::array<Vector3f, 3> face_vertices, face_texcoords;
 
             for (int j = 0; j < 3; j++)
             {
                 auto vert = Vector3f(mesh.Vertices[i + j].Position.X,
                                      mesh.Vertices[i + j].Position.Y,
                                      mesh.Vertices[i + j].Position.Z);
+                objectVertices.push_back(vert);
 
                 // --对obj中三角形点坐标进行变换---
                 vert = scale * vert + trans;
                 // ------------------------------
 
                 face_vertices[j] = vert;
+                face_texcoords[j] = Vector3f(mesh.Vertices[i + j].TextureCoordinate.X,
+                                             mesh.Vertices[i + j].TextureCoordinate.Y, 0);
 
                 min_vert = Vector3f(std::min(min_vert.x, vert.x),
                                     std::min(min_vert.y, vert.y),
@@ -138,6 +195,7 @@ public:
 
             triangles.emplace_back(face_vertices[0], face_vertices[1],
                                    face_vertices[2], mt);
+            triangles.back().setTexcoords(face_texcoords[0], face_texcoords[1], face_texcoords[2]);
         }
 
         bounding_box = Bounds3(min_vert, max_vert);
@@ -148,9 +206,66 @@ public:
             ptrs.push_back(&tri);
             area += tri.area;
         }
-        bvh = new BVHAccel(ptrs);
+        bvh = std::make_unique<BVHAccel>(ptrs, maxPrimsInNode, splitMethod);
+
+        // 延迟构建时写缓存需要展开整棵树，因此不写缓存
+        if (key != 0 && !BVHAccel::lazyBuild)
+        {
+            // 三角形按加载顺序保存，另存BVH重排后各图元引用的三角形下标，加载时叶节点的图元下标可直接使用
+            std::vector<Vector3f> vertices, texcoords;
+            vertices.reserve(triangles.size() * 3);
+            texcoords.reserve(triangles.size() * 3);
+            for (auto &tri : triangles)
+            {
+                vertices.push_back(tri.v0);
+                vertices.push_back(tri.v1);
+                vertices.push_back(tri.v2);
+                texcoords.push_back(tri.t0);
+                texcoords.push_back(tri.t1);
+                texcoords.push_back(tri.t2);
+            }
+            std::vector<uint32_t> references;
+            references.reserve(bvh->primitives.size());
+            for (auto object : bvh->primitives)
+                references.push_back(static_cast<Triangle *>(object) - triangles.data());
+            if (!MeshCache::save(key, vertices, texcoords, references, bvh->flatten(), bounding_box, area))
+                std::cerr << "Cannot write mesh cache for " << filename << "\n";
+        }
+    }
+
+    /**
+     * @brief 修改网格的变换 world = Ry(rotateY) * (scale * v) + trans（rotateY为角度），
+     *        三角形原地更新后由BVHAccel::update重新拟合或重建BVH。
+     *        场景BVH中该网格的包围盒随之改变，需再调用Scene::updateBVH
+     */
+    BVHAccel::UpdateResult setTransform(const Vector3f &trans, const Vector3f &scale, float rotateY = 0)
+    {
+        float c = std::cos(rotateY * M_PI / 180), s = std::sin(rotateY * M_PI / 180);
+        Bounds3 bounds;
+        area = 0;
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            Vector3f v[3];
+            for (int j = 0; j < 3; ++j)
+            {
+                Vector3f p = scale * objectVertices[i * 3 + j];
+                v[j] = Vector3f(c * p.x + s * p.z, p.y, -s * p.x + c * p.z) + trans;
+                bounds = Union(bounds, v[j]);
+            }
+            // 原地赋值，BVH中指向triangles元素的指针保持有效
+            Triangle tri(v[0], v[1], v[2], m);
+            tri.setTexcoords(triangles[i].t0, triangles[i].t1, triangles[i].t2);
+            triangles[i] = tri;
+            area += triangles[i].area;
+        }
+        bounding_box = bounds;
+        return bvh->update();
     }
 
+    // BVH中保存了指向triangles元素的指针，禁止拷贝
+    MeshTriangle(const MeshTriangle &) = delete;
+    MeshTriangle &operator=(const MeshTriangle &) = delete;
+
     bool intersect(const Ray &ray) { return true; }
 
     bool intersect(const Ray &ray, float &tnear, uint32_t &index) const
@@ -227,6 +342,13 @@ public:
     {
         return m->hasEmission();
     }
+    // 光源层次结构按单个三角形建立，朝向与功率都更精确
+    void collectEmitters(std::vector<Object *> &emitters) override
+    {
+        if (hasEmit())
+            for (auto &tri : triangles)
+                emitters.push_back(&tri);
+    }
 
     Bounds3 bounding_box;
     std::unique_ptr<Vector3f[]> vertices;
@@ -235,8 +357,10 @@ public:
     std::unique_ptr<Vector2f[]> stCoordinates;
 
     std::vector<Triangle> triangles;
+    // 变换前的顶点，每个三角形3个，供setTransform使用
+    std::vector<Vector3f> objectVertices;
 
-    BVHAccel *bvh;
+    std::unique_ptr<BVHAccel> bvh;
     float area;
 
     Material *m;
@@ -251,9 +375,54 @@ inline bool Triangle::intersect(const Ray &ray, float &tnear,
 
 inline Bounds3 Triangle::getBounds() { return Union(Bounds3(v0, v1), v2); }
 
+/**
+ * @brief 依次用box的6个平面裁剪三角形（Sutherland-Hodgman），返回裁剪后多边形的包围盒；
+ *        每个平面至多增加一个顶点，多边形不超过9个顶点
+ */
+inline Bounds3 Triangle::getClippedBounds(const Bounds3 &box)
+{
+    Vector3f polygon[10] = {v0, v1, v2}, clipped[10];
+    int n = 3;
+    for (int axis = 0; axis < 3; ++axis)
+        for (int side = 0; side < 2; ++side)
+        {
+            float plane = side ? box.pMax[axis] : box.pMin[axis];
+            // 在平面内侧时距离非负
+            auto distance = [&](const Vector3f &p)
+            { return side ? plane - p[axis] : p[axis] - plane; };
+            // 多边形整体在平面内侧时无需裁剪
+            bool inside = true;
+            for (int i = 0; i < n && inside; ++i)
+                inside = distance(polygon[i]) >= 0;
+            if (inside)
+                continue;
+            int m = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                const Vector3f &a = polygon[i], &b = polygon[(i + 1) % n];
+                float da = distance(a), db = distance(b);
+                if (da >= 0)
+                    clipped[m++] = a;
+                if ((da >= 0) != (db >= 0))
+                    clipped[m++] = a + (b - a) * (da / (da - db));
+            }
+            n = m;
+            if (n == 0)
+                return Bounds3();
+            std::copy(clipped, clipped + n, polygon);
+        }
+
+    Bounds3 bounds;
+    for (int i = 0; i < n; ++i)
+        bounds = Union(bounds, polygon[i]);
+    // 交点的舍入误差可能略微越出box
+    return Overlap(bounds, box);
+}
+
 inline Intersection Triangle::getIntersection(Ray ray)
 {
     Intersection inter;
+    STAT_INC(triangleTests);
 
     if (dotProduct(ray.direction, normal) > 0)
         return inter;
@@ -284,6 +453,8 @@ inline Intersection Triangle::getIntersection(Ray ray)
     inter.coords = ray(t_tmp);   // 交点笛卡尔坐标(Vector3f)
     inter.distance = t_tmp;      // 交点距离（用o+dir*t中的t描述）
     inter.normal = this->normal; // 相交对象的法线
+    inter.tcoords = t0 * float(1 - u - v) + t1 * float(u) + t2 * float(v); // 插值的纹理坐标
+    inter.uvScale = uvScale;
 
     return inter;
 }
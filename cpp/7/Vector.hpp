@@ -14,8 +14,8 @@ public:
     Vector3f operator*(const float &r) const { return Vector3f(x * r, y * r, z * r); }
     Vector3f operator/(const float &r) const { return Vector3f(x / r, y / r, z / r); }
 
-    float norm() { return std::sqrt(x * x + y * y + z * z); }
-    Vector3f normalized()
+    float norm() const { return std::sqrt(x * x + y * y + z * z); }
+    Vector3f normalized() const
     {
         float n = std::sqrt(x * x + y * y + z * z);
         return Vector3f(x / n, y / n, z / n);
@@ -30,6 +30,21 @@ public:
         x += v.x, y += v.y, z += v.z;
         return *this;
     }
+    Vector3f &operator-=(const Vector3f &v)
+    {
+        x -= v.x, y -= v.y, z -= v.z;
+        return *this;
+    }
+    Vector3f &operator*=(const Vector3f &v)
+    {
+        x *= v.x, y *= v.y, z *= v.z;
+        return *this;
+    }
+    Vector3f &operator*=(const float &r)
+    {
+        x *= r, y *= r, z *= r;
+        return *this;
+    }
     friend Vector3f operator*(const float &r, const Vector3f &v)
     {
         return Vector3f(v.x * r, v.y * r, v.z * r);
@@ -38,8 +53,8 @@ public:
     {
         return os << v.x << ", " << v.y << ", " << v.z;
     }
-    double operator[](int index) const;
-    double &operator[](int index);
+    float operator[](int index) const { return (&x)[index]; }
+    float &operator[](int index) { return (&x)[index]; }
 
     static Vector3f Min(const Vector3f &p1, const Vector3f &p2)
     {
@@ -54,10 +69,8 @@ public:
     }
 };
 
-inline double Vector3f::operator[](int index) const
-{
-    return (&x)[index];
-}
+// 帧缓冲等按float数组批量处理Vector3f
+static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f must be three packed floats");
 
 class Vector2f
 {
@@ -98,4 +111,10 @@ inline Vector3f crossProduct(const Vector3f &a, const Vector3f &b)
         a.y * b.z - a.z * b.y,
         a.z * b.x - a.x * b.z,
         a.x * b.y - a.y * b.x);
+}
+
+// 线性RGB的亮度（Rec. 709权重）
+inline float luminance(const Vector3f &c)
+{
+    return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
 }
\ No newline at end of file
@@ -0,0 +1,560 @@
+// HW7光线追踪核心函数的微基准测试，输出机器可读的JSON结果与多线程强扩展性表格
+//
+// 编译：g++ -std=c++17 -O2 -fopenmp benchmark.cpp -o benchmark
+// 运行：./benchmark [--json benchmark.json] [--max-threads N] [--filter 名称子串] [--min-time 秒]
+
+#include "Renderer.hpp"
+#include "Scene.hpp"
+#include "Scenes.hpp"
+#include "Simd.hpp"
+#include "Sphere.hpp"
+#include "Triangle.hpp"
+#include "Vector.hpp"
+#include "global.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchmarkResult
+{
+    std::string name;
+    std::string params;
+    long long iterations;
+    double nsPerOp;
+    double seconds;
+};
+
+struct ScalingResult
+{
+    std::string scene;
+    int threads;
+    double seconds;
+    double speedup;
+    double efficiency;
+};
+
+// 防止编译器优化掉被测代码
+static volatile float sink;
+
+class Benchmark
+{
+public:
+    double minTime = 0.2;
+    int repeats = 5;
+    std::string filter;
+    std::vector<BenchmarkResult> results;
+
+    bool enabled(const std::string &name) const
+    {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    /**
+     * @brief 运行一项基准测试：先倍增迭代次数直到单次耗时超过minTime/10，
+     *        再按minTime折算迭代次数重复repeats次，取每次操作耗时的中位数
+     * @param body 执行n次被测操作
+     */
+    void run(const std::string &name, const std::string &params, const std::function<void(long long)> &body)
+    {
+        if (!enabled(name))
+            return;
+        long long n = 1;
+        double t = time(body, n);
+        while (t < minTime / 10 && n < (1ll << 40))
+        {
+            n *= 2;
+            t = time(body, n);
+        }
+        n = std::max(1ll, (long long)(n * minTime / std::max(t, 1e-9)));
+
+        std::vector<double> samples;
+        double total = 0;
+        for (int r = 0; r < repeats; ++r)
+        {
+            double s = time(body, n);
+            samples.push_back(s / n * 1e9);
+            total += s;
+        }
+        std::sort(samples.begin(), samples.end());
+        results.push_back({name, params, n, samples[samples.size() / 2], total});
+        printf("%-28s %-32s %14.1f ns/op  (%lld iterations)\n", name.c_str(), params.c_str(),
+               samples[samples.size() / 2], n);
+        fflush(stdout);
+    }
+
+private:
+    static double time(const std::function<void(long long)> &body, long long n)
+    {
+        auto start = std::chrono::steady_clock::now();
+        body(n);
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// 生成固定种子的随机光线：起点位于半径为radius的球面附近，指向target包围盒内的随机点
+static std::vector<Ray> makeRays(const Bounds3 &target, float radius, int count, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(0.f, 1.f);
+    Vector3f center = 0.5f * (target.pMin + target.pMax);
+    Vector3f extent = target.pMax - target.pMin;
+    std::vector<Ray> rays;
+    rays.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        float z = 1 - 2 * u(rng), phi = 2 * M_PI * u(rng);
+        float r = std::sqrt(std::max(0.f, 1 - z * z));
+        Vector3f origin = center + radius * Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+        Vector3f p = target.pMin + Vector3f(u(rng), u(rng), u(rng)) * extent;
+        rays.emplace_back(origin, normalize(p - origin));
+    }
+    return rays;
+}
+
+static std::vector<Object *> trianglePointers(const std::vector<MeshTriangle *> &meshes)
+{
+    std::vector<Object *> ptrs;
+    for (auto mesh : meshes)
+        for (auto &tri : mesh->triangles)
+            ptrs.push_back(&tri);
+    return ptrs;
+}
+
+static void benchIntersectors(Benchmark &bench)
+{
+    const int numRays = 1024;
+
+    Bounds3 box(Vector3f(-1, -1, -1), Vector3f(1, 1, 1));
+    auto boxRays = makeRays(Bounds3(Vector3f(-1.5f), Vector3f(1.5f)), 5, numRays, 1);
+    bench.run("Bounds3::IntersectP", "unit box", [&](long long n)
+              {
+                  int hits = 0;
+                  for (long long i = 0; i < n; ++i)
+                  {
+                      const Ray &ray = boxRays[i & (numRays - 1)];
+                      hits += box.IntersectP(ray, ray.direction_inv,
+                                             {int(ray.direction.x > 0), int(ray.direction.y > 0), int(ray.direction.z > 0)});
+                  }
+                  sink = hits;
+              });
+
+    Triangle tri(Vector3f(-1, -1, 0), Vector3f(1, -1, 0), Vector3f(0, 1, 0), defaultMaterial());
+    auto triRays = makeRays(Bounds3(Vector3f(-1.5f, -1.5f, -0.1f), Vector3f(1.5f, 1.5f, 0.1f)), 5, numRays, 2);
+    bench.run("Triangle::getIntersection", "single triangle", [&](long long n)
+              {
+                  float sum = 0;
+                  for (long long i = 0; i < n; ++i)
+                      sum += tri.getIntersection(triRays[i & (numRays - 1)]).happened;
+                  sink = sum;
+              });
+
+    Sphere sphere(Vector3f(0), 1);
+    auto sphereRays = makeRays(Bounds3(Vector3f(-1.5f), Vector3f(1.5f)), 5, numRays, 3);
+    bench.run("Sphere::getIntersection", "unit sphere", [&](long long n)
+              {
+                  float sum = 0;
+                  for (long long i = 0; i < n; ++i)
+                      sum += sphere.getIntersection(sphereRays[i & (numRays - 1)]).happened;
+                  sink = sum;
+              });
+}
+
+/**
+ * @brief 快速数学函数：标准库、fastmath标量与fastmath Vec8f三种实现每个元素的耗时，
+ *        以及与double精度结果比较的最大误差（Simd.hpp中注释给出的误差界即由此测得）
+ */
+static void benchFastMath(Benchmark &bench)
+{
+    const int count = 1024;
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> angle(0.f, 2 * M_PI), unit(1e-6f, 1.f);
+    std::vector<float> angles(count), values(count), out(count);
+    for (int i = 0; i < count; ++i)
+    {
+        angles[i] = angle(rng);
+        values[i] = unit(rng);
+    }
+
+    struct Kernel
+    {
+        const char *name;
+        const std::vector<float> &input;
+        float (*reference)(float);
+        float (*scalar)(float);
+        Vec8f (*vector)(const Vec8f &);
+        double (*exact)(double);
+    };
+    Kernel kernels[] = {
+        {"sin", angles, [](float x) { return std::sin(x); }, [](float x) { return fastmath::sin(x); },
+         [](const Vec8f &x) { return fastmath::sin(x); }, [](double x) { return std::sin(x); }},
+        {"pow(x, 0.6)", values, [](float x) { return std::pow(x, 0.6f); }, [](float x) { return fastmath::pow(x, 0.6f); },
+         [](const Vec8f &x) { return fastmath::pow(x, Vec8f(0.6f)); }, [](double x) { return std::pow(x, 0.6); }},
+        {"rsqrt", values, [](float x) { return 1 / std::sqrt(x); }, [](float x) { return fastmath::rsqrt(x); },
+         [](const Vec8f &x) { return fastmath::rsqrt(x); }, [](double x) { return 1 / std::sqrt(x); }},
+    };
+    for (auto &k : kernels)
+    {
+        std::string params = std::string(k.name) + " per element";
+        bench.run("std", params, [&](long long n)
+                  {
+                      for (long long i = 0; i < n; ++i)
+                          out[i & (count - 1)] = k.reference(k.input[i & (count - 1)]);
+                      sink = out[0];
+                  });
+        bench.run("fastmath float", params, [&](long long n)
+                  {
+                      for (long long i = 0; i < n; ++i)
+                          out[i & (count - 1)] = k.scalar(k.input[i & (count - 1)]);
+                      sink = out[0];
+                  });
+        bench.run("fastmath Vec8f", params, [&](long long n)
+                  {
+                      for (long long i = 0; i < n; i += 8)
+                          k.vector(Vec8f::load(&k.input[i & (count - 1)])).store(&out[i & (count - 1)]);
+                      sink = out[0];
+                  });
+
+        double maxError = 0;
+        for (int i = 0; i < count; i += 8)
+        {
+            Vec8f v = k.vector(Vec8f::load(&k.input[i]));
+            for (int j = 0; j < 8; ++j)
+            {
+                double exact = k.exact(k.input[i + j]);
+                maxError = std::max(maxError, std::fabs(v[j] - exact) / std::max(1.0, std::fabs(exact)));
+            }
+        }
+        if (bench.enabled("fastmath Vec8f"))
+            printf("%-28s %-32s %14.2e\n", "fastmath max error", k.name, maxError);
+    }
+
+    // 一条光线与8个包围盒：Vec3x8的slab测试与逐个Bounds3::IntersectP
+    const int numRays = 1024;
+    auto rays = makeRays(Bounds3(Vector3f(-2.f), Vector3f(2.f)), 6, numRays, 6);
+    std::uniform_real_distribution<float> center(-2.f, 2.f);
+    Bounds3 boxes[8];
+    float lo[3][8], hi[3][8];
+    for (int b = 0; b < 8; ++b)
+    {
+        Vector3f c(center(rng), center(rng), center(rng));
+        boxes[b] = Bounds3(c - Vector3f(0.5f), c + Vector3f(0.5f));
+        for (int i = 0; i < 3; ++i)
+        {
+            lo[i][b] = boxes[b].pMin[i];
+            hi[i][b] = boxes[b].pMax[i];
+        }
+    }
+    Vec3x8 pMin(Vec8f::load(lo[0]), Vec8f::load(lo[1]), Vec8f::load(lo[2]));
+    Vec3x8 pMax(Vec8f::load(hi[0]), Vec8f::load(hi[1]), Vec8f::load(hi[2]));
+    bench.run("Bounds3::IntersectP", "8 boxes, one at a time", [&](long long n)
+              {
+                  int hits = 0;
+                  for (long long i = 0; i < n; ++i)
+                  {
+                      const Ray &ray = rays[i & (numRays - 1)];
+                      std::array<int, 3> dirIsNeg = {int(ray.direction.x > 0), int(ray.direction.y > 0), int(ray.direction.z > 0)};
+                      for (auto &box : boxes)
+                          hits += box.IntersectP(ray, ray.direction_inv, dirIsNeg);
+                  }
+                  sink = hits;
+              });
+    bench.run("simd::intersectBoxes", "8 boxes, Vec3x8", [&](long long n)
+              {
+                  int hits = 0;
+                  for (long long i = 0; i < n; ++i)
+                  {
+                      const Ray &ray = rays[i & (numRays - 1)];
+                      const bool dirIsNeg[3] = {!(ray.direction.x > 0), !(ray.direction.y > 0), !(ray.direction.z > 0)};
+                      hits += __builtin_popcount(simd::movemask(simd::intersectBoxes(pMin, pMax, ray.origin, ray.direction_inv, dirIsNeg)));
+                  }
+                  sink = hits;
+              });
+}
+
+static void benchBVH(Benchmark &bench)
+{
+    Scene scene(1, 1);
+    Material *white = scene.Create<Material>(DIFFUSE, Vector3f(0.0f));
+    MeshTriangle *bunny = scene.Create<MeshTriangle>("./models/bunny/bunny.obj", white, Vector3f(200, -60, 150), Vector3f(-1500, 1500, -1500));
+    std::vector<MeshTriangle *> cornell;
+    for (const char *name : {"floor", "shortbox", "tallbox", "left", "right", "light"})
+        cornell.push_back(scene.Create<MeshTriangle>(std::string("./models/cornellbox/") + name + ".obj", white));
+
+    struct Input
+    {
+        const char *name;
+        std::vector<Object *> prims;
+    };
+    std::vector<Input> inputs = {{"bunny", trianglePointers({bunny})}, {"cornell", trianglePointers(cornell)}};
+
+    const int numRays = 4096;
+    for (auto &input : inputs)
+    {
+        for (auto split : {BVHAccel::SplitMethod::NAIVE, BVHAccel::SplitMethod::SAH, BVHAccel::SplitMethod::LBVH,
+                           BVHAccel::SplitMethod::SBVH})
+            for (int maxPrims : {1, 2, 4, 8, 16})
+            {
+                const char *splitNames[] = {"naive", "sah", "lbvh", "sbvh"};
+                std::string params = std::string(input.name) + " (" + std::to_string(input.prims.size()) +
+                                     " tris) split=" + splitNames[(int)split] +
+                                     " maxPrimsInNode=" + std::to_string(maxPrims);
+                bench.run("BVHAccel::build", params, [&](long long n)
+                          {
+                              for (long long i = 0; i < n; ++i)
+                              {
+                                  BVHAccel bvh(input.prims, maxPrims, split);
+                                  sink = bvh.root->area;
+                              }
+                          });
+
+                BVHAccel bvh(input.prims, maxPrims, split);
+                auto rays = makeRays(bvh.root->bounds, 2000, numRays, 4);
+                bench.run("BVHAccel::Intersect", params, [&](long long n)
+                          {
+                              float sum = 0;
+                              for (long long i = 0; i < n; ++i)
+                                  sum += bvh.Intersect(rays[i & (numRays - 1)]).happened;
+                              sink = sum;
+                          });
+
+                // 量化节点：同一棵树、同一组光线，比较遍历速度与每个节点的字节数
+                bvh.compress();
+                bench.run("BVHAccel::Intersect", params + " quantized", [&](long long n)
+                          {
+                              float sum = 0;
+                              for (long long i = 0; i < n; ++i)
+                                  sum += bvh.Intersect(rays[i & (numRays - 1)]).happened;
+                              sink = sum;
+                          });
+                size_t numNodes = 2 * bvh.quantizedNodes.size() + 1;
+                if (bench.enabled("BVHAccel::Intersect"))
+                    printf("%-28s %-32s %8zu nodes %6.1f -> %4.1f bytes/node\n", "BVHAccel::compress", params.c_str(),
+                           numNodes, (double)sizeof(BVHBuildNode),
+                           (double)(bvh.quantizedNodes.size() * sizeof(QuantizedBVHNode)) / numNodes);
+            }
+
+        // 延迟构建只构建上层，其余子树在首次被光线到达时展开
+        std::string params = std::string(input.name) + " (" + std::to_string(input.prims.size()) + " tris) split=sah lazy";
+        BVHAccel::lazyBuild = true;
+        bench.run("BVHAccel::build", params, [&](long long n)
+                  {
+                      for (long long i = 0; i < n; ++i)
+                      {
+                          BVHAccel bvh(input.prims, 1, BVHAccel::SplitMethod::SAH);
+                          sink = bvh.root->area;
+                      }
+                  });
+        BVHAccel::lazyBuild = false;
+    }
+}
+
+// 与Renderer相同的相机，生成res x res的像素中心光线
+static std::vector<Ray> cameraRays(const Scene &scene, int res)
+{
+    float scale = tan(deg2rad(scene.fov * 0.5));
+    Vector3f eye_pos(278, 273, -800);
+    std::vector<Ray> rays;
+    for (int j = 0; j < res; ++j)
+        for (int i = 0; i < res; ++i)
+        {
+            float x = (2 * (i + 0.5f) / res - 1) * scale;
+            float y = (1 - 2 * (j + 0.5f) / res) * scale;
+            rays.emplace_back(eye_pos, normalize(Vector3f(-x, y, 1)));
+        }
+    return rays;
+}
+
+static void benchScenes(Benchmark &bench, int maxThreads, std::vector<ScalingResult> &scaling)
+{
+    std::vector<std::pair<const char *, void (*)(Scene &)>> scenes = {
+        {"scene1", buildScene1}, {"scene2", buildScene2}, {"scene3", buildScene3}};
+
+    for (auto &entry : scenes)
+    {
+        const int res = 64;
+        Scene scene(res, res);
+        entry.second(scene);
+
+        auto rays = cameraRays(scene, 32);
+        bench.run("Scene::castRay", std::string(entry.first) + " seed=7", [&](long long n)
+                  {
+                      // 每轮使用相同的种子，单线程下路径完全可复现
+                      set_random_seed(7);
+                      Vector3f sum;
+                      for (long long i = 0; i < n; ++i)
+                          sum += scene.castRay(rays[i % rays.size()], 0);
+                      sink = sum.x + sum.y + sum.z;
+                  });
+
+        if (!bench.enabled("Renderer::Render"))
+            continue;
+        Renderer r;
+        r.verbose = false;
+        r.filename = "benchmark.ppm";
+        const int spp = 16;
+        // 线程数取1, 2, 4, ...，最后补上maxThreads
+        std::vector<int> threadCounts;
+        for (int threads = 1; threads < maxThreads; threads *= 2)
+            threadCounts.push_back(threads);
+        threadCounts.push_back(maxThreads);
+
+        double baseline = 0;
+        for (int threads : threadCounts)
+        {
+            std::string params = std::string(entry.first) + " " + std::to_string(res) + "x" + std::to_string(res) +
+                                 " spp=" + std::to_string(spp) + " threads=" + std::to_string(threads);
+            auto start = std::chrono::steady_clock::now();
+            set_random_seed(7);
+            r.Render(scene, spp, threads);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (threads == 1)
+                baseline = seconds;
+            double pixelSamples = (double)res * res * spp;
+            bench.results.push_back({"Renderer::Render", params, 1, seconds / pixelSamples * 1e9, seconds});
+            scaling.push_back({entry.first, threads, seconds, baseline / seconds, baseline / seconds / threads});
+            printf("%-28s %-32s %14.1f ns/sample (%.3f s)\n", "Renderer::Render", params.c_str(),
+                   seconds / pixelSamples * 1e9, seconds);
+            fflush(stdout);
+        }
+        std::remove(r.filename.c_str());
+    }
+}
+
+// 延迟构建与量化节点同时打开：构造后、追踪任何光线之前不应展开任何延迟子树，也不生成量化节点
+static bool checkLazyCompress(Benchmark &bench)
+{
+    if (!bench.enabled("BVHAccel::lazy"))
+        return true;
+    Scene scene(1, 1);
+    MeshTriangle *bunny = scene.Create<MeshTriangle>("./models/bunny/bunny.obj", defaultMaterial(), Vector3f(200, -60, 150),
+                                                     Vector3f(-1500, 1500, -1500));
+    BVHAccel::lazyBuild = true;
+    BVHAccel::compressNodes = true;
+    BVHAccel bvh(trianglePointers({bunny}), 1, BVHAccel::SplitMethod::SAH);
+    BVHAccel::lazyBuild = false;
+    BVHAccel::compressNodes = false;
+    int expanded = bvh.expandedSubtrees.load();
+    bool ok = bvh.lazySubtrees > 0 && expanded == 0 && bvh.quantizedNodes.empty();
+    printf("%-28s %-32s %d lazy subtrees, %d expanded, %zu quantized nodes: %s\n", "BVHAccel::lazy",
+           "lazyBuild + compressNodes", bvh.lazySubtrees, expanded, bvh.quantizedNodes.size(), ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// 纹理分块缓存：纹理场景分别以很小（48 KB，每个分片一块）与足够大（64 MB）的缓存容量单线程渲染，
+// 缓存只影响读入哪些块，两次的输出须逐字节相同
+static bool benchTextureCache(Benchmark &bench)
+{
+    if (!bench.enabled("TextureCache"))
+        return true;
+    const int res = 128, spp = 16;
+    Scene scene(res, res);
+    buildTexturedScene(scene);
+    Renderer r;
+    r.verbose = false;
+    r.filename = "benchmark_texture.ppm";
+
+    size_t defaultCapacity = TextureCache::capacity;
+    const size_t capacities[] = {48u << 10, 64u << 20};
+    std::string outputs[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        TextureCache &cache = TextureCache::instance();
+        TextureCache::capacity = capacities[i];
+        cache.clear();
+        set_random_seed(7);
+        auto start = std::chrono::steady_clock::now();
+        r.Render(scene, spp, 1);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::ifstream in(r.filename, std::ios::binary);
+        outputs[i].assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+        std::string params = "textured " + std::to_string(res) + "x" + std::to_string(res) + " spp=" + std::to_string(spp) +
+                             " capacity=" + std::to_string(capacities[i] >> 10) + "KB";
+        double pixelSamples = (double)res * res * spp;
+        bench.results.push_back({"TextureCache", params, 1, seconds / pixelSamples * 1e9, seconds});
+        printf("%-28s %-32s %14.1f ns/sample (%.3f s), %llu hits, %llu misses, %zu KB resident\n", "TextureCache",
+               params.c_str(), seconds / pixelSamples * 1e9, seconds, (unsigned long long)cache.hits(),
+               (unsigned long long)cache.misses(), cache.bytes() >> 10);
+    }
+    TextureCache::capacity = defaultCapacity;
+    std::remove(r.filename.c_str());
+
+    bool identical = !outputs[0].empty() && outputs[0] == outputs[1];
+    printf("%-28s %-32s %s\n", "TextureCache", "small vs large capacity", identical ? "identical output" : "OUTPUT MISMATCH");
+    return identical;
+}
+
+static void writeJSON(const std::string &path, const Benchmark &bench, const std::vector<ScalingResult> &scaling)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s for writing\n", path.c_str());
+        return;
+    }
+    fprintf(fp, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < bench.results.size(); ++i)
+    {
+        auto &r = bench.results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"params\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.3f, \"seconds\": %.6f}%s\n",
+                r.name.c_str(), r.params.c_str(), r.iterations, r.nsPerOp, r.seconds,
+                i + 1 < bench.results.size() ? "," : "");
+    }
+    fprintf(fp, "  ],\n  \"scaling\": [\n");
+    for (size_t i = 0; i < scaling.size(); ++i)
+    {
+        auto &s = scaling[i];
+        fprintf(fp, "    {\"scene\": \"%s\", \"threads\": %d, \"seconds\": %.6f, \"speedup\": %.3f, \"efficiency\": %.3f}%s\n",
+                s.scene.c_str(), s.threads, s.seconds, s.speedup, s.efficiency, i + 1 < scaling.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+    Benchmark bench;
+    std::string json = "benchmark.json";
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--json"))
+            json = argv[i + 1];
+        else if (!strcmp(argv[i], "--max-threads"))
+            maxThreads = std::max(1, atoi(argv[i + 1]));
+        else if (!strcmp(argv[i], "--filter"))
+            bench.filter = argv[i + 1];
+        else if (!strcmp(argv[i], "--min-time"))
+            bench.minTime = atof(argv[i + 1]);
+    }
+    BVHAccel::verbose = false;
+
+    std::vector<ScalingResult> scaling;
+    benchIntersectors(bench);
+    benchFastMath(bench);
+    benchBVH(bench);
+    benchScenes(bench, maxThreads, scaling);
+    bool lazyOk = checkLazyCompress(bench);
+    bool texturesOk = benchTextureCache(bench);
+
+    if (!scaling.empty())
+    {
+        printf("\nStrong scaling (Renderer::Render):\n");
+        printf("%-8s %8s %12s %10s %11s\n", "scene", "threads", "seconds", "speedup", "efficiency");
+        for (auto &s : scaling)
+            printf("%-8s %8d %12.3f %10.2f %10.1f%%\n", s.scene.c_str(), s.threads, s.seconds, s.speedup, s.efficiency * 100);
+    }
+
+    writeJSON(json, bench, scaling);
+    printf("\nResults written to %s\n", json.c_str());
+    return lazyOk && texturesOk ? 0 : 1;
+}
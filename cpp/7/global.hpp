@@ -3,6 +3,9 @@
 #include <iostream>
 #include <cmath>
 #include <random>
+#include <atomic>
+#include <cstdint>
+#include <limits>
 
 #undef M_PI
 #define M_PI 3.141592653589793f
@@ -15,6 +18,14 @@ inline float clamp(const float &lo, const float &hi, const float &v)
     return std::max(lo, std::min(hi, v));
 }
 
+// 浮点数的原子加法（比较并交换循环），供多线程累加记录使用
+inline void atomicAdd(std::atomic<float> &a, float value)
+{
+    float old = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(old, old + value, std::memory_order_relaxed))
+        ;
+}
+
 inline bool solveQuadratic(const float &a, const float &b, const float &c, float &x0, float &x1)
 {
     float discr = b * b - 4 * a * c;
@@ -33,17 +44,50 @@ inline bool solveQuadratic(const float &a, const float &b, const float &c, float
     return true;
 }
 
+namespace detail
+{
+    /**
+     * \brief 随机数种子（random_device只在首次使用时调用一次；注意random_device不是跨平台的，
+     * 旧版MinGW上每次结果相同，因此各线程的种子再由线程序号区分）
+     */
+    inline uint32_t &baseSeed()
+    {
+        static uint32_t seed = std::random_device()();
+        return seed;
+    }
+    // 每次设置种子后递增，线程据此得知需要重新播种
+    inline std::atomic<uint32_t> seedGeneration{0};
+    inline std::atomic<uint32_t> seededThreads{0};
+}
+
 /**
- * \brief get random float (注意random_device不是跨平台的，MinGW使用需增加static
- * 且增加static后对象实例化次数为一次，大大减小了时间开销）
+ * \brief 设置随机数种子。之后每个线程首次取随机数时以 seed 与线程播种顺序重新播种，
+ * 单线程下结果可完全复现（用于基准测试与回归测试）
+ */
+inline void set_random_seed(uint32_t seed)
+{
+    detail::baseSeed() = seed;
+    detail::seededThreads = 0;
+    detail::seedGeneration++;
+}
+
+/**
+ * \brief get random float（每个线程独立的随机数引擎，避免多线程共享同一引擎产生数据竞争；
+ * 引擎只在线程首次使用或重新设置种子时播种，大大减小了时间开销）
  * \return float 
  */
 inline float get_random_float()
 {
-    static std::random_device dev;
-    static std::mt19937 rng(dev());
-    static std::uniform_real_distribution<float> dist(0.f, 1.f);
+    thread_local std::mt19937 rng;
+    thread_local uint32_t generation = ~0u;
+    thread_local std::uniform_real_distribution<float> dist(0.f, 1.f);
 
+    uint32_t current = detail::seedGeneration.load(std::memory_order_acquire);
+    if (generation != current)
+    {
+        generation = current;
+        rng.seed(detail::baseSeed() + 0x9E3779B9u * detail::seededThreads++);
+    }
     return dist(rng);
 }
 
@@ -1,52 +1,83 @@
 #include "Renderer.hpp"
 #include "Scene.hpp"
+#include "Scenes.hpp"
 #include "Triangle.hpp"
 #include "Sphere.hpp"
 #include "Vector.hpp"
 #include "global.hpp"
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 
 // In the main function of the program, we create the scene (create objects and
 // lights) as well as set the options for the render (image width and height,
 // maximum recursion depth, field-of-view, etc.). We then call the render
 // function().
 
-inline void scene1()
-{
-    Scene scene(784, 784);
-
-    Material *red = new Material(DIFFUSE, Vector3f(0.0f));
-    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
-    Material *green = new Material(DIFFUSE, Vector3f(0.0f));
-    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
-    Material *white = new Material(DIFFUSE, Vector3f(0.0f));
-    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
-    Material *light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
-    light->Kd = Vector3f(0.65f);
-
-    MeshTriangle floor("./models/cornellbox/floor.obj", white);
-    MeshTriangle shortbox("./models/cornellbox/shortbox.obj", white);
-    MeshTriangle tallbox("./models/cornellbox/tallbox.obj", white);
-    MeshTriangle left("./models/cornellbox/left.obj", red);
-    MeshTriangle right("./models/cornellbox/right.obj", green);
-    MeshTriangle light_("./models/cornellbox/light.obj", light);
-
-    scene.Add(&floor);
-    scene.Add(&shortbox);
-    scene.Add(&tallbox);
-    scene.Add(&left);
-    scene.Add(&right);
-    scene.Add(&light_);
-
-    scene.buildBVH();
+// 渐进式渲染：先输出1spp预览图，再逐轮细化并刷新输出图像
+const bool progressive = false;
+// 渐进式渲染的墙钟时间预算（秒），<=0表示不限时
+const double time_budget = 0;
+// ReSTIR直接光照：每像素重采样多个光源候选并在相邻像素间复用，每个采样只发射一条直接光照的阴影光线
+const bool restir_direct = false;
+// 路径引导：渐进式渲染的各轮之间学习入射辐射亮度的SD-tree，并与BSDF混合采样间接光照方向（开启时场景2、3按渐进式渲染）
+const bool path_guiding = false;
+// 辐射亮度缓存：第一次弹射之后的漫反射表面查询世界空间的哈希网格缓存，格子样本数达到radiance_cache_samples后不再继续追踪路径
+const bool radiance_cache = false;
+const int radiance_cache_samples = 32;
+// 随机渐进式光子映射：每像素spp轮，每轮从面光源发射与像素数相同的光子，收敛镜面反射形成的焦散
+const bool photon_mapping = false;
+// 双向路径追踪：每个采样分别生成相机子路径与光源子路径，按所有连接策略组合并以多重重要性采样加权
+const bool bidirectional = false;
+// 调试渲染：输出BVH节点访问数、图元求交数与路径长度的伪彩色图及BVH逐层SAH开销（需 -DRT_STATS）
+const bool debug_heatmap = false;
+// 复用首个交点重新渲染场景1的次数：第一次渲染记录相机光线的首个交点（G-buffer），之后每轮修改左墙的材质并跳过相机光线求交，
+// 最后与不复用的完整渲染比较，0表示不渲染
+const int rerender_passes = 0;
+// 转台动画的帧数：bunny每帧绕竖直轴旋转，更新BVH后以64spp渲染到frame_XXX.ppm，0表示不渲染动画
+const int animation_frames = 0;
+// 分页几何：bunny预处理为分页文件后按需换入渲染场景2，并输出缺页次数与常驻内存；paged_budget为常驻内存上限（字节，0不限）
+const bool paged_geometry = false;
+const size_t paged_budget = 0;
+// 同时渲染场景4（GGX粗糙金属bunny与粗糙塑料盒子）
+const bool microfacet_scene = false;
+// 同时渲染多光源场景（上千个小三角形光源，由光源层次结构采样）
+const bool many_lights_scene = false;
+// 同时渲染纹理场景（场景1的地面贴上程序生成的棋盘格PPM）
+const bool textured_scene = false;
+// 经纬度HDR环境贴图（PFM），非空时渲染环境光场景
+const std::string environment_map = "";
 
+inline void render(const Scene &scene)
+{
     Renderer r;
     int spp = 1024;
     int num_workers = 12;
 
     auto start = std::chrono::system_clock::now();
-    r.Render(scene, spp, num_workers);
+    if (debug_heatmap)
+        r.RenderDebug(scene, 16, num_workers);
+    else if (restir_direct)
+        r.RenderReSTIR(scene, spp, num_workers);
+    else if (photon_mapping)
+        r.RenderSPPM(scene, spp, num_workers);
+    else if (bidirectional)
+        r.RenderBDPT(scene, spp, num_workers);
+    else if (progressive || scene.guide)
+        r.RenderProgressive(scene, spp, num_workers, time_budget);
+    else
+        r.Render(scene, spp, num_workers);
     auto stop = std::chrono::system_clock::now();
+    if (scene.radianceCache)
+    {
+        const RadianceCache &cache = *scene.radianceCache;
+        uint64_t queries = cache.hitCount() + cache.missCount() + cache.updateCount();
+        printf("Radiance cache: %llu hits, %llu misses, %llu updates (hit rate %.1f%%), %zu cells, %.1f MB\n",
+               (unsigned long long)cache.hitCount(), (unsigned long long)cache.missCount(),
+               (unsigned long long)cache.updateCount(), queries ? 100.0 * cache.hitCount() / queries : 0.0,
+               cache.cellCount(), cache.bytes() / 1048576.0);
+    }
 
     std::cout << "Render complete: \n";
     std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::hours>(stop - start).count() << " hours\n";
@@ -54,104 +85,196 @@ inline void scene1()
     std::cout << "          : " << std::chrono::duration_cast<std::chrono::seconds>(stop - start).count() << " seconds\n";
 }
 
+inline void enableRadianceCache(Scene &scene)
+{
+    scene.enableRadianceCache();
+    scene.radianceCache->minSamples = radiance_cache_samples;
+}
+
+inline void scene1()
+{
+    Scene scene(784, 784);
+    buildScene1(scene);
+    if (radiance_cache)
+        enableRadianceCache(scene);
+    render(scene);
+}
+
 inline void scene2()
 {
     // Change the definition here to change resolution
     Scene scene(784, 784);
+    buildScene2(scene);
+    if (path_guiding)
+        scene.enablePathGuiding();
+    if (radiance_cache)
+        enableRadianceCache(scene);
+    render(scene);
+}
 
-    Material *red = new Material(DIFFUSE, Vector3f(0.0f));
-    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
-    Material *green = new Material(DIFFUSE, Vector3f(0.0f));
-    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
-    Material *white = new Material(DIFFUSE, Vector3f(0.0f));
-    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
-    Material *glossy_white = new Material(GLOSSY, Vector3f(0.0f));
-    glossy_white->Kd = Vector3f(0.0f, 0.0f, 0.0f);
-    glossy_white->ior = 40.0f;
-    Material *light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
-    light->Kd = Vector3f(0.65f);
-
-    MeshTriangle floor("./models/cornellbox/floor.obj", white);
-    MeshTriangle tallbox("./models/cornellbox/tallbox.obj", glossy_white);
-    MeshTriangle bunny("./models/bunny/bunny.obj", glossy_white, Vector3f(200, -60, 150), Vector3f(-1500, 1500, -1500));
-    MeshTriangle left("./models/cornellbox/left.obj", red);
-    MeshTriangle right("./models/cornellbox/right.obj", green);
-    MeshTriangle light_("./models/cornellbox/light.obj", light);
-
-    scene.Add(&floor);
-    scene.Add(&tallbox);
-    scene.Add(&bunny);
-    scene.Add(&left);
-    scene.Add(&right);
-    scene.Add(&light_);
-
-    scene.buildBVH();
+inline void scene3()
+{
+    Scene scene(784, 784);
+    buildScene3(scene);
+    if (path_guiding)
+        scene.enablePathGuiding();
+    if (radiance_cache)
+        enableRadianceCache(scene);
+    render(scene);
+}
 
-    Renderer r;
-    int spp = 1024;
-    int num_workers = 12;
+inline void scene4()
+{
+    Scene scene(784, 784);
+    buildScene4(scene);
+    render(scene);
+}
 
-    auto start = std::chrono::system_clock::now();
-    r.Render(scene, spp, num_workers);
-    auto stop = std::chrono::system_clock::now();
+inline void manyLightsScene()
+{
+    Scene scene(784, 784);
+    buildManyLightsScene(scene);
+    render(scene);
+}
 
-    std::cout << "Render complete: \n";
-    std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::hours>(stop - start).count() << " hours\n";
-    std::cout << "          : " << std::chrono::duration_cast<std::chrono::minutes>(stop - start).count() << " minutes\n";
-    std::cout << "          : " << std::chrono::duration_cast<std::chrono::seconds>(stop - start).count() << " seconds\n";
+inline void texturedScene()
+{
+    Scene scene(784, 784);
+    buildTexturedScene(scene);
+    render(scene);
 }
 
-inline void scene3()
+inline void environmentScene(const std::string &path)
 {
     Scene scene(784, 784);
+    buildEnvironmentScene(scene, path);
+    render(scene);
+}
 
-    Material *red = new Material(DIFFUSE, Vector3f(0.0f));
-    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
-    Material *green = new Material(DIFFUSE, Vector3f(0.0f));
-    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
-    Material *white = new Material(DIFFUSE, Vector3f(0.0f));
-    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
-    Material *glossy_white = new Material(GLOSSY, Vector3f(0.0f));
-    glossy_white->Kd = Vector3f(0.0f, 0.0f, 0.0f);
-    glossy_white->ior = 40.0f;
-    Material *light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f + 0.058f, 0.747f + 0.258f, 0.747f) + 15.6f * Vector3f(0.740f + 0.287f, 0.740f + 0.160f, 0.740f) + 18.4f * Vector3f(0.737f + 0.642f, 0.737f + 0.159f, 0.737f)));
-    light->Kd = Vector3f(0.65f);
-
-    MeshTriangle floor("./models/cornellbox/floor.obj", white);
-    MeshTriangle shortbox("./models/cornellbox/shortbox.obj", glossy_white);
-    MeshTriangle tallbox("./models/cornellbox/tallbox.obj", glossy_white);
-    MeshTriangle left("./models/cornellbox/left.obj", red);
-    MeshTriangle right("./models/cornellbox/right.obj", green);
-    MeshTriangle light_("./models/cornellbox/light.obj", light);
-
-    scene.Add(&floor);
-    scene.Add(&shortbox);
-    scene.Add(&tallbox);
-    scene.Add(&left);
-    scene.Add(&right);
-    scene.Add(&light_);
-
-    scene.buildBVH();
+inline void animation(int frames)
+{
+    Scene scene(784, 784);
+    MeshTriangle *bunny = buildTurntableScene(scene);
+    Renderer r;
+    const char *results[] = {"refit", "partial rebuild", "full rebuild"};
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto meshUpdate = bunny->setTransform(Vector3f(200, -60, 150), Vector3f(-1500, 1500, -1500), 360.0f * frame / frames);
+        auto sceneUpdate = scene.updateBVH();
+        auto updated = std::chrono::steady_clock::now();
+
+        char filename[32];
+        snprintf(filename, sizeof(filename), "frame_%03d.ppm", frame);
+        r.filename = filename;
+        r.Render(scene, 64, 12);
+        auto stop = std::chrono::steady_clock::now();
+        printf("frame %d: bunny %s, scene %s, update %.2f ms, render %.1f s\n", frame,
+               results[(int)meshUpdate], results[(int)sceneUpdate],
+               std::chrono::duration<double, std::milli>(updated - start).count(),
+               std::chrono::duration<double>(stop - updated).count());
+    }
+}
+
+inline std::string readFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
 
+inline void rerender(int passes)
+{
+    Scene scene(784, 784);
+    // 每轮修改左墙的反照率，只改材质参数，几何体不变
+    Material *wall = buildCornellScene(scene);
+    const Vector3f colors[] = {Vector3f(0.63f, 0.065f, 0.05f), Vector3f(0.05f, 0.2f, 0.63f), Vector3f(0.6f, 0.55f, 0.1f)};
     Renderer r;
-    int spp = 1024;
-    int num_workers = 12;
+    r.reusePrimaryHits = true;
+    for (int pass = 0; pass <= passes; ++pass)
+    {
+        wall->Kd = colors[pass % 3];
+        scene.materials.commit(); // 材质参数在提交后才进入着色使用的核函数
+        char filename[32];
+        snprintf(filename, sizeof(filename), "rerender_%02d.ppm", pass);
+        r.filename = filename;
+        // 单线程、固定种子，使结果可与完整重新渲染逐字节比较
+        set_random_seed(1);
+        auto start = std::chrono::steady_clock::now();
+        r.Render(scene, 16, 1);
+        printf("pass %d: %.1f s, %llu primary hits reused, G-buffer %.1f MB\n", pass,
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+               (unsigned long long)r.primaryHits.reusedCount(), r.primaryHits.bytes() / 1048576.0);
+    }
 
-    auto start = std::chrono::system_clock::now();
-    r.Render(scene, spp, num_workers);
-    auto stop = std::chrono::system_clock::now();
+    // 最后一轮的材质参数下不复用首个交点完整渲染一次，结果应与复用时完全相同
+    Renderer full;
+    full.filename = "rerender_full.ppm";
+    set_random_seed(1);
+    full.Render(scene, 16, 1);
+    char last[32];
+    snprintf(last, sizeof(last), "rerender_%02d.ppm", passes);
+    printf("Reused primary hits %s the full re-render\n", readFile(last) == readFile(full.filename) ? "match" : "DIFFER from");
+}
 
-    std::cout << "Render complete: \n";
-    std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::hours>(stop - start).count() << " hours\n";
-    std::cout << "          : " << std::chrono::duration_cast<std::chrono::minutes>(stop - start).count() << " minutes\n";
-    std::cout << "          : " << std::chrono::duration_cast<std::chrono::seconds>(stop - start).count() << " seconds\n";
+inline void pagedScene(size_t budget)
+{
+    // 由OBJ预处理生成分页文件；文件缺失、格式版本不符或OBJ内容、变换、BVH参数变化（缓存键不符）时重新生成
+    std::string path = MeshCache::directory + "/bunny.page";
+    const std::string obj = "./models/bunny/bunny.obj";
+    const Vector3f trans(200, -60, 150), scale(-1500, 1500, -1500);
+    uint64_t source = MeshCache::key(obj, trans, scale, 4, BVHAccel::SplitMethod::SAH);
+    if (!PagedMesh::current(path, source))
+    {
+        std::filesystem::create_directories(MeshCache::directory);
+        MeshTriangle bunny(obj, defaultMaterial(), trans, scale, 4, BVHAccel::SplitMethod::SAH);
+        if (!PagedMesh::write(bunny, path, source))
+        {
+            std::cerr << "Cannot write paged mesh " << path << "\n";
+            return;
+        }
+    }
+    PagedMesh::residentBudget = budget;
+    Scene scene(784, 784);
+    PagedMesh *bunny = buildPagedScene(scene, path);
+    auto before = PagedMesh::pageFaults();
+    render(scene);
+    auto after = PagedMesh::pageFaults();
+    printf("Page faults: %ld minor, %ld major; bunny resident %.1f KB, trimmed %d times\n",
+           after.minor - before.minor, after.major - before.major, bunny->residentBytes() / 1024.0, bunny->trimCount());
 }
 
 int main(int argc, char **argv)
 {
+    if (animation_frames > 0)
+    {
+        animation(animation_frames);
+        return 0;
+    }
+    if (rerender_passes > 0)
+    {
+        rerender(rerender_passes);
+        return 0;
+    }
+    if (!environment_map.empty())
+    {
+        environmentScene(environment_map);
+        return 0;
+    }
+    if (paged_geometry)
+    {
+        pagedScene(paged_budget);
+        return 0;
+    }
+
     // Change the definition here to change resolution
     scene1();
     scene2();
     scene3();
+    if (microfacet_scene)
+        scene4();
+    if (many_lights_scene)
+        manyLightsScene();
+    if (textured_scene)
+        texturedScene();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,274 @@
+// HW7渲染质量-时间回归测试：按spp与线程数阶梯渲染三个场景，与cpp_out/7中的参考图像比较，
+// 计算RMSE、relMSE与SSIM并记录墙钟时间，得到每个场景的“误差-时间”曲线
+//
+// 编译：g++ -std=c++17 -O2 -fopenmp regression.cpp -o regression
+// 运行：./regression [--spp 1,4,16,64] [--threads 1,12] [--scale 4] [--gamma 0.6]
+//                    [--refs ../../cpp_out/7] [--scenes scene1,scene3] [--csv quality.csv]
+//
+// 参考图像为784x784的8位PPM；--scale N 时以784/N的分辨率渲染，参考图像先解码为线性辐射亮度，
+// 按N x N盒式滤波降采样后再以相同的Gamma编码，与低分辨率渲染（先平均线性辐射亮度再编码）一致。
+// --gamma须与参考图像的编码一致（cpp_out/7中的*_msaa.ppm与Renderer相同，以0.6为指数编码）
+
+#include "Renderer.hpp"
+#include "Scene.hpp"
+#include "Scenes.hpp"
+#include "global.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Image
+{
+    int width = 0, height = 0;
+    std::vector<float> data; // RGB，取值[0, 1]
+
+    float &at(int x, int y, int c) { return data[(y * width + x) * 3 + c]; }
+    float at(int x, int y, int c) const { return data[(y * width + x) * 3 + c]; }
+};
+
+struct QualitySample
+{
+    std::string scene;
+    int spp;
+    int threads;
+    double seconds;
+    double rmse;
+    double relMSE;
+    double ssim;
+};
+
+static bool loadPPM(const std::string &path, Image &img)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::string magic;
+    int maxval;
+    in >> magic >> img.width >> img.height >> maxval;
+    in.get();
+    if (magic != "P6" || maxval != 255 || img.width <= 0 || img.height <= 0)
+        return false;
+    std::vector<unsigned char> bytes(img.width * img.height * 3);
+    in.read((char *)bytes.data(), bytes.size());
+    if (!in)
+        return false;
+    img.data.resize(bytes.size());
+    for (size_t i = 0; i < bytes.size(); ++i)
+        img.data[i] = bytes[i] / 255.0f;
+    return true;
+}
+
+// factor x factor 盒式滤波降采样：以gamma为指数编码的图像先解码为线性值再平均，平均后重新编码
+static Image downsample(const Image &src, int factor, float gamma)
+{
+    Image dst;
+    dst.width = src.width / factor;
+    dst.height = src.height / factor;
+    dst.data.assign(dst.width * dst.height * 3, 0.0f);
+    float w = 1.0f / (factor * factor);
+    for (int y = 0; y < dst.height * factor; ++y)
+        for (int x = 0; x < dst.width * factor; ++x)
+            for (int c = 0; c < 3; ++c)
+                dst.at(x / factor, y / factor, c) += std::pow(src.at(x, y, c), 1 / gamma) * w;
+    for (float &v : dst.data)
+        v = std::pow(v, gamma);
+    return dst;
+}
+
+static double rmse(const Image &a, const Image &b)
+{
+    double sum = 0;
+    for (size_t i = 0; i < a.data.size(); ++i)
+        sum += (a.data[i] - b.data[i]) * (a.data[i] - b.data[i]);
+    return std::sqrt(sum / a.data.size());
+}
+
+// 相对均方误差，分母加0.01避免暗部像素主导
+static double relMSE(const Image &a, const Image &ref)
+{
+    double sum = 0;
+    for (size_t i = 0; i < a.data.size(); ++i)
+    {
+        double d = a.data[i] - ref.data[i];
+        sum += d * d / (ref.data[i] * ref.data[i] + 0.01);
+    }
+    return sum / a.data.size();
+}
+
+// 11x11、sigma=1.5的可分离高斯模糊
+static std::vector<float> gaussianBlur(const std::vector<float> &src, int width, int height)
+{
+    const int radius = 5;
+    float kernel[2 * radius + 1], sum = 0;
+    for (int i = -radius; i <= radius; ++i)
+        sum += kernel[i + radius] = std::exp(-i * i / (2 * 1.5f * 1.5f));
+    for (float &k : kernel)
+        k /= sum;
+
+    std::vector<float> tmp(src.size()), dst(src.size());
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float v = 0;
+            for (int i = -radius; i <= radius; ++i)
+                v += kernel[i + radius] * src[y * width + std::clamp(x + i, 0, width - 1)];
+            tmp[y * width + x] = v;
+        }
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float v = 0;
+            for (int i = -radius; i <= radius; ++i)
+                v += kernel[i + radius] * tmp[std::clamp(y + i, 0, height - 1) * width + x];
+            dst[y * width + x] = v;
+        }
+    return dst;
+}
+
+// 亮度通道上的平均SSIM（Wang et al. 2004）
+static double ssim(const Image &a, const Image &b)
+{
+    int n = a.width * a.height;
+    std::vector<float> x(n), y(n), xx(n), yy(n), xy(n);
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] = 0.2126f * a.data[i * 3] + 0.7152f * a.data[i * 3 + 1] + 0.0722f * a.data[i * 3 + 2];
+        y[i] = 0.2126f * b.data[i * 3] + 0.7152f * b.data[i * 3 + 1] + 0.0722f * b.data[i * 3 + 2];
+        xx[i] = x[i] * x[i];
+        yy[i] = y[i] * y[i];
+        xy[i] = x[i] * y[i];
+    }
+    auto mx = gaussianBlur(x, a.width, a.height), my = gaussianBlur(y, a.width, a.height);
+    auto sxx = gaussianBlur(xx, a.width, a.height), syy = gaussianBlur(yy, a.width, a.height);
+    auto sxy = gaussianBlur(xy, a.width, a.height);
+
+    const double C1 = 0.01 * 0.01, C2 = 0.03 * 0.03;
+    double sum = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        double vx = sxx[i] - mx[i] * mx[i], vy = syy[i] - my[i] * my[i], cov = sxy[i] - mx[i] * my[i];
+        sum += (2 * mx[i] * my[i] + C1) * (2 * cov + C2) /
+               ((mx[i] * mx[i] + my[i] * my[i] + C1) * (vx + vy + C2));
+    }
+    return sum / n;
+}
+
+static std::vector<int> parseList(const std::string &s)
+{
+    std::vector<int> values;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        values.push_back(atoi(item.c_str()));
+    return values;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int> sppLadder = {1, 4, 16, 64};
+    std::vector<int> threadLadder = {1};
+    std::string refs = "../../cpp_out/7";
+    std::string csv = "quality.csv";
+    std::string sceneFilter;
+    int scale = 4;
+    float gamma = 0.6f;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--spp"))
+            sppLadder = parseList(argv[i + 1]);
+        else if (!strcmp(argv[i], "--threads"))
+            threadLadder = parseList(argv[i + 1]);
+        else if (!strcmp(argv[i], "--scale"))
+            scale = std::max(1, atoi(argv[i + 1]));
+        else if (!strcmp(argv[i], "--gamma"))
+            gamma = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--refs"))
+            refs = argv[i + 1];
+        else if (!strcmp(argv[i], "--scenes"))
+            sceneFilter = argv[i + 1];
+        else if (!strcmp(argv[i], "--csv"))
+            csv = argv[i + 1];
+    }
+    BVHAccel::verbose = false;
+
+    std::vector<std::pair<std::string, void (*)(Scene &)>> scenes = {
+        {"scene1", buildScene1}, {"scene2", buildScene2}, {"scene3", buildScene3}};
+
+    std::vector<QualitySample> samples;
+    for (auto &entry : scenes)
+    {
+        if (!sceneFilter.empty() && sceneFilter.find(entry.first) == std::string::npos)
+            continue;
+
+        Image reference;
+        std::string refPath = refs + "/" + entry.first + "_784x784_spp1024_numw12_msaa.ppm";
+        if (!loadPPM(refPath, reference))
+        {
+            fprintf(stderr, "Cannot load reference %s\n", refPath.c_str());
+            continue;
+        }
+        if (reference.width % scale != 0 || reference.height % scale != 0)
+        {
+            fprintf(stderr, "Reference size %dx%d is not divisible by --scale %d\n", reference.width, reference.height, scale);
+            return 1;
+        }
+        if (scale > 1)
+            reference = downsample(reference, scale, gamma);
+
+        Scene scene(reference.width, reference.height);
+        entry.second(scene);
+
+        Renderer r;
+        r.verbose = false;
+        r.gamma = gamma;
+        r.filename = "regression.ppm";
+
+        printf("%s (%dx%d, reference %s)\n", entry.first.c_str(), scene.width, scene.height, refPath.c_str());
+        printf("%8s %8s %10s %10s %10s %8s\n", "spp", "threads", "seconds", "rmse", "relmse", "ssim");
+        for (int threads : threadLadder)
+            for (int spp : sppLadder)
+            {
+                set_random_seed(1);
+                auto start = std::chrono::steady_clock::now();
+                r.Render(scene, spp, threads);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                Image img;
+                if (!loadPPM(r.filename, img))
+                {
+                    fprintf(stderr, "Cannot load %s\n", r.filename.c_str());
+                    return 1;
+                }
+                QualitySample s{entry.first, spp, threads, seconds, rmse(img, reference), relMSE(img, reference), ssim(img, reference)};
+                samples.push_back(s);
+                printf("%8d %8d %10.3f %10.5f %10.5f %8.4f\n", spp, threads, seconds, s.rmse, s.relMSE, s.ssim);
+                fflush(stdout);
+            }
+        std::remove(r.filename.c_str());
+        printf("\n");
+    }
+
+    // 误差-时间曲线：每个场景按耗时排序输出
+    std::stable_sort(samples.begin(), samples.end(), [](const QualitySample &a, const QualitySample &b)
+                     { return a.scene != b.scene ? a.scene < b.scene : a.seconds < b.seconds; });
+    FILE *fp = fopen(csv.c_str(), "w");
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "Cannot open %s for writing\n", csv.c_str());
+        return 1;
+    }
+    fprintf(fp, "scene,spp,threads,seconds,rmse,relmse,ssim\n");
+    for (auto &s : samples)
+        fprintf(fp, "%s,%d,%d,%.6f,%.6f,%.6f,%.6f\n", s.scene.c_str(), s.spp, s.threads, s.seconds, s.rmse, s.relMSE, s.ssim);
+    fclose(fp);
+    printf("Error vs. seconds written to %s\n", csv.c_str());
+    return 0;
+}